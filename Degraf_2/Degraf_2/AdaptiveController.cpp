@@ -0,0 +1,151 @@
+/*!
+\file AdaptiveController.cpp
+\brief Time-budgeted DeGraF-Flow, adapts pipeline parameters from frame to frame to meet a latency target
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "AdaptiveController.h"
+
+#include <sstream>
+
+// Quality ladders, relative to the base configuration: index 0 leaves it unchanged and each further entry
+// is cheaper. With the default base they give the absolute settings in the comments.
+// Detection: added to the DeGraF step size (window stays fixed), steps 9, 11, 13, 15, 17
+static const int detection_step[] = { 0, 2, 4, 6, 8 };
+
+// Tracking: RLOF pyramid levels removed (4, 3, 3, 2, 2), iterations scaled (30, 20, 15, 10, 10) and a point
+// budget capping the base one (0 for none)
+static const int tracking_level_drop[] = { 0, 1, 1, 2, 2 };
+static const double tracking_iter_scale[] = { 1.0, 2.0 / 3.0, 0.5, 1.0 / 3.0, 1.0 / 3.0 };
+static const int tracking_budget[] = { 0, 0, 8000, 5000, 3000 };
+
+// Interpolation: support vectors scaled (127, 95, 63, 63, 31) and FGS post-processing
+static const double interpolation_k_scale[] = { 1.0, 0.75, 0.5, 0.5, 0.25 };
+static const bool interpolation_fgs[] = { true, true, true, false, false };
+
+// Constructor
+/*!
+\param p_target_ms per-frame latency budget in milliseconds
+\param p_base highest quality parameters the controller may use
+*/
+AdaptiveDegrafController::AdaptiveDegrafController(double p_target_ms, const DegrafFlowParams& p_base) {
+	target_ms = p_target_ms;
+	headroom = 0.1;
+	restore_fraction = 0.7;
+	restore_frames = 10;
+	base = p_base;
+	params = p_base;
+	frame_no = 0;
+	fast_frames = 0;
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		level[s] = 0;
+		stage_ema[s] = 0.0;
+	}
+}
+
+// Additionally writes every adjustment to a log file
+void AdaptiveDegrafController::setLogFile(const std::string& path) {
+	log_file.open(path.c_str(), std::ios::out | std::ios::trunc);
+}
+
+int AdaptiveDegrafController::ladderLength(int stage) const {
+	if (stage == DETECTION)
+		return sizeof(detection_step) / sizeof(int);
+	if (stage == TRACKING)
+		return sizeof(tracking_level_drop) / sizeof(int);
+	return sizeof(interpolation_k_scale) / sizeof(double);
+}
+
+// Derives params from the base configuration and the current ladder positions
+void AdaptiveDegrafController::applyLevels() {
+	params = base;
+
+	params.step_x = base.step_x + detection_step[level[DETECTION]];
+	params.step_y = base.step_y + detection_step[level[DETECTION]];
+
+	params.rlof_max_level = (std::max)(1, base.rlof_max_level - tracking_level_drop[level[TRACKING]]);
+	params.rlof_max_iter = (std::max)(1, (int)(base.rlof_max_iter * tracking_iter_scale[level[TRACKING]]));
+	if (tracking_budget[level[TRACKING]] > 0)
+		params.max_points = (base.max_points > 0) ? (std::min)(base.max_points, tracking_budget[level[TRACKING]]) : tracking_budget[level[TRACKING]];
+
+	// The interpolator needs k > 3
+	params.k = (std::max)(4, (int)(base.k * interpolation_k_scale[level[INTERPOLATION]]));
+	params.use_post_proc = base.use_post_proc && interpolation_fgs[level[INTERPOLATION]];
+}
+
+void AdaptiveDegrafController::log(const std::string& message) {
+	std::cout << "[adaptive] " << message << "\n";
+	if (log_file.is_open())
+		log_file << message << std::endl;
+}
+
+// Updates the ladder positions from the stage times of the frame just processed
+void AdaptiveDegrafController::adjust(const DegrafStageTimes& times) {
+	const char* stage_names[STAGE_COUNT] = { "detection", "tracking", "interpolation" };
+	double measured[STAGE_COUNT] = { times.detection * 1000.0, times.tracking * 1000.0, times.interpolation * 1000.0 };
+	double total_ms = times.total * 1000.0;
+
+	// Smooth with a short EMA, but never let the estimate lag below the latest measurement
+	for (int s = 0; s < STAGE_COUNT; s++)
+		stage_ema[s] = (frame_no == 0) ? measured[s] : (std::max)(measured[s], 0.7 * stage_ema[s] + 0.3 * measured[s]);
+	double predicted_ms = stage_ema[DETECTION] + stage_ema[TRACKING] + stage_ema[INTERPOLATION];
+
+	std::ostringstream msg;
+	if (predicted_ms > target_ms * (1.0 - headroom)) {
+		fast_frames = 0;
+
+		// Reduce the most expensive stage that still has a cheaper setting
+		int order[STAGE_COUNT] = { DETECTION, TRACKING, INTERPOLATION };
+		std::sort(order, order + STAGE_COUNT, [&](int a, int b) { return stage_ema[a] > stage_ema[b]; });
+		for (int i = 0; i < STAGE_COUNT; i++) {
+			int s = order[i];
+			if (level[s] + 1 < ladderLength(s)) {
+				level[s]++;
+				reductions.push_back(s);
+				DegrafFlowParams old_params = params;
+				applyLevels();
+				msg << "frame " << frame_no << ": " << total_ms << " ms (predicted " << predicted_ms << ", target " << target_ms
+					<< ") reduce " << stage_names[s] << " to level " << level[s]
+					<< " [step " << old_params.step_x << "->" << params.step_x
+					<< ", points " << old_params.max_points << "->" << params.max_points
+					<< ", rlof levels " << old_params.rlof_max_level << "->" << params.rlof_max_level
+					<< ", iter " << old_params.rlof_max_iter << "->" << params.rlof_max_iter
+					<< ", k " << old_params.k << "->" << params.k
+					<< ", fgs " << old_params.use_post_proc << "->" << params.use_post_proc << "]";
+				log(msg.str());
+				return;
+			}
+		}
+		msg << "frame " << frame_no << ": " << total_ms << " ms over target " << target_ms << " at the cheapest setting";
+		log(msg.str());
+	}
+	else if (predicted_ms < target_ms * restore_fraction && !reductions.empty()) {
+		// Restore the last reduction once the budget has been met comfortably for a while
+		if (++fast_frames >= restore_frames) {
+			int s = reductions.back();
+			reductions.pop_back();
+			level[s]--;
+			fast_frames = 0;
+			applyLevels();
+			msg << "frame " << frame_no << ": " << total_ms << " ms (predicted " << predicted_ms << ", target " << target_ms
+				<< ") restore " << stage_names[s] << " to level " << level[s];
+			log(msg.str());
+		}
+	}
+	else {
+		fast_frames = 0;
+	}
+}
+
+// Computes DeGraF-Flow for one frame pair with the current parameters, then adapts them for the next frame
+/*!
+\param from first image
+\param to second image, same size and type as from
+\param flow output optical flow, 2 channel image (middlebury format)
+*/
+void AdaptiveDegrafController::process(InputArray from, InputArray to, OutputArray flow) {
+	matcher.degraf_flow_RLOF(from, to, flow, params);
+	adjust(matcher.stage_times);
+	frame_no++;
+}
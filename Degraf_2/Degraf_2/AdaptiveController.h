@@ -0,0 +1,49 @@
+/*!
+\file AdaptiveController.h
+\brief Time-budgeted DeGraF-Flow, adapts pipeline parameters from frame to frame to meet a latency target
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FeatureMatcher.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Runs RLOF DeGraF-Flow on a stream of frame pairs while keeping the per-frame latency under a target.
+// Stage times are taken from the getTickCount instrumentation in FeatureMatcher. When a frame goes over
+// budget the most expensive stage is moved one notch down its quality ladder; quality is only restored
+// after a run of frames comfortably under budget, so EPE is traded away before frames are dropped.
+class AdaptiveDegrafController {
+
+	public:
+		// Stages that have a quality ladder
+		enum Stage { DETECTION = 0, TRACKING = 1, INTERPOLATION = 2, STAGE_COUNT = 3 };
+
+		double target_ms;			// per-frame latency budget
+		double headroom;			// reduce quality when predicted time exceeds target * (1 - headroom)
+		double restore_fraction;	// restore quality when time stays below target * restore_fraction
+		int restore_frames;			// number of consecutive fast frames needed before restoring
+		DegrafFlowParams params;	// parameters used for the next frame
+		FeatureMatcher matcher;		// last frame's matches and stage times
+
+		AdaptiveDegrafController(double p_target_ms, const DegrafFlowParams& p_base = DegrafFlowParams());
+		void setLogFile(const std::string& path);
+		void process(InputArray from, InputArray to, OutputArray flow);
+
+	private:
+		DegrafFlowParams base;
+		int level[STAGE_COUNT];
+		std::vector<int> reductions;	// stages in the order they were reduced, restored last-in first-out
+		double stage_ema[STAGE_COUNT];	// smoothed stage times in ms
+		int frame_no;
+		int fast_frames;
+		std::ofstream log_file;
+
+		int ladderLength(int stage) const;
+		void applyLevels();
+		void adjust(const DegrafStageTimes& times);
+		void log(const std::string& message);
+};
@@ -0,0 +1,335 @@
+/*!
+\file BatchEvaluator.cpp
+\brief Evaluates a flow method over every image pair listed in a dataset manifest, pairs run concurrently
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "BatchEvaluator.h"
+#include "KittiFlowIO.h"
+#include "DatasetCache.h"
+
+#include <atomic>
+#include <functional>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+std::vector<std::string> splitFields(const std::string& line)
+{
+	std::vector<std::string> fields;
+	size_t i = 0;
+	while (i < line.size()) {
+		while (i < line.size() && isspace((unsigned char)line[i]))
+			i++;
+		if (i >= line.size() || line[i] == '#')
+			break;
+		std::string field;
+		if (line[i] == '"') {
+			size_t end = line.find('"', i + 1);
+			if (end == std::string::npos)
+				end = line.size();
+			field = line.substr(i + 1, end - i - 1);
+			i = end + 1;
+		}
+		else {
+			while (i < line.size() && !isspace((unsigned char)line[i]))
+				field += line[i++];
+		}
+		fields.push_back(field);
+	}
+	return fields;
+}
+
+bool isAbsolutePath(const std::string& path)
+{
+	return (!path.empty() && (path[0] == '/' || path[0] == '\\')) || (path.size() > 1 && path[1] == ':');
+}
+
+bool readManifest(const std::string& path, std::vector<ManifestEntry>& entries)
+{
+	std::ifstream in(path.c_str());
+	if (!in.is_open()) {
+		printf("Could not open manifest %s\n", path.c_str());
+		return false;
+	}
+
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+
+	std::string line;
+	int line_no = 0;
+	while (std::getline(in, line)) {
+		line_no++;
+		std::vector<std::string> fields = splitFields(line);
+		if (fields.empty())
+			continue;
+		if (fields.size() != 4 || (fields[0] != "kitti" && fields[0] != "middlebury")) {
+			printf("%s:%d: expected <kitti|middlebury> <image 1> <image 2> <ground truth>\n", path.c_str(), line_no);
+			return false;
+		}
+		if (fields[3] == "-")
+			fields[3] = "";
+		for (int f = 1; f < 4; f++) {
+			if (!fields[f].empty() && !isAbsolutePath(fields[f]))
+				fields[f] = directory + fields[f];
+		}
+
+		ManifestEntry entry;
+		entry.data_set = fields[0];
+		entry.i1_path = fields[1];
+		entry.i2_path = fields[2];
+		entry.groundtruth_path = fields[3];
+		entry.line = line_no;
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+bool loadManifestPair(const ManifestEntry& entry, Mat& i1, Mat& i2, Mat& ground_truth)
+{
+	i1 = imread(entry.i1_path, IMREAD_COLOR);
+	i2 = imread(entry.i2_path, IMREAD_COLOR);
+	if (i1.empty() || i2.empty()) {
+		printf("No image data (%s, %s)\n", entry.i1_path.c_str(), entry.i2_path.c_str());
+		return false;
+	}
+	ground_truth.release();
+	if (entry.groundtruth_path.empty())
+		return true;
+	if (entry.data_set == "middlebury")
+		ground_truth = optflow::readOpticalFlow(entry.groundtruth_path);
+	else
+		readKittiFlow(entry.groundtruth_path, ground_truth);
+	if (ground_truth.empty()) {
+		printf("No ground truth data (%s)\n", entry.groundtruth_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+int writeManifest(const String& data_set, const std::string& root, const std::string& path)
+{
+	std::ofstream out(path.c_str());
+	if (!out.is_open())
+		return -1;
+
+	int pairs = 0;
+	out << "# " << data_set << " training pairs under " << root << "\n";
+	if (data_set == "middlebury") {
+		const char* names[] = { "Venus", "RubberWhale", "Grove2", "Grove3", "Urban2", "Urban3", "Hydrangea" };
+		for (int i = 0; i < 7; i++, pairs++) {
+			out << "middlebury \"" << root << "/other-data/" << names[i] << "/frame10.png\" \"" << root << "/other-data/" << names[i]
+				<< "/frame11.png\" \"" << root << "/other-gt-flow/" << names[i] << "/flow10.flo\"\n";
+		}
+	}
+	else if (data_set == "kitti") {
+		char num[16];
+		for (int i = 0; i < 194; i++, pairs++) {
+			sprintf(num, "%06d", i);
+			out << "kitti \"" << root << "/training/colored_0/" << num << "_10.png\" \"" << root << "/training/colored_0/" << num
+				<< "_11.png\" \"" << root << "/training/flow_noc/" << num << "_10.png\"\n";
+		}
+	}
+	else {
+		return -1;
+	}
+	return pairs;
+}
+
+// Name of a pair's result files, the first image's file name without directory and extension
+static std::string resultName(const ManifestEntry& entry)
+{
+	std::string name = entry.i1_path;
+	size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos)
+		name = name.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos)
+		name = name.substr(0, dot);
+	return name;
+}
+
+StatsAggregator& BatchSummary::dataSet(const String& name)
+{
+	for (size_t d = 0; d < data_sets.size(); d++) {
+		if (data_sets[d] == name)
+			return stats[d];
+	}
+	data_sets.push_back(name);
+	stats.push_back(StatsAggregator());
+	return stats.back();
+}
+
+// Runs evaluate(e, i) for every pair index on the pool. Each worker owns one EvaluateOptFlow, claims one
+// pair at a time and stores its result by index; entries name the pairs for messages and result files.
+// The summary is folded once the pool is done, in pair order, so it does not depend on scheduling or
+// thread count.
+static std::vector<BatchResult> runWorkers(const std::vector<ManifestEntry>& entries, int threads, ResultWriter* writer,
+	BatchSummary* summary, const std::function<int(EvaluateOptFlow&, size_t)>& evaluate)
+{
+	std::vector<BatchResult> results(entries.size());
+	if (entries.empty())
+		return results;
+
+	ThreadPool pool(threads);
+	int workers = (std::min)(pool.size(), (int)entries.size());
+
+	SerialOpenCVScope serial_opencv(workers);
+
+	std::atomic<size_t> next(0);
+	std::atomic<int> done(0);
+	for (int w = 0; w < workers; w++) {
+		pool.submit([&]() {
+			EvaluateOptFlow e;
+			e.verbose = false;
+			e.fixed_image_no = -1;
+			e.result_writer = writer;
+			for (;;) {
+				size_t i = next++;
+				if (i >= entries.size())
+					break;
+				const ManifestEntry& entry = entries[i];
+				e.data_set = entry.data_set;
+				e.result_name = resultName(entry);
+				try {
+					results[i].status = evaluate(e, i);
+				}
+				catch (const std::exception& ex) {
+					printf("Manifest line %d: %s\n", entry.line, ex.what());
+					results[i].status = -1;
+				}
+				catch (...) {
+					printf("Manifest line %d: unknown error\n", entry.line);
+					results[i].status = -1;
+				}
+				if (results[i].status == 0)
+					results[i].result = e.last_result;
+
+				int finished = ++done;
+				if (finished % 10 == 0 || finished == (int)entries.size())
+					printf("  %d / %d pairs\n", finished, (int)entries.size());
+			}
+		});
+	}
+	pool.wait();
+
+	if (summary != NULL) {
+		for (size_t i = 0; i < results.size(); i++) {
+			if (results[i].status != 0)
+				continue;
+			summary->dataSet(entries[i].data_set).add(results[i].result);
+			summary->total.add(results[i].result);
+		}
+	}
+	return results;
+}
+
+std::vector<BatchResult> evaluateBatch(const std::vector<ManifestEntry>& entries, const String& method, int threads, ResultWriter* writer,
+	BatchSummary* summary)
+{
+	return runWorkers(entries, threads, writer, summary, [&](EvaluateOptFlow& e, size_t i) {
+		const ManifestEntry& entry = entries[i];
+		return e.evaluatePair(method, entry.i1_path, entry.i2_path, entry.groundtruth_path, false, (int)i);
+	});
+}
+
+// Manifest-like entries naming the pairs of a cache, the first image path holds the cached name
+std::vector<ManifestEntry> cacheEntries(const DatasetCache& cache)
+{
+	std::vector<ManifestEntry> entries(cache.size());
+	for (int i = 0; i < cache.size(); i++) {
+		entries[i].data_set = cache.pair(i).data_set;
+		entries[i].i1_path = cache.pair(i).name;
+		entries[i].line = i + 1;
+	}
+	return entries;
+}
+
+std::vector<BatchResult> evaluateBatch(const DatasetCache& cache, const String& method, int threads, ResultWriter* writer,
+	BatchSummary* summary)
+{
+	return runWorkers(cacheEntries(cache), threads, writer, summary, [&](EvaluateOptFlow& e, size_t i) {
+		const DatasetCache::Pair& p = cache.pair((int)i);
+		return e.evaluateFrames(method, p.i1, p.i2, p.ground_truth, p.regionMask(e.region), false, (int)i);
+	});
+}
+
+int runBatchEvaluation(const std::string& manifest, const String& method, int threads, const std::string& output_csv, const std::string& output_dir,
+	int outputs, int policy)
+{
+	// A .dgc container replaces the manifest, frames then come straight from the mapping
+	std::vector<ManifestEntry> entries;
+	DatasetCache cache;
+	bool cached = isDatasetCache(manifest);
+	if (cached) {
+		if (!cache.open(manifest))
+			return -1;
+		entries = cacheEntries(cache);
+	}
+	else if (!readManifest(manifest, entries)) {
+		return -1;
+	}
+
+	// Encoding and disk writes run on their own threads, a few records deep per evaluation worker
+	std::unique_ptr<ResultWriter> writer;
+	if (!output_dir.empty()) {
+		int workers = threads > 0 ? threads : ThreadPool::hardwareThreads();
+		writer.reset(new ResultWriter(output_dir, 2 * workers, (std::max)(1, workers / 2), policy, outputs));
+	}
+
+	printf("Evaluating %s on %d pairs from %s\n", method.c_str(), (int)entries.size(), manifest.c_str());
+	int64 start = getTickCount();
+	BatchSummary summary;
+	std::vector<BatchResult> results = cached ? evaluateBatch(cache, method, threads, writer.get(), &summary)
+		: evaluateBatch(entries, method, threads, writer.get(), &summary);
+	double evaluation = (double)(getTickCount() - start) / getTickFrequency();
+	if (writer)
+		writer->flush();
+	double wall = (double)(getTickCount() - start) / getTickFrequency();
+
+	std::ofstream csv(output_csv.c_str());
+	csv << "index,data_set,image_1,status,epe,std,r0.5,r1,r2,r3,r5,r10,fl,time_s\n";
+
+	int failures = 0;
+	for (size_t i = 0; i < results.size(); i++) {
+		csv << i << "," << entries[i].data_set << ",\"" << entries[i].i1_path << "\"," << results[i].status;
+		if (results[i].status != 0) {
+			failures++;
+			csv << "\n";
+			continue;
+		}
+		// Accuracy columns are left empty for pairs without ground truth
+		const PairResult& r = results[i].result;
+		if (r.has_ground_truth) {
+			csv << "," << r.error_mean << "," << r.error_std;
+			for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+				csv << "," << r.R[t];
+			csv << "," << r.fl;
+		}
+		else {
+			csv << std::string(3 + FlowMetrics::R_COUNT, ',');
+		}
+		csv << "," << r.seconds << "\n";
+	}
+
+	cout << "---------------   Batch Stats  -------------------\n";
+	cout << "# data set     pairs   EPE      STD      R2.0     R3.0     time [s]\n";
+	for (size_t d = 0; d < summary.data_sets.size(); d++) {
+		const StatsAggregator& a = summary.stats[d];
+		printf("%-12s %7lld   %6.3f   %6.3f   %6.2f   %6.2f   %8.3f\n", summary.data_sets[d].c_str(), a.pairs(), a.mean(StatsAggregator::FIELD_EPE),
+			a.mean(StatsAggregator::FIELD_STD), a.mean(StatsAggregator::FIELD_R2), a.mean(StatsAggregator::FIELD_R3), a.mean(StatsAggregator::FIELD_TIME));
+	}
+	cout << "\nAll pairs:\n";
+	summary.total.print();
+	printf("%d pairs in %.1f s (%.2f pairs/s), %d failed\n", (int)results.size(), wall, results.size() / wall, failures);
+	if (writer) {
+		printf("Results of %lld pairs written to %s (%.1f s after evaluation), %lld dropped, %lld failed\n", writer->written(), output_dir.c_str(),
+			wall - evaluation, writer->dropped(), writer->failed());
+		if (writer->failed() > 0)
+			failures++;
+	}
+	cout << "Per-pair results written to " << output_csv << "\n";
+
+	return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,100 @@
+/*!
+\file BatchEvaluator.h
+\brief Evaluates a flow method over every image pair listed in a dataset manifest, pairs run concurrently
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "EvaluateOptFlow.h"
+#include "ThreadPool.h"
+#include "ResultWriter.h"
+
+#include <string>
+#include <vector>
+
+// One image pair of a manifest. Manifest lines read
+//     <data set> <image 1> <image 2> <ground truth>
+// with data set "kitti" or "middlebury", fields separated by whitespace and quoted with "" when a path
+// contains spaces. Relative paths are taken relative to the manifest's directory; # starts a comment.
+// A ground truth of - evaluates runtime only (e.g. to produce submission files for a test set).
+struct ManifestEntry {
+	String data_set;
+	String i1_path, i2_path, groundtruth_path;
+	int line;			// line number in the manifest, for error messages
+};
+
+// Result of one pair
+struct BatchResult {
+	int status = -1;	// return value of EvaluateOptFlow::evaluatePair, -1 until it returns
+	PairResult result;
+};
+
+// Aggregate stats of a batch per data set (in order of first appearance) and over all pairs
+struct BatchSummary {
+	std::vector<String> data_sets;
+	std::vector<StatsAggregator> stats;
+	StatsAggregator total;
+
+	StatsAggregator& dataSet(const String& name);	// aggregate of a data set, added if not present
+};
+
+// Splits a manifest line into whitespace separated fields, "" quotes a field containing spaces and # starts a comment
+std::vector<std::string> splitFields(const std::string& line);
+
+// True for paths starting at a root (/, \ or a drive letter)
+bool isAbsolutePath(const std::string& path);
+
+// Decodes the frames and ground truth of a manifest pair, ground truth is left empty when the entry has none
+/*!
+\return false (with a message) if a file could not be read
+*/
+bool loadManifestPair(const ManifestEntry& entry, Mat& i1, Mat& i2, Mat& ground_truth);
+
+/*!
+\param path manifest file
+\param entries output, pairs in manifest order
+\return false if the file could not be read or a line is malformed
+*/
+bool readManifest(const std::string& path, std::vector<ManifestEntry>& entries);
+
+// Writes a manifest for the standard layout of the KITTI 2012 or Middlebury training sets
+/*!
+\param data_set "kitti" (data_stereo_flow/training under root) or "middlebury" (other-data and other-gt-flow under root)
+\param root data set directory
+\param path manifest file to write
+\return number of pairs written, -1 on error
+*/
+int writeManifest(const String& data_set, const std::string& root, const std::string& path);
+
+// Evaluates method on all manifest pairs. Each worker owns an EvaluateOptFlow (and so its own pipeline
+// and controller state); results are stored by manifest index, so output order does not depend on scheduling.
+/*!
+\param entries pairs to evaluate
+\param method flow method, see EvaluateOptFlow::evaluatePair
+\param threads number of concurrent pairs, <= 0 for one per hardware thread
+\param writer if not NULL, receives each pair's flow under the first image's name (see ResultWriter); must be flushed
+before the inputs are released
+\param summary if not NULL, receives the aggregate stats; folded in manifest order, so identical for any thread count
+\return results in manifest order
+*/
+std::vector<BatchResult> evaluateBatch(const std::vector<ManifestEntry>& entries, const String& method, int threads = 0, ResultWriter* writer = NULL,
+	BatchSummary* summary = NULL);
+
+class DatasetCache;
+
+// Same as above with the pairs of a dataset cache (no decoding, region masks precomputed)
+std::vector<BatchResult> evaluateBatch(const DatasetCache& cache, const String& method, int threads = 0, ResultWriter* writer = NULL,
+	BatchSummary* summary = NULL);
+std::vector<ManifestEntry> cacheEntries(const DatasetCache& cache);
+
+// Command line entry, prints a summary and writes per-pair stats to output_csv. manifest may also be a
+// dataset cache (.dgc) written by DatasetCache::build.
+/*!
+\param output_dir if not empty, the artefacts selected by outputs are written there by a background ResultWriter
+\param outputs combination of ResultWriter::Output flags
+\param policy ResultWriter::Policy when writing falls behind evaluation
+\return 0 if every pair was evaluated and written, -1 otherwise
+*/
+int runBatchEvaluation(const std::string& manifest, const String& method, int threads, const std::string& output_csv, const std::string& output_dir = "",
+	int outputs = ResultWriter::OUTPUT_FLOW, int policy = ResultWriter::POLICY_BLOCK);
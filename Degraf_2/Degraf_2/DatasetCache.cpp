@@ -0,0 +1,247 @@
+/*!
+\file DatasetCache.cpp
+\brief Binary container of decoded frames, float ground truth and region masks, opened by memory mapping
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "DatasetCache.h"
+#include "KittiFlowIO.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+
+static const char CACHE_MAGIC[8] = { 'D', 'G', 'F', 'C', 'A', 'C', 'H', 'E' };
+static const unsigned int CACHE_VERSION = 1;
+static const unsigned long long CACHE_ALIGN = 64;
+
+enum CacheDataSet { CACHE_KITTI = 0, CACHE_MIDDLEBURY = 1 };
+
+#pragma pack(push, 1)
+struct CacheHeader {
+	char magic[8];
+	unsigned int version;
+	unsigned int pair_count;
+};
+
+struct CacheBlob {
+	unsigned long long offset;	// from the start of the file, 0 for an empty blob
+	int rows, cols, type;
+	unsigned int step;
+};
+
+struct CachePairRecord {
+	int data_set;
+	int source_line;
+	char name[64];
+	CacheBlob blobs[DatasetCache::BLOB_COUNT];
+};
+#pragma pack(pop)
+
+bool isDatasetCache(const std::string& path)
+{
+	return path.size() > 4 && path.substr(path.size() - 4) == ".dgc";
+}
+
+const Mat& DatasetCache::Pair::regionMask(const String& region) const
+{
+	static const Mat none;
+	if (region == "discontinuities")
+		return mask_discontinuities;
+	if (region == "untextured")
+		return mask_untextured;
+	return none;
+}
+
+// Decoded content of one pair, produced on a worker
+struct DecodedPair {
+	bool ok;
+	Mat blobs[DatasetCache::BLOB_COUNT];
+};
+
+static DecodedPair decodePair(const ManifestEntry& entry)
+{
+	DecodedPair d;
+	d.ok = false;
+	d.blobs[DatasetCache::BLOB_I1] = imread(entry.i1_path, 1);
+	d.blobs[DatasetCache::BLOB_I2] = imread(entry.i2_path, 1);
+	if (d.blobs[DatasetCache::BLOB_I1].empty() || d.blobs[DatasetCache::BLOB_I2].empty()) {
+		printf("No image data (%s, %s)\n", entry.i1_path.c_str(), entry.i2_path.c_str());
+		return d;
+	}
+
+	if (!entry.groundtruth_path.empty()) {
+		Mat gt;
+		if (entry.data_set == "middlebury")
+			gt = optflow::readOpticalFlow(entry.groundtruth_path);
+		else
+			readKittiFlow(entry.groundtruth_path, gt);
+		if (gt.empty()) {
+			printf("No ground truth data (%s)\n", entry.groundtruth_path.c_str());
+			return d;
+		}
+		d.blobs[DatasetCache::BLOB_GROUND_TRUTH] = gt;
+		EvaluateOptFlow::regionMask("discontinuities", gt, d.blobs[DatasetCache::BLOB_I1], d.blobs[DatasetCache::BLOB_MASK_DISCONTINUITIES]);
+	}
+	EvaluateOptFlow::regionMask("untextured", Mat(), d.blobs[DatasetCache::BLOB_I1], d.blobs[DatasetCache::BLOB_MASK_UNTEXTURED]);
+	d.ok = true;
+	return d;
+}
+
+// Appends a blob at the next aligned offset, rows are packed without padding
+static CacheBlob writeBlob(std::ofstream& out, unsigned long long& offset, const Mat& m)
+{
+	static const char zeros[CACHE_ALIGN] = { 0 };
+	CacheBlob blob;
+	memset(&blob, 0, sizeof(blob));
+	if (m.empty())
+		return blob;
+
+	unsigned long long aligned = (offset + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+	out.write(zeros, (std::streamsize)(aligned - offset));
+	offset = aligned;
+
+	blob.offset = offset;
+	blob.rows = m.rows;
+	blob.cols = m.cols;
+	blob.type = m.type();
+	blob.step = (unsigned int)(m.cols * m.elemSize());
+	for (int i = 0; i < m.rows; i++)
+		out.write((const char*)m.ptr(i), blob.step);
+	offset += (unsigned long long)blob.step * m.rows;
+	return blob;
+}
+
+// Writes header, pair table and blobs of every entry to out
+static bool writeCache(const std::vector<ManifestEntry>& entries, std::ofstream& out, int threads)
+{
+	CacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.pair_count = (unsigned int)entries.size();
+	std::vector<CachePairRecord> records(entries.size());
+	memset(records.data(), 0, records.size() * sizeof(CachePairRecord));
+
+	// Header and table are rewritten once the blob offsets are known
+	out.write((const char*)&header, sizeof(header));
+	if (!records.empty())
+		out.write((const char*)records.data(), records.size() * sizeof(CachePairRecord));
+	unsigned long long offset = sizeof(header) + records.size() * sizeof(CachePairRecord);
+
+	// Decode a window of pairs concurrently, write them in manifest order
+	ThreadPool pool(threads);
+	size_t window = (size_t)pool.size() * 2;
+	for (size_t first = 0; first < entries.size(); first += window) {
+		size_t last = (std::min)(entries.size(), first + window);
+		std::vector<std::future<DecodedPair> > decoded;
+		for (size_t i = first; i < last; i++)
+			decoded.push_back(pool.submit([&entries, i]() { return decodePair(entries[i]); }));
+
+		for (size_t i = first; i < last; i++) {
+			DecodedPair d = decoded[i - first].get();
+			if (!d.ok)
+				return false;
+			records[i].data_set = entries[i].data_set == "middlebury" ? CACHE_MIDDLEBURY : CACHE_KITTI;
+			records[i].source_line = entries[i].line;
+			std::string name = entries[i].i1_path;
+			size_t slash = name.find_last_of("/\\");
+			if (slash != std::string::npos)
+				name = name.substr(slash + 1);
+			size_t dot = name.find_last_of('.');
+			if (dot != std::string::npos)
+				name = name.substr(0, dot);
+			strncpy(records[i].name, name.c_str(), sizeof(records[i].name) - 1);
+			for (int b = 0; b < DatasetCache::BLOB_COUNT; b++)
+				records[i].blobs[b] = writeBlob(out, offset, d.blobs[b]);
+		}
+		printf("  %d / %d pairs cached\n", (int)last, (int)entries.size());
+	}
+
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+	if (!records.empty())
+		out.write((const char*)records.data(), records.size() * sizeof(CachePairRecord));
+	return out.good();
+}
+
+bool DatasetCache::build(const std::vector<ManifestEntry>& entries, const std::string& path, int threads)
+{
+	// Written under a temporary name and renamed once complete, so a failed build never leaves a file
+	// with a valid header behind
+	std::string temp = path + ".part";
+	std::ofstream out(temp.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		printf("Could not create %s\n", temp.c_str());
+		return false;
+	}
+
+	bool ok = writeCache(entries, out, threads);
+	out.close();
+	if (!ok || out.fail()) {
+		printf("Could not write %s\n", path.c_str());
+		std::remove(temp.c_str());
+		return false;
+	}
+
+	// rename does not replace an existing file on Windows
+	std::remove(path.c_str());
+	if (std::rename(temp.c_str(), path.c_str()) != 0) {
+		printf("Could not rename %s to %s\n", temp.c_str(), path.c_str());
+		std::remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool DatasetCache::open(const std::string& path)
+{
+	pairs.clear();
+	if (!file.open(path)) {
+		printf("Could not map %s\n", path.c_str());
+		return false;
+	}
+
+	const unsigned char* base = file.data();
+	CacheHeader header;
+	if (file.size() < sizeof(header))
+		return false;
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION) {
+		printf("%s is not a dataset cache of version %u\n", path.c_str(), CACHE_VERSION);
+		return false;
+	}
+	if (file.size() < sizeof(header) + (size_t)header.pair_count * sizeof(CachePairRecord))
+		return false;
+
+	const CachePairRecord* records = (const CachePairRecord*)(base + sizeof(header));
+	pairs.resize(header.pair_count);
+	for (unsigned int i = 0; i < header.pair_count; i++) {
+		Pair& p = pairs[i];
+		p.data_set = records[i].data_set == CACHE_MIDDLEBURY ? "middlebury" : "kitti";
+		char name[sizeof(records[i].name) + 1] = { 0 };
+		memcpy(name, records[i].name, sizeof(records[i].name));
+		p.name = name;
+		Mat* targets[BLOB_COUNT] = { &p.i1, &p.i2, &p.ground_truth, &p.mask_discontinuities, &p.mask_untextured };
+		for (int b = 0; b < BLOB_COUNT; b++) {
+			const CacheBlob& blob = records[i].blobs[b];
+			if (blob.offset == 0) {
+				// Only ground truth and masks are optional, every pair has both frames
+				if (b == BLOB_I1 || b == BLOB_I2) {
+					printf("%s: pair %u has no image data\n", path.c_str(), i);
+					pairs.clear();
+					return false;
+				}
+				continue;
+			}
+			if (blob.offset + (unsigned long long)blob.step * blob.rows > file.size()) {
+				printf("%s is truncated\n", path.c_str());
+				pairs.clear();
+				return false;
+			}
+			*targets[b] = Mat(blob.rows, blob.cols, blob.type, file.data() + blob.offset, blob.step);
+		}
+	}
+	return true;
+}
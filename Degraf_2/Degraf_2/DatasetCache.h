@@ -0,0 +1,54 @@
+/*!
+\file DatasetCache.h
+\brief Binary container of decoded frames, float ground truth and region masks, opened by memory mapping
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "BatchEvaluator.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+
+// Layout (little endian, every blob starts on a 64 byte boundary so rows can be loaded with aligned SIMD):
+//   CacheHeader | CachePairRecord x pair_count | blobs
+// Each pair stores the two frames as decoded by imread (CV_8UC3), ground truth as CV_32FC2 with NaN
+// where unknown, and the "discontinuities" and "untextured" region masks (CV_8U). Missing ground truth
+// is stored as an empty blob.
+class DatasetCache {
+
+	public:
+		enum Blob { BLOB_I1 = 0, BLOB_I2, BLOB_GROUND_TRUTH, BLOB_MASK_DISCONTINUITIES, BLOB_MASK_UNTEXTURED, BLOB_COUNT };
+
+		// One cached pair, all Mats point into the mapping (no copy)
+		struct Pair {
+			String data_set;
+			String name;			// file name of the first image without directory and extension
+			Mat i1, i2, ground_truth;
+			Mat mask_discontinuities, mask_untextured;
+
+			const Mat& regionMask(const String& region) const;	// empty for "all"
+		};
+
+		// Decodes every manifest pair once and writes the container, decoding runs on the pool
+		/*!
+		\param entries pairs to import
+		\param path container file to write
+		\param threads decode workers, <= 0 for one per hardware thread
+		\return false if a pair could not be decoded or the file could not be written
+		*/
+		static bool build(const std::vector<ManifestEntry>& entries, const std::string& path, int threads = 0);
+
+		bool open(const std::string& path);
+		int size() const { return (int)pairs.size(); }
+		const Pair& pair(int i) const { return pairs[i]; }
+
+	private:
+		MappedFile file;
+		std::vector<Pair> pairs;
+};
+
+// True for file names ending in the container extension (.dgc)
+bool isDatasetCache(const std::string& path);
@@ -0,0 +1,267 @@
+/*!
+\file EssentialEstimator.cpp
+\brief Essential matrix estimation with quality-ordered PROSAC sampling, SPRT and parallel hypothesis scoring
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "EssentialEstimator.h"
+
+#include "opencv2/calib3d.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+static const int SAMPLE_SIZE = 5;
+
+// Correspondence in normalised camera coordinates
+struct NormalisedPair {
+	double x1, y1, x2, y2;
+};
+
+// Squared Sampson distance of x2' E x1 = 0, as used by findEssentialMat
+static inline double sampsonError(const Matx33d& E, const NormalisedPair& p)
+{
+	double ex1_0 = E(0, 0) * p.x1 + E(0, 1) * p.y1 + E(0, 2);
+	double ex1_1 = E(1, 0) * p.x1 + E(1, 1) * p.y1 + E(1, 2);
+	double ex1_2 = E(2, 0) * p.x1 + E(2, 1) * p.y1 + E(2, 2);
+	double etx2_0 = E(0, 0) * p.x2 + E(1, 0) * p.y2 + E(2, 0);
+	double etx2_1 = E(0, 1) * p.x2 + E(1, 1) * p.y2 + E(2, 1);
+	double x2tex1 = p.x2 * ex1_0 + p.y2 * ex1_1 + ex1_2;
+	return x2tex1 * x2tex1 / (ex1_0 * ex1_0 + ex1_1 * ex1_1 + etx2_0 * etx2_0 + etx2_1 * etx2_1);
+}
+
+// SPRT decision threshold A for inlier ratio epsilon and bad-model consistency delta (Chum and Matas),
+// with model estimation costing ~200 point verifications and ~4 models per five-point sample
+static double sprtThreshold(double epsilon, double delta)
+{
+	if (epsilon <= delta)
+		return DBL_MAX;
+	const double t_m = 200.0, m_s = 4.0;
+	double c = (1 - delta) * log((1 - delta) / (1 - epsilon)) + delta * log(delta / epsilon);
+	double a0 = t_m * c / m_s + 1, a = a0;
+	for (int i = 0; i < 10; i++)
+		a = a0 + log(a);
+	return a;
+}
+
+// One hypothesis evaluated in a round
+struct Hypothesis {
+	Matx33d E;
+	int inliers;
+	int tested;
+	bool rejected;
+};
+
+// Everything produced for one sample of a round
+struct SampleResult {
+	std::vector<Hypothesis> hypotheses;
+};
+
+Mat findEssentialMatProsac(const std::vector<Point2f>& points1, const std::vector<Point2f>& points2, const std::vector<float>& quality,
+	double focal, Point2d pp, OutputArray mask, const EssentialParams& params, EssentialStats* stats)
+{
+	CV_Assert(points1.size() == points2.size());
+	CV_Assert(quality.empty() || quality.size() == points1.size());
+	int n_points = (int)points1.size();
+	if (stats != NULL)
+		*stats = EssentialStats();
+	if (mask.needed()) {
+		mask.create(n_points, 1, CV_8U);
+		mask.getMat().setTo(Scalar::all(0));
+	}
+	if (n_points < SAMPLE_SIZE)
+		return Mat();
+
+	// Points ranked by quality, best first
+	std::vector<int> ranked(n_points);
+	std::iota(ranked.begin(), ranked.end(), 0);
+	if (!quality.empty())
+		std::stable_sort(ranked.begin(), ranked.end(), [&](int a, int b) { return quality[a] > quality[b]; });
+
+	std::vector<NormalisedPair> pairs(n_points);
+	for (int i = 0; i < n_points; i++) {
+		const Point2f& a = points1[ranked[i]];
+		const Point2f& b = points2[ranked[i]];
+		pairs[i].x1 = (a.x - pp.x) / focal;
+		pairs[i].y1 = (a.y - pp.y) / focal;
+		pairs[i].x2 = (b.x - pp.x) / focal;
+		pairs[i].y2 = (b.y - pp.y) / focal;
+	}
+	double threshold = params.threshold / focal;
+	double threshold_sq = threshold * threshold;
+
+	// Scoring points: the best max_score_points, verified in a fixed random order so SPRT sees an
+	// unbiased sequence
+	int n_score = params.max_score_points > 0 ? (std::min)(params.max_score_points, n_points) : n_points;
+	std::vector<int> score_order(n_score);
+	std::iota(score_order.begin(), score_order.end(), 0);
+	RNG order_rng(params.seed ^ 0x9e3779b97f4a7c15ULL);
+	for (int i = n_score - 1; i > 0; i--)
+		std::swap(score_order[i], score_order[order_rng.uniform(0, i + 1)]);
+
+	// PROSAC growth of the sampling pool (Chum and Matas): T_n samples are expected to be drawn from the best n
+	// points before the pool grows to n + 1
+	const double prosac_samples = 200000.0;
+	double t_n = prosac_samples;
+	for (int i = 0; i < SAMPLE_SIZE; i++)
+		t_n *= (double)(SAMPLE_SIZE - i) / (n_points - i);
+	double t_n_prime = 1;
+	int pool = SAMPLE_SIZE;
+
+	int batch = (std::max)(1, params.batch);
+	double epsilon = 0.3, delta = 0.01;		// initial inlier ratio and bad-model consistency
+	double sprt_a = params.sprt ? sprtThreshold(epsilon, delta) : DBL_MAX;
+	double rejected_consistency = 0;
+	int rejected_count = 0;
+
+	Matx33d best_E;
+	int best_inliers = -1;
+	int samples = 0, hypotheses = 0, rejected_early = 0;
+	int needed = params.max_iterations;
+
+	std::vector<std::vector<int> > sample_points(batch, std::vector<int>(SAMPLE_SIZE));
+	std::vector<SampleResult> results(batch);
+	while (samples < needed) {
+		int round = (std::min)(batch, needed - samples);
+
+		// Samples are drawn sequentially (cheap, and deterministic), solving and scoring runs in parallel
+		for (int s = 0; s < round; s++) {
+			int t = samples + s + 1;
+			bool grow_sample = true;
+			if (params.prosac) {
+				if (t > t_n_prime && pool < n_points) {
+					double t_n1 = t_n * (pool + 1) / (pool + 1 - SAMPLE_SIZE);
+					t_n_prime += ceil(t_n1 - t_n);
+					t_n = t_n1;
+					pool++;
+				}
+				grow_sample = t_n_prime >= t;
+			}
+			int range = params.prosac ? pool : n_points;
+
+			// PROSAC takes the newest point of the pool and the rest from the points before it
+			RNG rng(params.seed + (uint64)t * 0x2545f4914f6cdd1dULL);
+			std::vector<int>& sample = sample_points[s];
+			int k = 0;
+			if (params.prosac && grow_sample)
+				sample[k++] = range - 1;
+			int draw_range = (params.prosac && grow_sample) ? range - 1 : range;
+			while (k < SAMPLE_SIZE) {
+				int candidate = rng.uniform(0, draw_range);
+				if (std::find(sample.begin(), sample.begin() + k, candidate) == sample.begin() + k)
+					sample[k++] = candidate;
+			}
+		}
+
+		parallel_for_(Range(0, round), [&](const Range& r) {
+			std::vector<Point2d> p1(SAMPLE_SIZE), p2(SAMPLE_SIZE);
+			for (int s = r.start; s < r.end; s++) {
+				results[s].hypotheses.clear();
+				for (int k = 0; k < SAMPLE_SIZE; k++) {
+					const NormalisedPair& p = pairs[sample_points[s][k]];
+					p1[k] = Point2d(p.x1, p.y1);
+					p2[k] = Point2d(p.x2, p.y2);
+				}
+
+				// findEssentialMat on exactly five points runs the five-point solver once and returns all
+				// solutions stacked as 3 x 3 blocks
+				Mat Es;
+				try {
+					Es = findEssentialMat(p1, p2, 1.0, Point2d(0, 0), RANSAC, 0.99, threshold);
+				}
+				catch (const cv::Exception&) {
+					continue;
+				}
+
+				for (int m = 0; m + 3 <= Es.rows; m += 3) {
+					Hypothesis h;
+					h.E = Matx33d(Es.rowRange(m, m + 3));
+					h.inliers = 0;
+					h.tested = 0;
+					h.rejected = false;
+
+					// Wald's likelihood ratio, reject once the hypothesis is more likely bad than good
+					double lambda = 1.0;
+					double consistent_step = delta / epsilon, inconsistent_step = (1 - delta) / (1 - epsilon);
+					for (int i = 0; i < n_score; i++) {
+						bool inlier = sampsonError(h.E, pairs[score_order[i]]) <= threshold_sq;
+						h.tested++;
+						if (inlier)
+							h.inliers++;
+						if (params.sprt) {
+							lambda *= inlier ? consistent_step : inconsistent_step;
+							if (lambda > sprt_a) {
+								h.rejected = true;
+								break;
+							}
+						}
+					}
+					results[s].hypotheses.push_back(h);
+				}
+			}
+		});
+
+		// Reduced in sample order, so the result does not depend on the thread count
+		for (int s = 0; s < round; s++) {
+			for (size_t m = 0; m < results[s].hypotheses.size(); m++) {
+				const Hypothesis& h = results[s].hypotheses[m];
+				hypotheses++;
+				if (h.rejected) {
+					rejected_early++;
+					rejected_consistency += (double)h.inliers / h.tested;
+					rejected_count++;
+					continue;
+				}
+				if (h.inliers > best_inliers) {
+					best_inliers = h.inliers;
+					best_E = h.E;
+				}
+			}
+		}
+		samples += round;
+
+		if (best_inliers > 0) {
+			// SPRT parameters follow the best support and the consistency of rejected models
+			epsilon = (std::max)(epsilon, (double)best_inliers / n_score);
+			if (rejected_count > 0)
+				delta = (std::min)(0.5, (std::max)(0.001, rejected_consistency / rejected_count));
+			if (params.sprt)
+				sprt_a = sprtThreshold(epsilon, delta);
+
+			// Standard RANSAC stopping rule on the inlier ratio of the best hypothesis
+			double w = (double)best_inliers / n_score;
+			double p_good = pow(w, SAMPLE_SIZE);
+			if (p_good >= 1.0)
+				needed = samples;
+			else if (p_good > 0) {
+				// Clamped before the cast, the count is far beyond int for a small p_good
+				double rounds = ceil(log(1 - params.confidence) / log(1 - p_good));
+				needed = rounds < params.max_iterations ? (int)rounds : params.max_iterations;
+			}
+		}
+	}
+
+	if (stats != NULL) {
+		stats->samples = samples;
+		stats->hypotheses = hypotheses;
+		stats->rejected_early = rejected_early;
+	}
+	if (best_inliers < 0)
+		return Mat();
+
+	// Final inlier mask over all points, in the caller's order
+	int total_inliers = 0;
+	if (mask.needed()) {
+		Mat m = mask.getMat();
+		parallel_for_(Range(0, n_points), [&](const Range& r) {
+			for (int i = r.start; i < r.end; i++)
+				m.at<uchar>(ranked[i]) = sampsonError(best_E, pairs[i]) <= threshold_sq ? 1 : 0;
+		});
+		total_inliers = countNonZero(m);
+	}
+	if (stats != NULL)
+		stats->inliers = total_inliers;
+	return Mat(best_E, true);
+}
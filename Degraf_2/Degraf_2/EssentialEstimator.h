@@ -0,0 +1,51 @@
+/*!
+\file EssentialEstimator.h
+\brief Essential matrix estimation with quality-ordered PROSAC sampling, SPRT and parallel hypothesis scoring
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+
+#include <vector>
+
+using namespace cv;
+
+struct EssentialParams {
+	double confidence = 0.999;		// probability of having drawn an all-inlier sample when sampling stops
+	double threshold = 1.0;			// Sampson distance in pixels for a point to count as an inlier
+	int max_iterations = 1000;		// samples drawn at most
+	int max_score_points = 0;		// hypotheses are scored on the best this many points by quality, 0 for all
+	bool prosac = true;				// draw samples from the best points first, uniform RANSAC sampling otherwise
+	bool sprt = true;				// abandon scoring a hypothesis as soon as it is unlikely to beat the best
+	int batch = 32;					// samples solved and scored in parallel per round; fixed, since the stopping rule is
+									// checked per round and the result would otherwise vary with the thread count
+	uint64 seed = 0x5eed;			// samples depend only on the seed, not on the thread count
+};
+
+struct EssentialStats {
+	int samples;					// minimal samples drawn
+	int hypotheses;					// essential matrices scored (a sample gives up to 10)
+	int rejected_early;				// hypotheses abandoned by SPRT
+	int inliers;					// inliers of the returned matrix over all points
+};
+
+// Drop-in replacement for findEssentialMat(points1, points2, focal, pp, RANSAC, confidence, threshold, mask).
+// Samples are drawn PROSAC style from points sorted by quality, so the first hypotheses come from the most
+// reliable tracks. Rounds of samples are solved (five-point algorithm) and scored concurrently. Each
+// hypothesis is verified with Wald's SPRT on a fixed random order of the scoring points, so most bad
+// hypotheses are rejected after a few points. The inlier mask is computed over all points at the end.
+/*!
+\param points1 points in the second image, as for findEssentialMat
+\param points2 corresponding points in the first image
+\param quality per-point quality, higher is better; empty to keep the given order
+\param focal focal length in pixels
+\param pp principal point
+\param mask output, CV_8U N x 1, 1 for inliers; same layout as findEssentialMat, so it can be passed to recoverPose
+\param params sampling and scoring setup
+\param stats if not NULL, receives counters of the run
+\return 3x3 CV_64F essential matrix, empty if there are fewer than 5 points or no hypothesis was found
+*/
+Mat findEssentialMatProsac(const std::vector<Point2f>& points1, const std::vector<Point2f>& points2, const std::vector<float>& quality,
+	double focal, Point2d pp, OutputArray mask, const EssentialParams& params = EssentialParams(), EssentialStats* stats = NULL);
@@ -6,6 +6,11 @@
 
 #include "EvaluateOptFlow.h"
 #include "FeatureMatcher.h"
+#include "FlowMethod.h"
+#include "FlowMetrics.h"
+#include "FlowVisualization.h"
+#include "ResultWriter.h"
+#include "KittiFlowIO.h"
 
 using namespace std;
 using namespace cv;
@@ -27,103 +32,6 @@ inline bool isFlowCorrect(const Point3f u)
 		&& (fabs(u.z) < 1e9);
 }
 
-// Converts middlebury 2 channel flow image to 3 channel (CV_16UC3) KITTI format
-/*!
-\param flow 2 channel optical flow Mat, middlebury format  
-\return 3 channel KITTI optical flow Mat
-*/
-static Mat convertToKittiFlow(const Mat_<Point2f>& flow) {
-
-	Mat kittiFlow = cv::Mat::ones(flow.rows, flow.cols, CV_16UC3);// type 18
-	
-	int width = flow.cols;
-	int height = flow.rows;
-	for (int i = 0; i < height; ++i) {
-		for (int j = 0; j < width; ++j) {
-			
-			const Point2f pt = flow(i, j);
-			float u = pt.x;
-			float v = pt.y;
-			
-				kittiFlow.at<Vec3s>(i, j)[1] = (uint16_t)max(min(v*64.0f + 32768.0f, 65535.0f), 0.0f);
-				
-				kittiFlow.at<Vec3s>(i, j)[2] = (uint16_t)max(min(u*64.0f + 32768.0f, 65535.0f), 0.0f);
-			
-		}
-	}
-	return kittiFlow;
-}
-
-
-// Converts KITTI ground truth image into a middlebury 2 channel image for evaluation
-/*!
-\param ground_truth_path string specifying the path to the KITTI 3 channel ground truth image
-\return 2 channel Mat, ground truth optical flow 
-*/
-static Mat readKittiGroundTruth(String ground_truth_path) {
-
-	String path = ground_truth_path;
-	// NB opencv has order BGR => valid , v , u
-	Mat image = imread(path, CV_LOAD_IMAGE_ANYCOLOR | CV_LOAD_IMAGE_ANYDEPTH);
-
-	Mat gt = cv::Mat::zeros(image.rows, image.cols, CV_32FC2);
-	int width = image.cols;
-	int height = image.rows;
-
-	for (int32_t v = 0; v < height; v++) {
-		for (int32_t u = 0; u < width; u++) {
-			Vec3s val = image.at<Vec3s>(v, u);
-			if (val[0] > 0) {
-				Vec2f flow;
-				if (val[2] > 0) {
-					flow[0] = ((float)val[2] - 32768.0f) / 64.0f;
-				}
-				else {
-					flow[0] = ((float)val[2] + 32768.0f) / 64.0f;
-				}
-
-				if (val[1] > 0) {
-					flow[1] = ((float)val[1] - 32768.0f) / 64.0f;
-				}
-				else {
-					flow[1] = ((float)val[1] + 32768.0f) / 64.0f;
-				}
-				gt.at<Vec2f>(v, u) = flow;
-			}
-			else {
-				Vec2f flow;
-				flow[0] = std::numeric_limits<float>::quiet_NaN();
-				flow[1] = std::numeric_limits<float>::quiet_NaN();
-				gt.at<Vec2f>(v, u) = flow;
-			}
-		}
-	}
-	return gt;
-}
-
-static Mat endpointError(const Mat_<Point2f>& flow1, const Mat_<Point2f>& flow2)
-{
-	Mat result(flow1.size(), CV_32FC1);
-
-	for (int i = 0; i < flow1.rows; ++i)
-	{
-		for (int j = 0; j < flow1.cols; ++j)
-		{
-			const Point2f u1 = flow1(i, j);
-			const Point2f u2 = flow2(i, j);
-
-			if (isFlowCorrect(u1) && isFlowCorrect(u2))
-			{
-				const Point2f diff = u1 - u2;
-				result.at<float>(i, j) = sqrt((float)diff.ddot(diff)); //distance				
-			}
-			else
-				result.at<float>(i, j) = std::numeric_limits<float>::quiet_NaN();
-		}
-	}
-	return result;
-}
-
 static Mat angularError(const Mat_<Point2f>& flow1, const Mat_<Point2f>& flow2)
 {
 	Mat result(flow1.size(), CV_32FC1);
@@ -196,11 +104,13 @@ void EvaluateOptFlow::calculateStats(Mat errors, Mat mask = Mat(), bool display_
 	meanStdDev(errors, s_mean, s_std, mask);
 	mean = (float)s_mean[0];
 	std = (float)s_std[0];
-	printf("Average: %.2f\nStandard deviation: %.2f\n", mean, std);
+	if (verbose)
+		printf("Average: %.2f\nStandard deviation: %.2f\n", mean, std);
 
 	// FS added to collect stats (printed out in main.cpp)
-	stats_vector.push_back(mean); 
-	stats_vector.push_back(std);
+	last_result.has_ground_truth = true;
+	last_result.error_mean = mean;
+	last_result.error_std = std;
 
 	//RX stats - displayed in percent
 	float R;
@@ -208,8 +118,9 @@ void EvaluateOptFlow::calculateStats(Mat errors, Mat mask = Mat(), bool display_
 	for (int i = 0; i < R_thresholds_count; ++i)
 	{
 		R = stat_RX(errors, R_thresholds[i], mask);
-		printf("R%.1f: %.2f%%\n", R_thresholds[i], R * 100);
-		stats_vector.push_back(R*100); // FS added to collect stats
+		if (verbose)
+			printf("R%.1f: %.2f%%\n", R_thresholds[i], R * 100);
+		last_result.R[i] = R*100; // FS added to collect stats
 	}
 
 	//AX stats
@@ -239,101 +150,82 @@ void EvaluateOptFlow::calculateStats(Mat errors, Mat mask = Mat(), bool display_
 	}
 }
 
-static Mat flowToDisplay(const Mat flow)
+// Records and prints the stats of a fused metrics pass
+void EvaluateOptFlow::calculateStats(const FlowMetrics& metrics)
 {
-	// Used to show gt for kitti data with NaN values
-	Mat flow_copy = flow;
-	for (int32_t v = 0; v < flow.rows; v++) {
-		for (int32_t u = 0; u < flow.cols; u++) {
-			if (cvIsNaN(flow.at<Vec2f>(v, u)[0])) {
-				Vec2f f;
-				f[0] = 0.0f;
-				f[1] = 0.0f;
-				flow_copy.at<Vec2f>(v, u) = f;
-			}
-		}
+	if (verbose) {
+		printf("Average: %.2f\nStandard deviation: %.2f\n", metrics.epe_mean, metrics.epe_std);
+		for (int i = 0; i < FlowMetrics::R_COUNT; ++i)
+			printf("R%.1f: %.2f%%\n", FlowMetrics::R_THRESHOLDS[i], metrics.R[i]);
+		printf("Fl: %.2f%%\nAE: %.2f deg\n", metrics.fl, metrics.ae_mean);
+		if (metrics.invalid_flow > 0)
+			printf("%d pixels without a computed flow were skipped\n", metrics.invalid_flow);
 	}
 
-	Mat flow_split[2];
-	Mat magnitude, angle;
-	Mat hsv_split[3], hsv, rgb;
-	split(flow_copy, flow_split);
-
-	///////////////////-- New colour display/////////////////////////
-	Mat flowHSV, flowRGB;
-	vector<cv::Mat> flowVec(3);
-
-	cv::cartToPolar(flow_split[0], flow_split[1], flowVec[1], flowVec[0], true);
-	flowVec[2] = cv::Mat::ones(flowVec[0].size(), flowVec[0].type()) * 255;
-	cv::threshold(flowVec[1], flowVec[1], 4, 4, CV_THRESH_TRUNC);
-	flowVec[1] = flowVec[1] * 0.25f;
-	cv::merge(flowVec, flowHSV);
-	cv::cvtColor(flowHSV, flowRGB, cv::COLOR_HSV2BGR);
-	flowRGB.convertTo(flowRGB, CV_8UC3);
-	return flowRGB;
+	last_result.has_ground_truth = true;
+	last_result.error_mean = (float)metrics.epe_mean;
+	last_result.error_std = (float)metrics.epe_std;
+	for (int i = 0; i < FlowMetrics::R_COUNT; ++i)
+		last_result.R[i] = metrics.R[i];
+	last_result.fl = metrics.fl;
 }
 
-static Mat flowToDisplay2(const Mat flow)
-{
-	Mat flow_split[2];
-	Mat magnitude, angle;
-	Mat hsv_split[3], hsv, rgb;
-	split(flow, flow_split);
-	cartToPolar(flow_split[0], flow_split[1], magnitude, angle, true);
-	normalize(magnitude, magnitude, 0, 1, NORM_MINMAX);
-	hsv_split[0] = angle; // already in degrees - no normalization needed
-	hsv_split[1] = Mat::ones(angle.size(), angle.type());
-	hsv_split[2] = magnitude;
-	merge(hsv_split, 3, hsv);
-	cvtColor(hsv, rgb, COLOR_HSV2BGR);
-	return rgb;
-}
-
-
-// Converts an error flow map into a linear heatmap blue -> red
-// N.B set range of colour map in the function where specified
+// Builds the mask of an evaluation region, shared with the dataset cache import
 /*!
-\param flow 2 channel mat of End Point Error vectors
-\param mask Mask specifiying the pixels at which flow was recovered
-\return error heat map from blue (low error) to red (high error)
+\param region "all" (mask left empty), "discontinuities" or "untextured"
+\param ground_truth 2 channel ground truth flow
+\param i1 first image, grey or BGR
+\param mask output CV_8U mask
+\return false for an unknown region
 */
-static Mat errorHeatMap(const Mat_<Point2f>& flow, Mat mask) {
-	
-	Mat flow_magnitudes(flow.size(), CV_32FC1);
-	Mat mask_copy;
-	mask.copyTo(mask_copy);
-
-	for (int i = 0; i < flow.rows; i++) {
-		for (int j = 0; j < flow.cols; j++) {
-			
-			if (mask_copy.at<char>(i, j) != 0) {
-				float flow_mag = sqrt(flow(i, j).x*flow(i, j).x + flow(i, j).y*flow(i, j).y);
-
-				// Set max error to adjust the colour mapping 
-				if (flow_mag > 3) {
-					flow_magnitudes.at<float>(i, j) = 3; // Adjust this range depending on the error range you want to see.
-				}
-				else {
-					flow_magnitudes.at<float>(i, j) = flow_mag;
-				}
-			}
-			else {
-				flow_magnitudes.at<float>(i, j) = std::numeric_limits<float>::quiet_NaN();
-			}
-		}
+bool EvaluateOptFlow::regionMask(const String& region, const Mat& ground_truth, const Mat& i1, Mat& mask)
+{
+	mask.release();
+	if (region == "all")
+		return true;
+	if (region == "discontinuities")
+	{
+		Mat truth_merged, grad_x, grad_y, gradient;
+		vector<Mat> truth_split;
+		split(ground_truth, truth_split);
+		truth_merged = truth_split[0] + truth_split[1];
+
+		Sobel(truth_merged, grad_x, CV_16S, 1, 0, -1, 1, 0, BORDER_REPLICATE);
+		grad_x = abs(grad_x);
+		Sobel(truth_merged, grad_y, CV_16S, 0, 1, 1, 1, 0, BORDER_REPLICATE);
+		grad_y = abs(grad_y);
+		addWeighted(grad_x, 0.5, grad_y, 0.5, 0, gradient); //approximation!
+
+		Scalar s_mean;
+		s_mean = mean(gradient);
+		double threshold = s_mean[0]; // threshold value arbitrary
+		mask = gradient > threshold;
+		dilate(mask, mask, Mat::ones(9, 9, CV_8U));
 	}
-
-	// Convert to 8 bit
-	flow_magnitudes.convertTo(flow_magnitudes, CV_8U);
-
-	Mat norm;
-	// Normailse to get contrast
-	normalize(flow_magnitudes, norm, 255, 0, NORM_INF);
-	applyColorMap(norm, norm, COLORMAP_JET);
-	bitwise_not(mask_copy, mask_copy);
-	norm.setTo(Scalar(0, 0, 0), mask_copy);
-	// Show the result:
-	return norm;
+	else if (region == "untextured")
+	{
+		Mat i1_grayscale, grad_x, grad_y, gradient;
+		if (i1.channels() == 3)
+			cvtColor(i1, i1_grayscale, COLOR_BGR2GRAY);
+		else
+			i1_grayscale = i1;
+		Sobel(i1_grayscale, grad_x, CV_16S, 1, 0, 7);
+		grad_x = abs(grad_x);
+		Sobel(i1_grayscale, grad_y, CV_16S, 0, 1, 7);
+		grad_y = abs(grad_y);
+		addWeighted(grad_x, 0.5, grad_y, 0.5, 0, gradient); //approximation!
+		GaussianBlur(gradient, gradient, Size(5, 5), 1, 1);
+
+		Scalar s_mean;
+		s_mean = mean(gradient);
+		// arbitrary threshold value used - could be determined statistically from the image?
+		double threshold = 1000;
+		mask = gradient < threshold;
+		dilate(mask, mask, Mat::ones(3, 3, CV_8U));
+	}
+	else
+		return false;
+	return true;
 }
 
 // Runs an evalution for a given optical flow method 
@@ -347,7 +239,12 @@ static Mat errorHeatMap(const Mat_<Point2f>& flow, Mat mask) {
 int EvaluateOptFlow::runEvaluation(String method, bool display_images, int image_no)
 {
 	//////////////////// **** CHANGE THE IMAGE PAIR AND GROUND TRUTH FILE LOCATIONs HERE **** ////////////////////////////////
-	String data_set = "kitti"; // or "middlebury";
+	// data_set ("kitti" or "middlebury") is a member, set it before calling
+
+	// Set fixed_image_no to evaluate just a single image pair
+	if (fixed_image_no >= 0) {
+		image_no = fixed_image_no;
+	}
 
 	// Convert image_num into string 
 	String num = to_string(image_no);
@@ -358,273 +255,233 @@ int EvaluateOptFlow::runEvaluation(String method, bool display_images, int image
 		num = "0" + num;
 	}
 
-	num = "006"; // set to evaluate just a single image pair
-
 	// Middlebury Image names 
 	vector<String> image_names = { {"Venus"}, { "RubberWhale" }, {"Grove2"}, {"Grove3"}, { "Urban2" }, { "Urban3" }, {"Hydrangea"} };
 
 	vector<String> image_names_eval = { { "Army" },{ "Backyard" },{ "Basketball" },{ "Dumptruck" },{ "Evergreen" },{ "Grove" } , \
 										{ "Mequon" }, { "Schefflera" }, { "Teddy" }, { "Urban" }, { "Wooden" }, { "Yosemite" } };
 
-	// Middlebury path names (indexed by image_num)
-	//String i1_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/Middlebury/other-data/" + image_names[image_no] + "/frame10.png";
-	//String i2_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/Middlebury/other-data/" + image_names[image_no] + "/frame11.png";
-	//String groundtruth_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/Middlebury/other-gt-flow/" + image_names[image_no] + "/flow10.flo"; 
-
-	// KITTI 2015 train (indexed by image_num)
-	/*String i1_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_scene_flow/training/image_2/000" + num + "_10.png";
-	String i2_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_scene_flow/training/image_2/000" + num + "_11.png";
-	String groundtruth_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_scene_flow/training/flow_noc/000" + num + "_10.png";*/
+	String i1_path, i2_path, groundtruth_path;
+	if (data_set == "middlebury") {
+		if (image_no < 0 || image_no >= (int)image_names.size()) {
+			printf("No Middlebury image pair %d\n", image_no);
+			return -1;
+		}
 
-	//// KITTI 2012 train (indexed by image_num)
-	String i1_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_stereo_flow/training/colored_0/000" + num + "_10.png";
-	String i2_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_stereo_flow/training/colored_0/000" + num + "_11.png";
-	String groundtruth_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_stereo_flow/training/flow_noc/000" + num + "_10.png";
+		// Middlebury path names (indexed by image_num)
+		i1_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/Middlebury/other-data/" + image_names[image_no] + "/frame10.png";
+		i2_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/Middlebury/other-data/" + image_names[image_no] + "/frame11.png";
+		groundtruth_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/Middlebury/other-gt-flow/" + image_names[image_no] + "/flow10.flo"; 
+	}
+	else {
+		// KITTI 2015 train (indexed by image_num)
+		/*i1_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_scene_flow/training/image_2/000" + num + "_10.png";
+		i2_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_scene_flow/training/image_2/000" + num + "_11.png";
+		groundtruth_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_scene_flow/training/flow_noc/000" + num + "_10.png";*/
+
+		//// KITTI 2012 train (indexed by image_num)
+		i1_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_stereo_flow/training/colored_0/000" + num + "_10.png";
+		i2_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_stereo_flow/training/colored_0/000" + num + "_11.png";
+		groundtruth_path = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/data_stereo_flow/training/flow_noc/000" + num + "_10.png";
+	}
 
 	//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+	return evaluatePair(method, i1_path, i2_path, groundtruth_path, display_images, image_no);
+}
+
+// Evaluates a flow method on one image pair given by file locations, records the stats in last_result and stats.
+// Holds no state outside this object (and the method's own), so separate EvaluateOptFlow objects
+// can evaluate pairs concurrently; data_set selects how the ground truth file is read.
+/*!
+\param method a string corresponding to an optical flow method
+\param i1_path first image
+\param i2_path second image
+\param groundtruth_path ground truth flow (.flo for Middlebury, 16 bit png for KITTI), empty to skip the comparison
+\param display_images bool to specify if output images should be shown
+\param image_no number recorded in the first column of the stats
+\return 0 on success, -1 on error
+*/
+int EvaluateOptFlow::evaluatePair(String method, const String& i1_path, const String& i2_path, const String& groundtruth_path, bool display_images, int image_no)
+{
+	Mat i1 = imread(i1_path, 1);
+	Mat i2 = imread(i2_path, 1);
+	if (!i1.data || !i2.data || i1.empty() || i2.empty())
+	{
+		printf("No image data (%s, %s)\n", i1_path.c_str(), i2_path.c_str());
+		return -1;
+	}
+
+	Mat ground_truth;
+	if (!groundtruth_path.empty()) {
+		if (data_set == "middlebury") {
+			ground_truth = optflow::readOpticalFlow(groundtruth_path); // Middlebury 
+		}
+		else if (!readKittiFlow(groundtruth_path, ground_truth)) { // KITTI
+			return -1;
+		}
+		if (ground_truth.empty()) {
+			printf("No ground truth data (%s)\n", groundtruth_path.c_str());
+			return -1;
+		}
+	}
+
+	return evaluateFrames(method, i1, i2, ground_truth, Mat(), display_images, image_no);
+}
+
+// Evaluates a flow method on decoded frames, records the stats in last_result and stats
+/*!
+\param method a string corresponding to an optical flow method
+\param i1 first image
+\param i2 second image
+\param groundtruth ground truth flow (CV_32FC2, NaN where unknown), empty to skip the comparison
+\param region_mask precomputed mask of the evaluation region, empty to derive it from region
+\param display_images bool to specify if output images should be shown
+\param image_no number recorded in the first column of the stats
+\return 0 on success, -1 on error
+*/
+int EvaluateOptFlow::evaluateFrames(String method, Mat i1, Mat i2, const Mat& groundtruth, const Mat& region_mask, bool display_images, int image_no)
+{
 	String error_measure = "endpoint";
-	String region = "all";
 	
-	// Initialise vectors of points to display the sparse vector field if display)images is true 
-	// and either degraf_flow method is being used
+	// Initialise vectors of points to display the sparse vector field if display_images is true or results
+	// are saved, and a degraf_flow method is being used
 	vector<Point2f> points1;
 	vector<Point2f> points2;
+	bool keep_points = display_images || result_writer != NULL;
 
-	stats_vector.push_back(image_no);
+	last_result = PairResult();
+	last_result.image_no = image_no;
 	Mat im1, im2; // to keeep for display
-	Mat i1, i2;
 	Mat_<Point2f> flow, ground_truth;
 	Mat computed_errors;
-	i1 = imread(i1_path, 1);
-	i2 = imread(i2_path, 1);
 	im1 = i1;
 	im2 = i2;
 
-	if (!i1.data || !i2.data || i1.empty() || i2.empty())
-	{
-		printf("No image data \n");
-		return -1;
-	}
 	if (i1.size() != i2.size() || i1.channels() != i2.channels())
 	{
-		printf("Dimension mismatch between input images\n");
+		printf("Dimension mismatch between input images (%d)\n", image_no);
 		return -1;
 	}
 	// 8-bit images expected by all algorithms
 	if (i1.depth() != CV_8U)
-		cout << "convert";
 		i1.convertTo(i1, CV_8U);
 	if (i2.depth() != CV_8U)
 		i2.convertTo(i2, CV_8U);
 
-	if ((method == "farneback" || method == "tvl1" || method == "deepflow" || method == "DISflow_ultrafast" || method == "DISflow_fast" || method == "DISflow_medium") && i1.channels() == 3)
-	{   // 1-channel images are expected
-		cvtColor(i1, i1, COLOR_BGR2GRAY);
-		cvtColor(i2, i2, COLOR_BGR2GRAY);
-	}
-	else if (method == "simpleflow" && i1.channels() == 1)
-	{   // 3-channel images expected
-		cvtColor(i1, i1, COLOR_GRAY2BGR);
-		cvtColor(i2, i2, COLOR_GRAY2BGR);
-	}
-
-	//flow = Mat(i1.size[0], i1.size[1], CV_32FC2);
-	//flow = Mat::zeros(i1.size(), CV_32FC2);
-	Ptr<DenseOpticalFlow> algorithm;
-
-	if (method == "farneback")
-		algorithm = createOptFlow_Farneback();
-	else if (method == "simpleflow")
-		algorithm = createOptFlow_SimpleFlow();
-	else if (method == "tvl1")
-		algorithm = createOptFlow_DualTVL1();
-	else if (method == "deepflow")
-		algorithm = createOptFlow_DeepFlow();
-	else if (method == "sparsetodenseflow")
-		algorithm = createOptFlow_SparseToDense();
-	else if (method == "pcaflow") {
-		//FS removed prior option
-		algorithm = createOptFlow_PCAFlow();
+	// Every method but the adaptive one is a FlowMethod, created per pair so each call is timed cold
+	Ptr<FlowMethod> algorithm;
+	if (method == "degraf_flow_adaptive") {
+		if (adaptive_controller.empty())
+			adaptive_controller = makePtr<AdaptiveDegrafController>(adaptive_target_ms);
 	}
-	else if (method == "DISflow_ultrafast")
-		algorithm = createOptFlow_DIS(DISOpticalFlow::PRESET_ULTRAFAST);
-		//cv::Ptr<cv::optflow::DISOpticalFlow> algorithm = cv::optflow::createOptFlow_DIS(0);
-	else if (method == "DISflow_fast")
-		algorithm = createOptFlow_DIS(DISOpticalFlow::PRESET_FAST);
-	else if (method == "DISflow_medium")
-		algorithm = createOptFlow_DIS(DISOpticalFlow::PRESET_MEDIUM);
-	else if (method == "degraf_flow_lk") {
-	}
-	else if (method == "degraf_flow_rlof") {
-	}
-	else
-	{
-		printf("Wrong method!\n");
-		return -1;
+	else {
+		algorithm = FlowMethod::create(method);
+		if (algorithm.empty())
+		{
+			printf("Wrong method!\n");
+			return -1;
+		}
+		if (algorithm->greyInput() && i1.channels() == 3)
+		{   // 1-channel images are expected
+			cvtColor(i1, i1, COLOR_BGR2GRAY);
+			cvtColor(i2, i2, COLOR_BGR2GRAY);
+		}
+		else if (!algorithm->greyInput() && i1.channels() == 1)
+		{   // 3-channel images expected
+			cvtColor(i1, i1, COLOR_GRAY2BGR);
+			cvtColor(i2, i2, COLOR_GRAY2BGR);
+		}
 	}
 
 	double startTick, time;
 	startTick = (double)getTickCount(); // measure time
+	ScopedStageTimer total_timer(STAGE_TOTAL);
 
-	if (method == "degraf_flow_lk") {
-		FeatureMatcher algorithm = FeatureMatcher();
-		algorithm.degraf_flow_LK(i1, i2, flow, 60, (0.05000000075F), true, (500.0F), (1.5F));
+	if (algorithm.empty()) {
+		adaptive_controller->process(i1, i2, flow);
 
-		if (display_images) {
-			// Points for displaying sparse flow field
-			points1 = algorithm.points_filtered;
-			points2 = algorithm.dst_points_filtered;
-		}
-	}
-	else if (method == "degraf_flow_rlof") {
-		FeatureMatcher algorithm = FeatureMatcher();
-		algorithm.degraf_flow_RLOF(i1, i2, flow, 127, (0.05000000075F), true, (500.0F), (1.5F));
-		
-		if (display_images) {
-			// Points for displaying sparse flow field
-			points1 = algorithm.points_filtered;
-			points2 = algorithm.dst_points_filtered;
+		if (keep_points) {
+			points1 = adaptive_controller->matcher.points_filtered;
+			points2 = adaptive_controller->matcher.dst_points_filtered;
 		}
 	}
 	else {
 		algorithm->calc(i1, i2, flow);
+
+		// Points for displaying sparse flow field, degraf_flow methods only
+		if (keep_points)
+			algorithm->lastMatches(points1, points2);
 	}
 
+	total_timer.stop();
 	time = ((double)getTickCount() - startTick) / getTickFrequency();
-	printf("\nTime [s]: %.3f\n", time);
+	last_flow = flow;
+	if (verbose)
+		printf("\nTime [s]: %.3f\n", time);
 
-	if (!groundtruth_path.empty())
+	Mat mask;
+	if (!groundtruth.empty())
 	{ // compare to ground truth
-		if (data_set == "middlebury") {
-			ground_truth = optflow::readOpticalFlow(groundtruth_path); // Middlebury 
-		}
-		else {
-			ground_truth = readKittiGroundTruth(groundtruth_path); // KITTI
-		}
+		ground_truth = groundtruth;
 
 		if (flow.size() != ground_truth.size() || flow.channels() != 2
 			|| ground_truth.channels() != 2)
 		{
-			printf("Dimension mismatch between the computed flow and the provided ground truth\n");
+			printf("Dimension mismatch between the computed flow and the provided ground truth (%d)\n", image_no);
 			return -1;
 		}
-		if (error_measure == "endpoint")
-			computed_errors = endpointError(flow, ground_truth);
-		else if (error_measure == "angular")
+		if (error_measure == "angular")
 			computed_errors = angularError(flow, ground_truth);
-		else
+		else if (error_measure != "endpoint")
 		{
 			printf("Invalid error measure! Available options: endpoint, angular\n");
 			return -1;
 		}
 
-		Mat mask;
-		if (region == "all")
-			mask = Mat::ones(ground_truth.size(), CV_8U) * 255;
-		else if (region == "discontinuities")
-		{
-			Mat truth_merged, grad_x, grad_y, gradient;
-			vector<Mat> truth_split;
-			split(ground_truth, truth_split);
-			truth_merged = truth_split[0] + truth_split[1];
-
-			Sobel(truth_merged, grad_x, CV_16S, 1, 0, -1, 1, 0, BORDER_REPLICATE);
-			grad_x = abs(grad_x);
-			Sobel(truth_merged, grad_y, CV_16S, 0, 1, 1, 1, 0, BORDER_REPLICATE);
-			grad_y = abs(grad_y);
-			addWeighted(grad_x, 0.5, grad_y, 0.5, 0, gradient); //approximation!
-
-			Scalar s_mean;
-			s_mean = mean(gradient);
-			double threshold = s_mean[0]; // threshold value arbitrary
-			mask = gradient > threshold;
-			dilate(mask, mask, Mat::ones(9, 9, CV_8U));
+		// The metrics kernel checks ground truth validity itself, a mask is only built for other regions
+		// or when it is needed for display and the angular measure
+		bool need_valid_mask = display_images || result_writer != NULL || error_measure == "angular";
+		if (region == "all") {
+			if (need_valid_mask)
+				mask = Mat(ground_truth.size(), CV_8U, Scalar(255));
 		}
-		else if (region == "untextured")
-		{
-			Mat i1_grayscale, grad_x, grad_y, gradient;
-			if (i1.channels() == 3)
-				cvtColor(i1, i1_grayscale, COLOR_BGR2GRAY);
-			else
-				i1_grayscale = i1;
-			Sobel(i1_grayscale, grad_x, CV_16S, 1, 0, 7);
-			grad_x = abs(grad_x);
-			Sobel(i1_grayscale, grad_y, CV_16S, 0, 1, 7);
-			grad_y = abs(grad_y);
-			addWeighted(grad_x, 0.5, grad_y, 0.5, 0, gradient); //approximation!
-			GaussianBlur(gradient, gradient, Size(5, 5), 1, 1);
-
-			Scalar s_mean;
-			s_mean = mean(gradient);
-			// arbitrary threshold value used - could be determined statistically from the image?
-			double threshold = 1000;
-			mask = gradient < threshold;
-			dilate(mask, mask, Mat::ones(3, 3, CV_8U));
+		else if (!region_mask.empty()) {
+			mask = need_valid_mask ? region_mask.clone() : region_mask;
 		}
-
-		else
+		else if (!regionMask(region, ground_truth, i1, mask))
 		{
 			printf("Invalid region selected! Available options: all, discontinuities, untextured");
 			return -1;
 		}
 
+		// Single pass over flow, ground truth and region
+		if (error_measure == "endpoint")
+			computeFlowMetrics(flow, ground_truth, mask, last_metrics);
+
 		//masking out NaNs and incorrect GT values
-		Mat truth_split[2];
-		split(ground_truth, truth_split);
-		Mat abs_mask = Mat((abs(truth_split[0]) < 1e9) & (abs(truth_split[1]) < 1e9));
-		Mat nan_mask = Mat((truth_split[0] == truth_split[0]) & (truth_split[1] == truth_split[1]));
-		bitwise_and(abs_mask, nan_mask, nan_mask);
-		bitwise_and(nan_mask, mask, mask); //including the selected region
+		if (need_valid_mask) {
+			Mat truth_split[2];
+			split(ground_truth, truth_split);
+			Mat abs_mask = Mat((abs(truth_split[0]) < 1e9) & (abs(truth_split[1]) < 1e9));
+			Mat nan_mask = Mat((truth_split[0] == truth_split[0]) & (truth_split[1] == truth_split[1]));
+			bitwise_and(abs_mask, nan_mask, nan_mask);
+			bitwise_and(nan_mask, mask, mask); //including the selected region
+		}
 		
 		if (display_images)
 		{
-			Mat difference = ground_truth - flow;
-			Mat masked_difference;
-			difference.copyTo(masked_difference, mask);
-			Mat error = flowToDisplay(masked_difference);
-			Mat heatmap = errorHeatMap(difference, mask);
-			Mat ground = flowToDisplay(ground_truth);
-			Mat flow_image = flowToDisplay(flow);
-
-			// Display all useful output images in one frame
-			cv::Mat win_mat(cv::Size(i1.cols*2, i1.rows*3), CV_8UC3);
-
-
-			imwrite("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/Images/output/Presentation/06_0.png", i1);
-			imwrite("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/Images/output/Presentation/06_1.png", i2);
-			// Draw sparse flow field from degraf flow 
-			if (method == "degraf_flow_lk" || method == "degraf_flow_rlof") {
-				Mat sparse = Mat::zeros(i1.rows, i1.cols, CV_8UC3);
-				bitwise_not(sparse, sparse);
-				for (int i = 0; i < points1.size(); i += 4)
-				{
-					cv::arrowedLine(sparse, points1[i], points2[i], cv::Scalar(0, 0, 0), 2, 8, 0, 0.2);
-				}
-				//imwrite("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/Images/output/Presentation/lines.png" , sparse);
-				// place in output window
-				sparse.copyTo(win_mat(cv::Rect(0, i1.rows, i1.cols, i1.rows)));
-			}
-			else {
-				Mat placeholder = Mat::zeros(i1.rows, i1.cols, CV_8UC3);
-				bitwise_not(placeholder, placeholder);
-				cv::line(placeholder, Point2f(0,0), Point2f(i1.cols, i1.rows), cv::Scalar(0, 0, 0), 2, 8);
-				cv::line(placeholder, Point2f(i1.cols, 0), Point2f(0, i1.rows), cv::Scalar(0, 0, 0), 2, 8);
-				placeholder.copyTo(win_mat(cv::Rect(0, i1.rows, i1.cols, i1.rows)));
-			}
-			imwrite("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/Images/output/Presentation/flow.png", flow_image);
-			im1.copyTo(win_mat(cv::Rect(0, 0, i1.cols, i1.rows)));
-			im2.copyTo(win_mat(cv::Rect(i1.cols, 0, i1.cols, i1.rows)));
-			flow_image.copyTo(win_mat(cv::Rect(i1.cols, i1.rows, i1.cols, i1.rows)));
-			ground.copyTo(win_mat(cv::Rect(0, i1.rows*2, i1.cols, i1.rows)));
-			heatmap.copyTo(win_mat(cv::Rect(i1.cols, i1.rows*2, i1.cols, i1.rows)));
-
-			// Shrink to fit all image on the screen 
+			// Display all useful output images in one frame, shrunk to fit on the screen
+			Mat win_mat = resultsWindow(im1, im2, flow, ground_truth, mask, points1, points2);
 			resize(win_mat, win_mat, Size(1325, 600));
 			imshow("Results", win_mat);
 		}
-		printf("Using %s error measure\n", error_measure.c_str());
-		calculateStats(computed_errors, mask, display_images);
+		if (verbose)
+			printf("Using %s error measure\n", error_measure.c_str());
+		if (error_measure == "endpoint")
+			calculateStats(last_metrics);
+		else
+			calculateStats(computed_errors, mask, display_images);
 
 		if(display_images)
 			waitKey(0);
@@ -633,9 +490,32 @@ int EvaluateOptFlow::runEvaluation(String method, bool display_images, int image
 		waitKey(1);
 
 	// Collect stats from evaluation 
-	stats_vector.push_back(time);
-	all_stats.push_back(stats_vector);
-	stats_vector.clear();
+	last_result.seconds = time;
+	stats.add(last_result);
+
+	// Artefacts are encoded and written by the writer's threads, this only queues references
+	if (result_writer != NULL) {
+		ResultRecord record;
+		if (result_name.empty()) {
+			char name[64];
+			sprintf(name, "%s_%06d", method.c_str(), image_no);
+			record.name = name;
+		}
+		else {
+			record.name = result_name;
+		}
+		record.method = method;
+		record.data_set = data_set;
+		record.i1 = im1;
+		record.i2 = im2;
+		record.flow = flow;
+		record.ground_truth = ground_truth;
+		record.mask = mask;
+		record.points1.swap(points1);
+		record.points2.swap(points2);
+		record.result = last_result;
+		result_writer->push(record);
+	}
 
 	return 0;
 }
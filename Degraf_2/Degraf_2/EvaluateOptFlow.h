@@ -5,6 +5,9 @@
 #pragma once
 
 #include "SaliencyDetector.h"
+#include "AdaptiveController.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
 #include "opencv2/videoio.hpp"
 #include "opencv2/highgui.hpp"
 #include "opencv2/imgproc.hpp"
@@ -28,15 +31,45 @@
 
 using namespace cv;
 
+class ResultWriter;
+
 class EvaluateOptFlow {
 
 public:
 
-	// Stats for a single flow computation 
-	vector<float> stats_vector;
+	// Stats of the last image pair
+	PairResult last_result;
+
+	// Aggregate stats over all image pairs evaluated by this instance
+	StatsAggregator stats;
+
+	// Data set evaluated by runEvaluation, "kitti" or "middlebury" (file locations are set in runEvaluation)
+	String data_set = "kitti";
+
+	// KITTI pair evaluated regardless of image_no, -1 evaluates the pair given by image_no
+	int fixed_image_no = 6;
+
+	// Latency budget and controller state for "degraf_flow_adaptive", persists across runEvaluation calls
+	double adaptive_target_ms = 100.0;
+	Ptr<AdaptiveDegrafController> adaptive_controller;
+
+	// Flow computed for the last pair
+	Mat last_flow;
 
-	// List of stats over all image pairs 
-	vector<vector<float>> all_stats;
+	// Full metrics of the last pair evaluated with the endpoint measure (includes KITTI Fl, AE and A quantiles)
+	FlowMetrics last_metrics;
+
+	// Pixels the errors are evaluated on: "all", "discontinuities" or "untextured"
+	String region = "all";
+
+	// Print per-pair timing and stats, turned off by the batch runner
+	bool verbose = true;
+
+	// If set, the flow, visualisations and metadata of every pair are queued to this writer (not owned)
+	ResultWriter* result_writer = NULL;
+
+	// File name stem of the next pair's artefacts, empty for <method>_<image_no>
+	String result_name;
 
 	EvaluateOptFlow();
 
@@ -49,7 +82,13 @@ public:
 	static void calculateStats(Mat errors, Mat mask = Mat(), bool display_images = false);
 	static Mat flowToDisplay(const Mat flow);*/
 
-	void calculateStats(Mat errors, Mat mask, bool display_images); // adding this as public so it can update the stats_vector variable 
+	void calculateStats(Mat errors, Mat mask, bool display_images); // adding this as public so it can update last_result
+	void calculateStats(const FlowMetrics& metrics);
 
 	int EvaluateOptFlow::runEvaluation(String method, bool display, int image_no);
+
+	int evaluatePair(String method, const String& i1_path, const String& i2_path, const String& groundtruth_path, bool display_images, int image_no);
+	int evaluateFrames(String method, Mat i1, Mat i2, const Mat& groundtruth, const Mat& region_mask, bool display_images, int image_no);
+
+	static bool regionMask(const String& region, const Mat& ground_truth, const Mat& i1, Mat& mask);
 };
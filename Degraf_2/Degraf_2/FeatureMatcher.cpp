@@ -11,6 +11,63 @@
 FeatureMatcher::FeatureMatcher() {
 }
 
+// Returns the parameters of a named preset, PRESET_BALANCED matches the published DeGraF-Flow settings
+/*!
+\param p_preset one of DegrafFlowParams::PRESET_*
+\return detector, saliency, tracker and interpolator parameters set together
+*/
+DegrafFlowParams DegrafFlowParams::preset(int p_preset)
+{
+	DegrafFlowParams params;
+	switch (p_preset) {
+	case PRESET_ULTRAFAST:
+		params.saliency_levels = 2;
+		params.step_x = params.step_y = 13;
+		params.max_points = 4000;
+		params.rlof_small_win = 8;
+		params.rlof_large_win = 9;
+		params.rlof_max_level = 2;
+		params.rlof_max_iter = 10;
+		params.k = 32;
+		params.use_post_proc = false;
+		break;
+	case PRESET_FAST:
+		params.step_x = params.step_y = 11;
+		params.rlof_max_level = 3;
+		params.rlof_max_iter = 15;
+		params.k = 64;
+		break;
+	case PRESET_BALANCED:
+		break;
+	case PRESET_ACCURATE:
+		params.saliency_levels = 5;
+		params.step_x = params.step_y = 7;
+		params.rlof_max_level = 5;
+		params.rlof_max_iter = 50;
+		params.k = 128;
+		break;
+	default:
+		CV_Error(Error::StsBadArg, "Unknown DeGraF-Flow preset");
+	}
+	return params;
+}
+
+const char* DegrafFlowParams::presetName(int p_preset)
+{
+	static const char* names[] = { "ultrafast", "fast", "balanced", "accurate" };
+	CV_Assert(p_preset >= PRESET_ULTRAFAST && p_preset <= PRESET_ACCURATE);
+	return names[p_preset];
+}
+
+DegrafFlowParams DegrafFlowParams::lucasKanade()
+{
+	DegrafFlowParams params;
+	params.saliency_levels = 5;
+	params.step_x = params.step_y = 7;
+	params.k = 60;
+	return params;
+}
+
 // DeGraF-Flow using lucas-kanade point tracking
 /*!
 \param from first image
@@ -22,15 +79,94 @@ FeatureMatcher::FeatureMatcher() {
 
 void FeatureMatcher::degraf_flow_LK(InputArray from, InputArray to, OutputArray flow, int k, float sigma, bool use_post_proc, float fgs_lambda, float fgs_sigma)
 {
-	CV_Assert(k > 3 && sigma > 0.0001f && fgs_lambda > 1.0f && fgs_sigma > 0.01f);
+	DegrafFlowParams params = DegrafFlowParams::lucasKanade();
+	params.k = k;
+	params.sigma = sigma;
+	params.use_post_proc = use_post_proc;
+	params.fgs_lambda = fgs_lambda;
+	params.fgs_sigma = fgs_sigma;
+	degraf_flow_LK(from, to, flow, params);
+}
+
+// DeGraF-Flow using lucas-kanade point tracking with every pipeline parameter exposed
+/*!
+\param from first image
+\param to second image, same size and type as from
+\param flow h output optical flow, 2 channel image (middlebury format)
+\param params detector, tracker and interpolator parameters (the rlof_* fields are ignored)
+*/
+void FeatureMatcher::degraf_flow_LK(InputArray from, InputArray to, OutputArray flow, const DegrafFlowParams& params)
+{
+	CV_Assert(params.k > 3 && params.sigma > 0.0001f && params.fgs_lambda > 1.0f && params.fgs_sigma > 0.01f);
+
+	degraf_matches_LK(from, to, params);
+	degraf_interpolate(from, to, flow, params);
+
+	///////////////// 4. Variational refinement (optional - not used in final results as adds significant computation time) ///////////////
+
+	// Split flow image into x and y components to pass to refinement
+	//Mat U_V[2];   //destination array
+	//split(dense_flow, U_V);//split source
+
+	//int64 refinement_start = getTickCount();
+	//// Source images to gray
+	//Mat gray_1;
+	//Mat gray_2;
+	//cvtColor(from, gray_1, CV_RGB2GRAY);
+	//cvtColor(to, gray_2, CV_RGB2GRAY);
+
+	//int variational_refinement_iter = 3;
+	//float variational_refinement_alpha = 20.f;
+	//float variational_refinement_gamma = 10.f;
+	//float variational_refinement_delta = 5.f;
+
+	//Ptr<optflow::VariationalRefinement> variational_refinement_processor = optflow::createVariationalFlowRefinement();
+
+	//variational_refinement_processor->setAlpha(variational_refinement_alpha);
+	//variational_refinement_processor->setDelta(variational_refinement_delta);
+	//variational_refinement_processor->setGamma(variational_refinement_gamma);
+	//variational_refinement_processor->setSorIterations(5);
+	//variational_refinement_processor->setFixedPointIterations(variational_refinement_iter);
+
+	//variational_refinement_processor->calcUV(gray_1, gray_2, U_V[0], U_V[1]);
+
+	//variational_refinement_processor->collectGarbage();
+
+	//vector<Mat> ch;
+	//flow.create(from.size(), CV_32FC2);
+	//Mat dst = flow.getMat();
+	//ch.push_back(U_V[0]);
+	//ch.push_back(U_V[1]);
+	//merge(ch, dst);
+}
+
+// Sparse DeGraF-Flow stages using lucas-kanade point tracking, results in points_filtered / dst_points_filtered
+/*!
+\param from first image
+\param to second image, same size and type as from
+*/
+void FeatureMatcher::degraf_matches_LK(InputArray from, InputArray to)
+{
+	degraf_matches_LK(from, to, DegrafFlowParams::lucasKanade());
+}
+
+// Sparse DeGraF-Flow stages using lucas-kanade point tracking with explicit detector and tracker parameters
+/*!
+\param from first image
+\param to second image, same size and type as from
+\param params detector, LK tracker and filtering parameters (interpolator and rlof_* fields are ignored)
+*/
+void FeatureMatcher::degraf_matches_LK(InputArray from, InputArray to, const DegrafFlowParams& params)
+{
 	CV_Assert(!from.empty() && from.depth() == CV_8U && (from.channels() == 3 || from.channels() == 1));
 	CV_Assert(!to.empty() && to.depth() == CV_8U && (to.channels() == 3 || to.channels() == 1));
 
-	int64 timeStart0 = getTickCount();
 	Mat prev = from.getMat();
 	Mat cur = to.getMat();
 	Mat prev_grayscale, cur_grayscale;
 
+	stage_times = DegrafStageTimes();
+	ScopedStageTimer grey_timer(STAGE_GREY, &stage_times.detection);
 	if (prev.channels() == 3)
 	{
 		cvtColor(prev, prev_grayscale, COLOR_BGR2GRAY);
@@ -41,78 +177,26 @@ void FeatureMatcher::degraf_flow_LK(InputArray from, InputArray to, OutputArray
 		prev.copyTo(prev_grayscale);
 		cur.copyTo(cur_grayscale);
 	}
+	grey_timer.stop();
 
+	// Same detector as the RLOF pipeline, point alternatives (FAST, SURF, ...) are compared there
 	vector<Point2f> points;
-	vector<Point2f> points_intermediate;
 	vector<Point2f> dst_points;
 	vector<unsigned char> status;
 	vector<float> err;
-
-	// Compare different feature point inputs DeGraF, FAST, SIFT, SURF, AGAST, ORB, Grid.
-	int point = 0;
-	if (point == 0) {
-		cv::Size s = from.size();
-
-		IplImage *dog_1 = cvCreateImage(cvSize(s.width, s.height), IPL_DEPTH_8U, 3);
-
-		SaliencyDetector saliency_detector;
-		saliency_detector.DoGoS_Saliency(&(IplImage(from.getMat())), dog_1, 5, true, true);
-		saliency_detector.Release();
-
-		GradientDetector *gradient_detector_1 = new GradientDetector();
-
-		int status_1 = gradient_detector_1->DetectGradients(dog_1, 3, 3, 7, 7);
-
-		// Convert from keyPoint type to Point2f
-		cv::KeyPoint::convert(gradient_detector_1->keypoints, points);
-	}
-	// Using other point detectors
-	else if(point == 1){
-		vector<KeyPoint> keypoints;
-		FAST(prev, keypoints, 2, true);
-		cv::KeyPoint::convert(keypoints, points);
-	}
-	else if (point == 2) {
-		vector<KeyPoint> keypoints;
-
-		Ptr<xfeatures2d::SURF> detector = xfeatures2d::SURF::create(0.1,4,2);
-		detector->detect(prev, keypoints);
-		cv::KeyPoint::convert(keypoints, points);
-	}
-	else if (point == 3) {
-		vector<KeyPoint> keypoints;
-		Ptr<xfeatures2d::SIFT> detector = xfeatures2d::SIFT::create(7000,3,0.00,100.0);
-		detector->detect(prev, keypoints);
-		cv::KeyPoint::convert(keypoints, points);
-	}
-	else if (point == 4) {
-		vector<KeyPoint> keypoints;
-		Ptr<FeatureDetector> detector = ORB::create(5400, 1.2, 8, 20, 0, 2, 0, 20, 20);
-		detector->detect(prev, keypoints);
-		cv::KeyPoint::convert(keypoints, points);
-	}
-	else if (point == 5) {
-		vector<KeyPoint> keypoints;
-		Ptr<FeatureDetector> detector = AgastFeatureDetector::create(5,true,3);
-		detector->detect(prev, keypoints);
-		cv::KeyPoint::convert(keypoints, points);
-	}
-	else if (point == 6) {
-		
-		for (int i = 0; i < prev.rows-7; i = i+7) {
-			for (int j = 0; j < prev.cols-7; j = j + 7) {
-				points.push_back(Point2f(j, i));
-			}
-		}
-	}
+	degraf_detect(from, points, params);
 	
 	// Lucas-Kanade point tracking
-	cv::calcOpticalFlowPyrLK(prev_grayscale, cur_grayscale, points, dst_points, status, err, Size(11, 11), 4);
+	ScopedStageTimer tracking_timer(STAGE_TRACKING, &stage_times.tracking);
+	cv::calcOpticalFlowPyrLK(prev_grayscale, cur_grayscale, points, dst_points, status, err, Size(params.lk_win, params.lk_win), params.lk_max_level);
+	tracking_timer.stop();
 	
-	// Set max vector length allowed (in pixels) N.B change max vector length for different data sets.
-	int max_flow_length = 100;
+	// Maximum vector length allowed (in pixels) N.B change max_flow_length for different data sets.
+	int max_flow_length = params.max_flow_length;
+	ScopedStageTimer filtering_timer(STAGE_FILTERING, &stage_times.tracking);
+	points_filtered.clear();
+	dst_points_filtered.clear();
 
-	//long double execTime1 = (getTickCount()*1.0000 - timeStart1) / (getTickFrequency() * 1.0000);
 	for (unsigned int i = 0; i < points.size(); i++)
 	{
 		if (status[i] != 0 && 
@@ -123,77 +207,118 @@ void FeatureMatcher::degraf_flow_LK(InputArray from, InputArray to, OutputArray
 			points_filtered.push_back(points[i]);
 			dst_points_filtered.push_back(dst_points[i]);
 		}
-	}	
-	
-	flow.create(from.size(), CV_32FC2);
-	Mat dense_flow = flow.getMat();
-	
-	Ptr<ximgproc::EdgeAwareInterpolator> gd = ximgproc::createEdgeAwareInterpolator();
-	gd->setK(k);
-	gd->setSigma(sigma);
-	gd->setUsePostProcessing(use_post_proc);
-	gd->setFGSLambda(fgs_lambda);
-	gd->setFGSSigma(fgs_sigma);
-
-	if (points_filtered.size() > SHRT_MAX) {
-		cout << "Too many points to interpolate";
 	}
-	
-	gd->interpolate(prev, points_filtered, cur, dst_points_filtered, dense_flow);
+	filtering_timer.stop();
+	stage_times.total = stage_times.detection + stage_times.tracking;
+}
 
 
-	///////////////// 4. Variational refinement (optional - not used in final results as adds significant computation time) ///////////////
 
-	// Split flow image into x and y components to pass to refinement
-	//Mat U_V[2];   //destination array
-	//split(dense_flow, U_V);//split source
 
-	//int64 refinement_start = getTickCount();
-	//// Source images to gray
-	//Mat gray_1;
-	//Mat gray_2;
-	//cvtColor(from, gray_1, CV_RGB2GRAY);
-	//cvtColor(to, gray_2, CV_RGB2GRAY);
+// DeGraF-Flow using Robust Local Optical Flow point tracking, requires RLOF code found at https://github.com/tsenst/RLOFLib
+/*!
+\param from first image
+\param to second image, same size and type as from
+\param flow h output optical flow, 2 channel image (middlebury format)
+\param k number of support vectors used by the interpolator
+\param sigma, use_post_proc, fgs_lambda, fgs_sigma EdgeAwareInterpolator params defined in openCV documentation
+*/
+void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArray flow, int k, float sigma, bool use_post_proc, float fgs_lambda, float fgs_sigma)
+{
+	DegrafFlowParams params;
+	params.k = k;
+	params.sigma = sigma;
+	params.use_post_proc = use_post_proc;
+	params.fgs_lambda = fgs_lambda;
+	params.fgs_sigma = fgs_sigma;
+	degraf_flow_RLOF(from, to, flow, params);
+}
 
-	//int variational_refinement_iter = 3;
-	//float variational_refinement_alpha = 20.f;
-	//float variational_refinement_gamma = 10.f;
-	//float variational_refinement_delta = 5.f;
+// DeGraF-Flow using Robust Local Optical Flow point tracking with every pipeline parameter exposed
+/*!
+\param from first image
+\param to second image, same size and type as from
+\param flow h output optical flow, 2 channel image (middlebury format)
+\param params detector, tracker and interpolator parameters
+*/
+void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArray flow, const DegrafFlowParams& params)
+{
+	CV_Assert(params.k > 3 && params.sigma > 0.0001f && params.fgs_lambda > 1.0f && params.fgs_sigma > 0.01f);
 
-	//Ptr<optflow::VariationalRefinement> variational_refinement_processor = optflow::createVariationalFlowRefinement();
+	degraf_matches_RLOF(from, to, params);
+	degraf_interpolate(from, to, flow, params);
+}
 
-	//variational_refinement_processor->setAlpha(variational_refinement_alpha);
-	//variational_refinement_processor->setDelta(variational_refinement_delta);
-	//variational_refinement_processor->setGamma(variational_refinement_gamma);
-	//variational_refinement_processor->setSorIterations(5);
-	//variational_refinement_processor->setFixedPointIterations(variational_refinement_iter);
+// Dense flow from the current matches (points_filtered / dst_points_filtered), last stage of degraf_flow_RLOF
+/*!
+\param from first image used to compute the matches
+\param to second image
+\param flow output optical flow, 2 channel image (middlebury format)
+\param params interpolator and FGS parameters (other fields are ignored)
+*/
+void FeatureMatcher::degraf_interpolate(InputArray from, InputArray to, OutputArray flow, const DegrafFlowParams& params)
+{
+	Mat prev = from.getMat();
+	Mat cur = to.getMat();
 
-	//variational_refinement_processor->calcUV(gray_1, gray_2, U_V[0], U_V[1]);
+	////////////////////////////////   Interpolation  //////////////////////////////////////////////////////////////////
 
-	//variational_refinement_processor->collectGarbage();
+	ScopedStageTimer interpolation_timer(STAGE_INTERPOLATION, &stage_times.interpolation);
 
-	//vector<Mat> ch;
-	//flow.create(from.size(), CV_32FC2);
-	//Mat dst = flow.getMat();
-	//ch.push_back(U_V[0]);
-	//ch.push_back(U_V[1]);
-	//merge(ch, dst);
-}
+	if (points_filtered.size() > SHRT_MAX) {
+		cout << "Too many points to interpolate";
+	}
+
+	flow.create(from.size(), CV_32FC2);
+	Mat dense_flow = flow.getMat();
 
+	// FGS post-processing is applied separately below so that it is timed on its own
+	Ptr<ximgproc::EdgeAwareInterpolator> gd = ximgproc::createEdgeAwareInterpolator();
+	gd->setK(params.k);
+	gd->setSigma(params.sigma);
+	gd->setUsePostProcessing(false);
 
+	gd->interpolate(prev, points_filtered, cur, dst_points_filtered, dense_flow);
+	interpolation_timer.stop();
 
+	if (params.use_post_proc)
+		degraf_post_process(prev, dense_flow, params);
+	stage_times.total = stage_times.detection + stage_times.tracking + stage_times.interpolation;
+}
 
-// DeGraF-Flow using Robust Local Optical Flow point tracking, requires RLOF code found at https://github.com/tsenst/RLOFLib
+// Fast global smoother post-processing of a dense flow field, in place
+/*!
+\param from first image, guides the filter
+\param flow dense flow to smooth
+\param params fgs_lambda and fgs_sigma are used
+*/
+void FeatureMatcher::degraf_post_process(InputArray from, InputOutputArray flow, const DegrafFlowParams& params)
+{
+	ScopedStageTimer fgs_timer(STAGE_FGS, &stage_times.interpolation);
+	Mat dense_flow = flow.getMat();
+	ximgproc::fastGlobalSmootherFilter(from, dense_flow, dense_flow, params.fgs_lambda, params.fgs_sigma);
+	fgs_timer.stop();
+	stage_times.total = stage_times.detection + stage_times.tracking + stage_times.interpolation;
+}
+
+// Sparse DeGraF-Flow stages using Robust Local Optical Flow, results in points_filtered / dst_points_filtered
 /*!
 \param from first image
 \param to second image, same size and type as from
-\param flow h output optical flow, 2 channel image (middlebury format)
-\param k number of support vectors used by the interpolator
-\param sigma, use_post_proc, fgs_lambda, fgs_sigma EdgeAwareInterpolator params defined in openCV documentation
 */
-void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArray flow, int k, float sigma, bool use_post_proc, float fgs_lambda, float fgs_sigma)
+void FeatureMatcher::degraf_matches_RLOF(InputArray from, InputArray to)
+{
+	degraf_matches_RLOF(from, to, DegrafFlowParams());
+}
+
+// Sparse DeGraF-Flow stages using Robust Local Optical Flow with explicit detector and tracker parameters
+/*!
+\param from first image
+\param to second image, same size and type as from
+\param params detector, tracker and filtering parameters (interpolator fields are ignored)
+*/
+void FeatureMatcher::degraf_matches_RLOF(InputArray from, InputArray to, const DegrafFlowParams& params)
 {
-	CV_Assert(k > 3 && sigma > 0.0001f && fgs_lambda > 1.0f && fgs_sigma > 0.01f);
 	CV_Assert(!from.empty() && from.depth() == CV_8U && (from.channels() == 3 || from.channels() == 1));
 	CV_Assert(!to.empty() && to.depth() == CV_8U && (to.channels() == 3 || to.channels() == 1));
 
@@ -202,6 +327,8 @@ void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArra
 	Mat cur = to.getMat();
 	Mat prev_grayscale, cur_grayscale;
 
+	stage_times = DegrafStageTimes();
+	ScopedStageTimer grey_timer(STAGE_GREY, &stage_times.detection);
 	if (prev.channels() == 3)
 	{
 		cvtColor(prev, prev_grayscale, COLOR_BGR2GRAY);
@@ -212,30 +339,98 @@ void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArra
 		prev.copyTo(prev_grayscale);
 		cur.copyTo(cur_grayscale);
 	}
+	grey_timer.stop();
 
 	vector<Point2f> points;
-	vector<Point2f> points_intermediate;
-	vector<Point2f> dst_points;
-	vector<unsigned char> status;
-	vector<float> err;
-	int64 timeStart0 = getTickCount();
+	degraf_detect(from, points, params);
+	degraf_track(from, to, points, params);
+	stage_times.total = stage_times.detection + stage_times.tracking;
+}
+
+// Thins points to at most max_points by overlaying square cells and keeping the point nearest each cell
+// centre. Taking every n-th point instead would drop whole columns of the row-major DeGraF grid.
+/*!
+\param points feature points, thinned in place (order is kept)
+\param size image size
+\param max_points point budget
+*/
+static void thinPoints(vector<Point2f>& points, Size size, int max_points)
+{
+	// Cells of the area per kept point; edge cells only partly overlap the image, so grow them until the
+	// budget holds
+	double cell = sqrt((double)size.area() / max_points);
+	vector<int> nearest;
+	for (;;) {
+		int cols = (int)ceil(size.width / cell), rows = (int)ceil(size.height / cell);
+		int cells = 0;
+		nearest.assign((size_t)cols * rows, -1);
+		vector<float> distance(nearest.size());
+		for (int i = 0; i < (int)points.size(); i++) {
+			int cx = (std::min)(cols - 1, (std::max)(0, (int)(points[i].x / cell)));
+			int cy = (std::min)(rows - 1, (std::max)(0, (int)(points[i].y / cell)));
+			float dx = points[i].x - (float)((cx + 0.5) * cell), dy = points[i].y - (float)((cy + 0.5) * cell);
+			float d = dx * dx + dy * dy;
+			int c = cy * cols + cx;
+			if (nearest[c] < 0)
+				cells++;
+			if (nearest[c] < 0 || d < distance[c]) {
+				nearest[c] = i;
+				distance[c] = d;
+			}
+		}
+		if (cells <= max_points)
+			break;
+		cell *= 1.05;
+	}
+
+	vector<bool> keep(points.size(), false);
+	for (size_t c = 0; c < nearest.size(); c++) {
+		if (nearest[c] >= 0)
+			keep[nearest[c]] = true;
+	}
+	size_t kept = 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		if (keep[i])
+			points[kept++] = points[i];
+	}
+	points.resize(kept);
+}
+
+// Detection stage of RLOF DeGraF-Flow: DoGoS saliency, DeGraF points and the point budget
+/*!
+\param from first image
+\param points output feature points
+\param params detector parameters (other fields are ignored)
+*/
+void FeatureMatcher::degraf_detect(InputArray from, vector<Point2f>& points, const DegrafFlowParams& params)
+{
+	Mat prev = from.getMat();
+	points.clear();
+
 	// Compare different feature point inputs DeGraF, FAST, SIFT, SURF, AGAST, ORB, Grid.
 	int point = 0;
 	if (point == 0) {
 		cv::Size s = from.size();
 
-		IplImage *dog_1 = cvCreateImage(cvSize(s.width, s.height), IPL_DEPTH_8U, 3);
+		IplImage *dog_1 = CreateTrackedImage(cvSize(s.width, s.height), IPL_DEPTH_8U, 3);
 
+		ScopedStageTimer saliency_timer(STAGE_SALIENCY, &stage_times.detection);
 		SaliencyDetector saliency_detector;
-		saliency_detector.DoGoS_Saliency(&(IplImage(from.getMat())), dog_1, 3, true, true);
+		saliency_detector.DoGoS_Saliency(&(IplImage(prev)), dog_1, params.saliency_levels, true, true);
 		saliency_detector.Release();
+		saliency_timer.stop();
 
+		ScopedStageTimer gradients_timer(STAGE_GRADIENTS, &stage_times.detection);
 		GradientDetector *gradient_detector_1 = new GradientDetector();
 
-		int status_1 = gradient_detector_1->DetectGradients(dog_1, 3, 3, 9, 9);  // DeGraF params specified here
+		int status_1 = gradient_detector_1->DetectGradients(dog_1, params.window_width, params.window_height, params.step_x, params.step_y);  // DeGraF params specified here
 
 		// Convert from keyPoint type to Point2f
 		cv::KeyPoint::convert(gradient_detector_1->keypoints, points);
+
+		// Release memory
+		delete gradient_detector_1;
+		ReleaseTrackedImage(&dog_1);
 	}
 	// Using other point detectors
 	else if (point == 1) {
@@ -276,12 +471,28 @@ void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArra
 		cv::KeyPoint::convert(keypoints, points);
 	}
 
-	long double execTime0 = (getTickCount()*1.0000 - timeStart0) / (getTickFrequency() * 1.0000);
-	std::cout << "Time to compute DeGraF points = " << execTime0 << "\n\n";
+	// Enforce the point budget, keeping the 2-D coverage needed by the interpolator
+	if (params.max_points > 0 && (int)points.size() > params.max_points)
+		thinPoints(points, prev.size(), params.max_points);
+}
+
+// Tracking stage of RLOF DeGraF-Flow: RLOF tracking of the given points and match filtering,
+// results in points_filtered / dst_points_filtered
+/*!
+\param from first image
+\param to second image, same size and type as from
+\param points feature points in from
+\param params tracker and filtering parameters (other fields are ignored)
+*/
+void FeatureMatcher::degraf_track(InputArray from, InputArray to, const vector<Point2f>& points, const DegrafFlowParams& params)
+{
+	Mat prev = from.getMat();
+	Mat cur = to.getMat();
+	vector<Point2f> dst_points;
 
 	//////////////////////////////// RLOF ////////////////////////////////////////////////////////////////
 
-	int64 timeStart1 = getTickCount();
+	ScopedStageTimer tracking_timer(STAGE_TRACKING, &stage_times.tracking);
 
 	rlof::Image img0, img1;
 	std::vector<rlof::CRPoint> prevPoints, currPoints;
@@ -297,10 +508,10 @@ void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArra
 	rlof::Parameter rlof_Parmeter;
 	rlof_Parmeter.m_UseIlluminationModel = true;
 	rlof_Parmeter.m_UseGlobalMotionPrior = true;
-	rlof_Parmeter.m_SmallWinSize = 10;
-	rlof_Parmeter.m_LargeWinSize = 11;
-	rlof_Parmeter.m_MaxLevel = 4;
-	rlof_Parmeter.m_MaxIter = 30;
+	rlof_Parmeter.m_SmallWinSize = params.rlof_small_win;
+	rlof_Parmeter.m_LargeWinSize = params.rlof_large_win;
+	rlof_Parmeter.m_MaxLevel = params.rlof_max_level;
+	rlof_Parmeter.m_MaxIter = params.rlof_max_iter;
 	rlof::SparseFlow * proc = rlof::SparseFlow::create(rlof_Parmeter);
 
 	try
@@ -312,8 +523,8 @@ void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArra
 		std::cout << e.what() << std::endl;
 	}
 
-	// Clear memory by calling destructor
-	proc->~SparseFlow();
+	// Clear memory
+	delete proc;
 	// clear points 
 	dst_points.clear();
 	dst_points_filtered.clear();
@@ -328,7 +539,10 @@ void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArra
 		dst_points.push_back(Point2f(currPoints[r].x, currPoints[r].y));
 	}
 
-	int max_flow_length = 100;
+	tracking_timer.stop();
+
+	ScopedStageTimer filtering_timer(STAGE_FILTERING, &stage_times.tracking);
+	int max_flow_length = params.max_flow_length;
 	for (unsigned int i = 0; i < points.size(); i++) {
 
 		if (sqrt(pow(points[i].x - dst_points[i].x, 2) + pow(points[i].y - dst_points[i].y, 2)) < max_flow_length &&
@@ -340,30 +554,25 @@ void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArra
 		}
 	}
 
-	long double execTime1 = (getTickCount()*1.0000 - timeStart1) / (getTickFrequency() * 1.0000);
-	std::cout << "Time to run RLOF = " << execTime1 << "\n\n";
-
-
-	////////////////////////////////   Interpolation  //////////////////////////////////////////////////////////////////
-
-	int64 timeStart2 = getTickCount();
-
-	if (points_filtered.size() > SHRT_MAX) {
-		cout << "Too many points to interpolate";
-	}
-
-	flow.create(from.size(), CV_32FC2);
-	Mat dense_flow = flow.getMat();
-
-	Ptr<ximgproc::EdgeAwareInterpolator> gd = ximgproc::createEdgeAwareInterpolator();
-	gd->setK(k);
-	gd->setSigma(sigma);
-	gd->setUsePostProcessing(use_post_proc);
-	gd->setFGSLambda(fgs_lambda);
-	gd->setFGSSigma(fgs_sigma);
+	filtering_timer.stop();
+}
 
-	gd->interpolate(prev, points_filtered, cur, dst_points_filtered, dense_flow);
+// Edge-aware interpolated flow at selected pixels only, using the matches of the last degraf_* call.
+// Avoids the full-image interpolation when only a few thousand positions are needed.
+/*!
+\param from first image used to compute the matches
+\param query_points pixel positions in from at which flow is wanted
+\param query_flow output flow vectors, one per query point (NaN where no match is reachable)
+\param k number of support matches per query
+\param sigma geodesic weight decay, as in the EdgeAwareInterpolator
+*/
+void FeatureMatcher::interpolate_at(InputArray from, const vector<Point2f>& query_points, vector<Point2f>& query_flow, int k, float sigma)
+{
+	CV_Assert(k > 3 && sigma > 0.0001f);
 
-	long double execTime2 = (getTickCount()*1.0000 - timeStart2) / (getTickFrequency() * 1.0000);
-	std::cout << "Time to interpolate = " << execTime2 << "\n";
-}
\ No newline at end of file
+	LazyFlowInterpolator interpolator;
+	interpolator.k = k;
+	interpolator.sigma = sigma;
+	interpolator.setMatches(from, points_filtered, dst_points_filtered);
+	interpolator.query(query_points, query_flow);
+}
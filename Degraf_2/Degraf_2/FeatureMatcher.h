@@ -8,6 +8,9 @@
 
 #include "GradientDetector.h"
 #include "SaliencyDetector.h"
+#include "LazyFlowInterpolator.h"
+#include "StageProfiler.h"
+#include "MemoryAccounting.h"
 #include "opencv2/videoio.hpp"
 #include "opencv2/highgui.hpp"
 #include "opencv2/imgproc.hpp"
@@ -16,6 +19,7 @@
 #include <opencv2/features2d.hpp>
 #include "opencv2/calib3d.hpp"
 #include "opencv2/ximgproc/sparse_match_interpolator.hpp"
+#include "opencv2/ximgproc/edge_filter.hpp"
 
 #include "opencv2/optflow.hpp"
 #include "opencv2/core/ocl.hpp"
@@ -30,14 +34,80 @@
 
 using namespace cv;
 
+// Tunable parameters of the DeGraF-Flow pipeline, defaults are the values used for the published RLOF results
+// (lucasKanade() gives those of the LK variant)
+struct DegrafFlowParams {
+	// DoGoS saliency and DeGraF detector
+	int saliency_levels = 3;
+	int window_width = 3;
+	int window_height = 3;
+	int step_x = 9;
+	int step_y = 9;
+	int max_points = 0;			// point budget, 0 keeps every DeGraF point
+
+	// RLOF tracker
+	int rlof_small_win = 10;
+	int rlof_large_win = 11;
+	int rlof_max_level = 4;
+	int rlof_max_iter = 30;
+
+	// Lucas-Kanade tracker, degraf_flow_LK only
+	int lk_win = 11;
+	int lk_max_level = 4;
+
+	// Match filtering
+	int max_flow_length = 100;
+
+	// EdgeAwareInterpolator
+	int k = 127;
+	float sigma = 0.05f;
+	bool use_post_proc = true;
+	float fgs_lambda = 500.0f;
+	float fgs_sigma = 1.5f;
+
+	// Named speed/quality operating points, analogous to DISOpticalFlow::PRESET_*
+	enum Preset { PRESET_ULTRAFAST = 0, PRESET_FAST = 1, PRESET_BALANCED = 2, PRESET_ACCURATE = 3 };
+	static DegrafFlowParams preset(int p_preset);
+	static const char* presetName(int p_preset);
+
+	// Settings of the published LK variant: 5 saliency levels, step 7 and k = 60
+	static DegrafFlowParams lucasKanade();
+};
+
+// Wall-clock time (seconds) of each stage of the last DeGraF-Flow call
+struct DegrafStageTimes {
+	double detection = 0.0;		// grey conversion, saliency and DeGraF points
+	double tracking = 0.0;		// RLOF and match filtering
+	double interpolation = 0.0;	// edge-aware interpolation and FGS
+	double total = 0.0;
+};
+
 class FeatureMatcher {
 
 	public:
 		// Public variables
 		vector<Point2f> points_filtered, dst_points_filtered; // corresponding points in each image
+		DegrafStageTimes stage_times; // filled by the degraf_flow_* / degraf_matches_* functions
 
 		// Public functions
 		FeatureMatcher();
 		void FeatureMatcher::degraf_flow_LK(InputArray from, InputArray to, OutputArray flow, int k, float sigma, bool use_post_proc, float fgs_lambda, float fgs_sigma);
 		void FeatureMatcher::degraf_flow_RLOF(InputArray from, InputArray to, OutputArray flow, int k, float sigma, bool use_post_proc, float fgs_lambda, float fgs_sigma);
+
+		// Sparse stages only: fill points_filtered / dst_points_filtered without computing dense flow
+		void degraf_matches_LK(InputArray from, InputArray to);
+		void degraf_matches_LK(InputArray from, InputArray to, const DegrafFlowParams& params);
+		void degraf_flow_LK(InputArray from, InputArray to, OutputArray flow, const DegrafFlowParams& params);
+		void degraf_matches_RLOF(InputArray from, InputArray to);
+		void degraf_matches_RLOF(InputArray from, InputArray to, const DegrafFlowParams& params);
+		void degraf_flow_RLOF(InputArray from, InputArray to, OutputArray flow, const DegrafFlowParams& params);
+
+		// Individual stages of degraf_flow_RLOF, so callers can reuse the output of earlier stages
+		void degraf_detect(InputArray from, vector<Point2f>& points, const DegrafFlowParams& params);
+		void degraf_track(InputArray from, InputArray to, const vector<Point2f>& points, const DegrafFlowParams& params);
+		void degraf_interpolate(InputArray from, InputArray to, OutputArray flow, const DegrafFlowParams& params);
+		void degraf_post_process(InputArray from, InputOutputArray flow, const DegrafFlowParams& params);
+
+		// Edge-aware flow at selected pixels from the current sparse matches, cost scales with the number of queries
+		void interpolate_at(InputArray from, const vector<Point2f>& query_points, vector<Point2f>& query_flow, int k, float sigma);
 };
@@ -0,0 +1,92 @@
+/*!
+\file FlowMethod.cpp
+\brief Uniform, reusable wrapper around every dense flow method the evaluation supports
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "FlowMethod.h"
+
+using namespace optflow;
+
+// OpenCV DenseOpticalFlow implementations
+class DenseFlowMethod : public FlowMethod {
+
+	public:
+		DenseFlowMethod(const String& p_name, bool p_grey_input, const Ptr<DenseOpticalFlow>& p_algorithm)
+			: FlowMethod(p_name, p_grey_input), algorithm(p_algorithm) {}
+
+		void calc(const Mat& i1, const Mat& i2, Mat& flow)
+		{
+			algorithm->calc(i1, i2, flow);
+		}
+
+	private:
+		Ptr<DenseOpticalFlow> algorithm;
+};
+
+// DeGraF-Flow, the matcher keeps its detector and tracker state between calls
+class DegrafFlowMethod : public FlowMethod {
+
+	public:
+		DegrafFlowMethod(const String& p_name, bool p_lk, const DegrafFlowParams& p_params)
+			: FlowMethod(p_name, false), lk(p_lk), params(p_params) {}
+
+		void calc(const Mat& i1, const Mat& i2, Mat& flow)
+		{
+			if (lk)
+				matcher.degraf_flow_LK(i1, i2, flow, params);
+			else
+				matcher.degraf_flow_RLOF(i1, i2, flow, params);
+		}
+
+		bool lastMatches(std::vector<Point2f>& from, std::vector<Point2f>& to) const
+		{
+			from = matcher.points_filtered;
+			to = matcher.dst_points_filtered;
+			return true;
+		}
+
+	private:
+		bool lk;
+		DegrafFlowParams params;
+		FeatureMatcher matcher;
+};
+
+Ptr<FlowMethod> FlowMethod::create(const String& name)
+{
+	if (name == "farneback")
+		return makePtr<DenseFlowMethod>(name, true, createOptFlow_Farneback());
+	if (name == "simpleflow")
+		return makePtr<DenseFlowMethod>(name, false, createOptFlow_SimpleFlow());
+	if (name == "tvl1")
+		return makePtr<DenseFlowMethod>(name, true, createOptFlow_DualTVL1());
+	if (name == "deepflow")
+		return makePtr<DenseFlowMethod>(name, true, createOptFlow_DeepFlow());
+	if (name == "sparsetodenseflow")
+		return makePtr<DenseFlowMethod>(name, false, createOptFlow_SparseToDense());
+	if (name == "pcaflow")
+		return makePtr<DenseFlowMethod>(name, false, createOptFlow_PCAFlow());
+	if (name == "DISflow_ultrafast")
+		return makePtr<DenseFlowMethod>(name, true, createOptFlow_DIS(DISOpticalFlow::PRESET_ULTRAFAST));
+	if (name == "DISflow_fast")
+		return makePtr<DenseFlowMethod>(name, true, createOptFlow_DIS(DISOpticalFlow::PRESET_FAST));
+	if (name == "DISflow_medium")
+		return makePtr<DenseFlowMethod>(name, true, createOptFlow_DIS(DISOpticalFlow::PRESET_MEDIUM));
+	if (name == "degraf_flow_lk")
+		return makePtr<DegrafFlowMethod>(name, true, DegrafFlowParams::lucasKanade());
+	if (name == "degraf_flow_rlof")
+		return makePtr<DegrafFlowMethod>(name, false, DegrafFlowParams());
+	for (int p = DegrafFlowParams::PRESET_ULTRAFAST; p <= DegrafFlowParams::PRESET_ACCURATE; p++) {
+		if (name == String("degraf_flow_") + DegrafFlowParams::presetName(p))
+			return makePtr<DegrafFlowMethod>(name, false, DegrafFlowParams::preset(p));
+	}
+	return Ptr<FlowMethod>();
+}
+
+std::vector<String> FlowMethod::allMethods()
+{
+	const char* names[] = { "farneback", "tvl1", "deepflow", "sparsetodenseflow", "pcaflow",
+		"DISflow_ultrafast", "DISflow_fast", "DISflow_medium", "degraf_flow_lk", "degraf_flow_rlof" };
+	return std::vector<String>(names, names + sizeof(names) / sizeof(names[0]));
+}
@@ -0,0 +1,47 @@
+/*!
+\file FlowMethod.h
+\brief Uniform, reusable wrapper around every dense flow method the evaluation supports
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FeatureMatcher.h"
+
+#include "opencv2/optflow.hpp"
+
+#include <vector>
+
+// A flow method whose algorithm object is created once and reused for every pair, so repeated calls
+// are timed warm. Method names are the ones accepted by EvaluateOptFlow::evaluatePair, which dispatches
+// through here too.
+class FlowMethod {
+
+	public:
+		virtual ~FlowMethod() {}
+
+		// Inputs must be 8 bit, single channel if greyInput() and 3 channel otherwise
+		virtual void calc(const Mat& i1, const Mat& i2, Mat& flow) = 0;
+
+		// Sparse matches the last flow was interpolated from, for display; false for methods without any
+		virtual bool lastMatches(std::vector<Point2f>& from, std::vector<Point2f>& to) const { return false; }
+
+		const String& name() const { return method_name; }
+		bool greyInput() const { return grey_input; }
+
+		/*!
+		\param name method name, e.g. "tvl1", "DISflow_fast", "degraf_flow_rlof", "degraf_flow_accurate"
+		\return the method, empty if the name is unknown
+		*/
+		static Ptr<FlowMethod> create(const String& name);
+
+		// Every method compared by default: the OpenCV methods, all DIS presets and DeGraF-Flow LK and RLOF
+		static std::vector<String> allMethods();
+
+	protected:
+		FlowMethod(const String& p_name, bool p_grey_input) : method_name(p_name), grey_input(p_grey_input) {}
+
+	private:
+		String method_name;
+		bool grey_input;
+};
@@ -0,0 +1,229 @@
+/*!
+\file FlowMetrics.cpp
+\brief Single-pass, row-parallel and vectorised optical flow error metrics against ground truth
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "FlowMetrics.h"
+
+#include "opencv2/core/hal/intrin.hpp"
+
+#include <cmath>
+#include <vector>
+
+const float FlowMetrics::R_THRESHOLDS[FlowMetrics::R_COUNT] = { 0.5f, 1.f, 2.f, 3.f, 5.f, 10.f };
+const float FlowMetrics::A_QUANTILES[FlowMetrics::A_COUNT] = { 0.5f, 0.75f, 0.95f };
+
+static const int ROWS_PER_CHUNK = 8;
+static const int BINS_PER_PIXEL = 64;
+static const float FLOW_LIMIT = 1e9f;
+
+// Partial sums of one chunk of rows
+struct MetricsPartial {
+	double count, invalid_flow;
+	double epe_sum, epe_sq_sum, epe_max;
+	double ae_sum, ae_sq_sum;
+	double r_count[FlowMetrics::R_COUNT];
+	double fl_count;
+	std::vector<int> hist;		// last bin is the overflow bin
+};
+
+static inline bool finiteFlow(float x, float y)
+{
+	return x == x && y == y && fabs(x) < FLOW_LIMIT && fabs(y) < FLOW_LIMIT;
+}
+
+// Scalar kernel for one pixel, also used for the row tails of the vector path
+static inline void accumulatePixel(float fx, float fy, float gx, float gy, MetricsPartial& p, float* epe_out, float* cos_out)
+{
+	float dx = fx - gx, dy = fy - gy;
+	float epe = std::sqrt(dx * dx + dy * dy);
+	float gt_mag = std::sqrt(gx * gx + gy * gy);
+	p.count += 1;
+	p.epe_sum += epe;
+	p.epe_sq_sum += (double)epe * epe;
+	for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+		p.r_count[t] += epe > FlowMetrics::R_THRESHOLDS[t];
+	p.fl_count += (epe > 3.0f && epe > 0.05f * gt_mag);
+	*epe_out = epe;
+	*cos_out = (fx * gx + fy * gy + 1.0f) / std::sqrt((fx * fx + fy * fy + 1.0f) * (gx * gx + gy * gy + 1.0f));
+}
+
+// Processes one row: the vector loop computes EPE, moments, R and Fl counts for four pixels at a time and
+// leaves EPE and cosine of the valid pixels in row buffers; a scalar loop then does acos, max and the histogram
+static void processRow(const float* f, const float* g, const uchar* m, int cols, MetricsPartial& p,
+	float* epe_buf, float* cos_buf, uchar* valid_buf, float hist_scale)
+{
+	int j = 0;
+#if CV_SIMD128
+	v_float32x4 v_zero = v_setzero_f32(), v_one = v_setall_f32(1.0f);
+	v_float32x4 v_limit = v_setall_f32(FLOW_LIMIT), v_three = v_setall_f32(3.0f), v_fl_rel = v_setall_f32(0.05f);
+	v_float32x4 v_r[FlowMetrics::R_COUNT], v_r_count[FlowMetrics::R_COUNT];
+	for (int t = 0; t < FlowMetrics::R_COUNT; t++) {
+		v_r[t] = v_setall_f32(FlowMetrics::R_THRESHOLDS[t]);
+		v_r_count[t] = v_zero;
+	}
+	v_float32x4 v_count = v_zero, v_invalid = v_zero, v_sum = v_zero, v_sq_sum = v_zero, v_fl = v_zero;
+
+	for (; j <= cols - 4; j += 4) {
+		// Deinterleave x0 y0 x1 y1 | x2 y2 x3 y3 into x0..x3 and y0..y3 with two zips
+		v_float32x4 a0 = v_load(f + 2 * j), a1 = v_load(f + 2 * j + 4), t0, t1, fx, fy;
+		v_zip(a0, a1, t0, t1);
+		v_zip(t0, t1, fx, fy);
+		a0 = v_load(g + 2 * j); a1 = v_load(g + 2 * j + 4);
+		v_zip(a0, a1, t0, t1);
+		v_float32x4 gx, gy;
+		v_zip(t0, t1, gx, gy);
+
+		v_float32x4 in_mask = v_one;
+		if (m != NULL)
+			in_mask = v_float32x4(m[j] ? 1.0f : 0.0f, m[j + 1] ? 1.0f : 0.0f, m[j + 2] ? 1.0f : 0.0f, m[j + 3] ? 1.0f : 0.0f);
+
+		// NaN compares unequal to itself, so x == x & |x| < limit is the finiteness test
+		v_float32x4 gt_ok = (gx == gx) & (gy == gy) & (v_abs(gx) < v_limit) & (v_abs(gy) < v_limit) & (in_mask != v_zero);
+		v_float32x4 flow_ok = (fx == fx) & (fy == fy) & (v_abs(fx) < v_limit) & (v_abs(fy) < v_limit);
+		v_float32x4 valid = gt_ok & flow_ok;
+		v_invalid += v_select(gt_ok, v_one, v_zero) - v_select(valid, v_one, v_zero);
+
+		// Zero invalid lanes before any arithmetic so NaN cannot leak into the sums
+		fx = v_select(valid, fx, v_zero); fy = v_select(valid, fy, v_zero);
+		gx = v_select(valid, gx, v_zero); gy = v_select(valid, gy, v_zero);
+
+		v_float32x4 dx = fx - gx, dy = fy - gy;
+		v_float32x4 epe = v_sqrt(dx * dx + dy * dy);
+		v_float32x4 gt_mag = v_sqrt(gx * gx + gy * gy);
+		v_float32x4 one_if_valid = v_select(valid, v_one, v_zero);
+
+		v_count += one_if_valid;
+		v_sum += epe;
+		v_sq_sum += epe * epe;
+		for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+			v_r_count[t] += v_select(epe > v_r[t], v_one, v_zero);
+		v_fl += v_select((epe > v_three) & (epe > gt_mag * v_fl_rel), v_one, v_zero);
+
+		v_float32x4 cosine = (fx * gx + fy * gy + v_one) / v_sqrt((fx * fx + fy * fy + v_one) * (gx * gx + gy * gy + v_one));
+		v_store(epe_buf + j, epe);
+		v_store(cos_buf + j, cosine);
+		float lanes[4];
+		v_store(lanes, one_if_valid);
+		for (int l = 0; l < 4; l++)
+			valid_buf[j + l] = lanes[l] != 0.0f;
+	}
+
+	p.count += v_reduce_sum(v_count);
+	p.invalid_flow += v_reduce_sum(v_invalid);
+	p.epe_sum += v_reduce_sum(v_sum);
+	p.epe_sq_sum += v_reduce_sum(v_sq_sum);
+	for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+		p.r_count[t] += v_reduce_sum(v_r_count[t]);
+	p.fl_count += v_reduce_sum(v_fl);
+#endif
+
+	for (; j < cols; j++) {
+		valid_buf[j] = 0;
+		if (m != NULL && m[j] == 0)
+			continue;
+		float fx = f[2 * j], fy = f[2 * j + 1], gx = g[2 * j], gy = g[2 * j + 1];
+		if (!finiteFlow(gx, gy))
+			continue;
+		if (!finiteFlow(fx, fy)) {
+			p.invalid_flow += 1;
+			continue;
+		}
+		accumulatePixel(fx, fy, gx, gy, p, epe_buf + j, cos_buf + j);
+		valid_buf[j] = 1;
+	}
+
+	int overflow = (int)p.hist.size() - 1;
+	for (j = 0; j < cols; j++) {
+		if (!valid_buf[j])
+			continue;
+		float epe = epe_buf[j];
+		double ae = acos((double)(std::min)(1.0f, (std::max)(-1.0f, cos_buf[j]))) * 180.0 / CV_PI;
+		p.ae_sum += ae;
+		p.ae_sq_sum += ae * ae;
+		if (epe > p.epe_max)
+			p.epe_max = epe;
+		int bin = (int)(epe * hist_scale);
+		p.hist[bin < overflow ? bin : overflow]++;
+	}
+}
+
+void computeFlowMetrics(const Mat& flow, const Mat& ground_truth, const Mat& mask, FlowMetrics& metrics, float hist_range)
+{
+	CV_Assert(flow.type() == CV_32FC2 && ground_truth.type() == CV_32FC2 && flow.size() == ground_truth.size());
+	CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == flow.size()));
+
+	const int rows = flow.rows, cols = flow.cols;
+	const int chunks = (rows + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK;
+	const int hist_bins = (int)ceil(hist_range * BINS_PER_PIXEL) + 1;
+	const float hist_scale = (float)BINS_PER_PIXEL;
+
+	std::vector<MetricsPartial> partials(chunks);
+	parallel_for_(Range(0, chunks), [&](const Range& range) {
+		std::vector<float> epe_buf(cols), cos_buf(cols);
+		std::vector<uchar> valid_buf(cols);
+		for (int c = range.start; c < range.end; c++) {
+			MetricsPartial& p = partials[c];
+			p.count = p.invalid_flow = p.epe_sum = p.epe_sq_sum = p.epe_max = 0;
+			p.ae_sum = p.ae_sq_sum = p.fl_count = 0;
+			for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+				p.r_count[t] = 0;
+			p.hist.assign(hist_bins, 0);
+
+			int row_end = (std::min)(rows, (c + 1) * ROWS_PER_CHUNK);
+			for (int i = c * ROWS_PER_CHUNK; i < row_end; i++)
+				processRow(flow.ptr<float>(i), ground_truth.ptr<float>(i), mask.empty() ? NULL : mask.ptr<uchar>(i), cols, p,
+					&epe_buf[0], &cos_buf[0], &valid_buf[0], hist_scale);
+		}
+	});
+
+	// Merge in chunk order so the floating point sums do not depend on scheduling
+	MetricsPartial total;
+	total.count = total.invalid_flow = total.epe_sum = total.epe_sq_sum = total.epe_max = 0;
+	total.ae_sum = total.ae_sq_sum = total.fl_count = 0;
+	for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+		total.r_count[t] = 0;
+	total.hist.assign(hist_bins, 0);
+	for (int c = 0; c < chunks; c++) {
+		const MetricsPartial& p = partials[c];
+		total.count += p.count;
+		total.invalid_flow += p.invalid_flow;
+		total.epe_sum += p.epe_sum;
+		total.epe_sq_sum += p.epe_sq_sum;
+		total.epe_max = (std::max)(total.epe_max, p.epe_max);
+		total.ae_sum += p.ae_sum;
+		total.ae_sq_sum += p.ae_sq_sum;
+		total.fl_count += p.fl_count;
+		for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+			total.r_count[t] += p.r_count[t];
+		for (int b = 0; b < hist_bins; b++)
+			total.hist[b] += p.hist[b];
+	}
+
+	double n = total.count;
+	metrics.valid_pixels = (int)n;
+	metrics.invalid_flow = (int)total.invalid_flow;
+	metrics.epe_mean = n > 0 ? total.epe_sum / n : 0.0;
+	metrics.epe_std = n > 0 ? sqrt((std::max)(0.0, total.epe_sq_sum / n - metrics.epe_mean * metrics.epe_mean)) : 0.0;
+	metrics.epe_max = total.epe_max;
+	metrics.ae_mean = n > 0 ? total.ae_sum / n : 0.0;
+	metrics.ae_std = n > 0 ? sqrt((std::max)(0.0, total.ae_sq_sum / n - metrics.ae_mean * metrics.ae_mean)) : 0.0;
+	for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+		metrics.R[t] = n > 0 ? (float)(total.r_count[t] / n * 100.0) : 0.0f;
+	metrics.fl = n > 0 ? (float)(total.fl_count / n * 100.0) : 0.0f;
+
+	for (int q = 0; q < FlowMetrics::A_COUNT; q++) {
+		metrics.A[q] = 0.0f;
+		long long cutoff = (long long)floor(FlowMetrics::A_QUANTILES[q] * n + 0.5);
+		long long seen = 0;
+		for (int b = 0; b < hist_bins; b++) {
+			seen += total.hist[b];
+			if (seen >= cutoff && cutoff > 0) {
+				metrics.A[q] = (b == hist_bins - 1) ? (float)total.epe_max : (std::min)((float)(b + 1) / hist_scale, (float)total.epe_max);
+				break;
+			}
+		}
+	}
+}
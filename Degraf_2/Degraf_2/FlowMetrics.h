@@ -0,0 +1,41 @@
+/*!
+\file FlowMetrics.h
+\brief Single-pass, row-parallel and vectorised optical flow error metrics against ground truth
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+
+using namespace cv;
+
+// All error statistics of one flow field. Only pixels that are inside the mask and have finite
+// ground truth and finite computed flow are counted.
+struct FlowMetrics {
+	static const int R_COUNT = 6;
+	static const int A_COUNT = 3;
+	static const float R_THRESHOLDS[R_COUNT];	// 0.5, 1, 2, 3, 5, 10 px
+	static const float A_QUANTILES[A_COUNT];	// 0.5, 0.75, 0.95
+
+	int valid_pixels;
+	int invalid_flow;			// pixels with valid ground truth but a non-finite computed flow, not counted
+	double epe_mean, epe_std, epe_max;
+	double ae_mean, ae_std;		// angular error of the space-time vectors (u, v, 1), degrees
+	float R[R_COUNT];			// percentage of pixels with EPE above each threshold
+	float fl;					// KITTI Fl: percentage of pixels with EPE > 3 px and > 5% of the ground truth magnitude
+	float A[A_COUNT];			// EPE below which each fraction of pixels lies
+};
+
+// Computes every FlowMetrics field in a single sweep over flow, ground truth and mask. Rows are split
+// into fixed chunks evaluated in parallel and merged in chunk order, so results are deterministic.
+// A quantiles come from a fixed-range histogram ([0, hist_range) px in 1/64 px bins, larger errors
+// share an overflow bin resolved to epe_max).
+/*!
+\param flow computed flow, CV_32FC2
+\param ground_truth ground truth flow, CV_32FC2, NaN (or |value| >= 1e9) where unknown
+\param mask CV_8U region of interest, non-zero pixels are evaluated, empty for the whole image
+\param metrics output
+\param hist_range upper end of the A quantile histogram in pixels
+*/
+void computeFlowMetrics(const Mat& flow, const Mat& ground_truth, const Mat& mask, FlowMetrics& metrics, float hist_range = 64.0f);
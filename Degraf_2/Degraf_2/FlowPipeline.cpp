@@ -0,0 +1,201 @@
+/*!
+\file FlowPipeline.cpp
+\brief DeGraF-Flow on a video stream as a task graph, stages of consecutive frames overlapped
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "FlowPipeline.h"
+#include "FlowVisualization.h"
+#include "SequenceReader.h"
+
+#include "opencv2/videoio.hpp"
+
+FlowPipeline::FlowPipeline(const DegrafFlowParams& p_params, Consumer p_consumer, int p_max_in_flight, int threads)
+	: params(p_params), consumer(p_consumer), max_in_flight((std::max)(1, p_max_in_flight)), slots(max_in_flight + 1),
+	serial_opencv(threads > 0 ? threads : ThreadPool::hardwareThreads()), graph(threads)
+{
+	CV_Assert(params.k > 3 && params.sigma > 0.0001f && params.fgs_lambda > 1.0f && params.fgs_sigma > 0.01f);
+	pushed = 0;
+	emitted = 0;
+}
+
+FlowPipeline::~FlowPipeline()
+{
+	// Not finish(), which rethrows consumer exceptions
+	graph.waitAll();
+}
+
+// Runs one stage of frame or pair t, any exception fails the stage with a message
+/*!
+\param unit "Frame" or "Pair", what t counts
+\param name stage name for the message
+\return false if the stage threw
+*/
+static bool runStage(const char* unit, int t, const char* name, const std::function<void()>& stage)
+{
+	try {
+		stage();
+		return true;
+	}
+	catch (const std::exception& ex) {
+		printf("%s %d %s: %s\n", unit, t, name, ex.what());
+	}
+	catch (...) {
+		printf("%s %d %s: unknown error\n", unit, t, name);
+	}
+	return false;
+}
+
+// Marks pair t emitted when it goes out of scope, so a consumer that throws cannot stall push()
+struct EmittedGuard {
+	std::mutex& mutex;
+	std::condition_variable& emitted_cv;
+	int& emitted;
+	int t;
+
+	~EmittedGuard()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			emitted = t;
+		}
+		emitted_cv.notify_all();
+	}
+};
+
+void FlowPipeline::push(const Mat& frame)
+{
+	int t = pushed;
+
+	// The slot's previous frame, t - max_in_flight - 1, is last read by emit(t - max_in_flight)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		emitted_cv.wait(lock, [&]() { return t - 1 - emitted < max_in_flight; });
+	}
+
+	// The emit of the slot's previous pair has finished, this rethrows what its consumer call threw
+	Slot& s = slot(t);
+	TaskGraph::Handle previous_emit;
+	previous_emit.swap(s.emitted);
+	graph.wait(previous_emit);
+
+	// A fresh flow buffer, the consumer may still hold the one of the slot's previous pair
+	frame.copyTo(s.frame);
+	s.flow = Mat();
+	s.detect_failed = false;
+	s.failed = false;
+
+	s.detected = graph.add([this, t]() {
+		Slot& current = slot(t);
+		if (!runStage("Frame", t, "detection", [&]() { current.detector.degraf_detect(current.frame, current.points, params); }))
+			current.points.clear();
+		current.detect_failed = current.points.empty();
+	});
+
+	if (t > 0) {
+		Slot& previous = slot(t - 1);
+
+		TaskGraph::Handle tracked = graph.add([this, t]() {
+			Slot& from = slot(t - 1);
+			Slot& to = slot(t);
+			if (from.detect_failed) {
+				to.failed = true;
+				return;
+			}
+			to.failed = !runStage("Pair", t, "tracking", [&]() { to.matcher.degraf_track(from.frame, to.frame, from.points, params); });
+		}, { previous.detected });
+
+		// FGS runs as its own task, so interpolation of the next pair can start meanwhile
+		TaskGraph::Handle interpolated = graph.add([this, t]() {
+			Slot& to = slot(t);
+			if (to.failed)
+				return;
+			DegrafFlowParams interpolation = params;
+			interpolation.use_post_proc = false;
+			to.failed = !runStage("Pair", t, "interpolation", [&]() {
+				to.matcher.degraf_interpolate(slot(t - 1).frame, to.frame, to.flow, interpolation);
+			});
+		}, { tracked });
+
+		TaskGraph::Handle smoothed = graph.add([this, t]() {
+			Slot& to = slot(t);
+			if (to.failed || !params.use_post_proc)
+				return;
+			to.failed = !runStage("Pair", t, "post-processing", [&]() { to.matcher.degraf_post_process(slot(t - 1).frame, to.flow, params); });
+		}, { interpolated });
+
+		s.emitted = graph.add([this, t]() {
+			EmittedGuard guard = { mutex, emitted_cv, emitted, t };
+			Slot& to = slot(t);
+			if (consumer)
+				consumer(t, slot(t - 1).frame, to.frame, to.failed ? Mat() : to.flow);
+		}, { smoothed, previous.emitted });
+	}
+	pushed++;
+}
+
+void FlowPipeline::finish()
+{
+	graph.waitAll();
+	for (size_t i = 0; i < slots.size(); i++) {
+		TaskGraph::Handle emit;
+		emit.swap(slots[i].emitted);
+		graph.wait(emit);
+	}
+}
+
+int runFlowStream(const std::string& pattern, const std::string& output_video, int max_frames, int max_in_flight, int threads)
+{
+	SequenceReader frames(pattern, 0, max_frames, IMREAD_COLOR);
+	Mat frame;
+	if (!frames.frame(0, frame)) {
+		printf("Could not read %s\n", frames.path(0).c_str());
+		return -1;
+	}
+
+	VideoWriter video;
+	Mat win_mat;
+	if (!output_video.empty()) {
+		video.open(output_video, CV_FOURCC('D', 'I', 'V', 'X'), 10, Size(frame.cols, frame.rows * 2), true);
+		if (!video.isOpened()) {
+			printf("Could not open the output video for write: %s\n", output_video.c_str());
+			return -1;
+		}
+		win_mat.create(Size(frame.cols, frame.rows * 2), CV_8UC3);
+	}
+
+	// The consumer runs on the pool, one pair at a time and in order, so it can write the video directly
+	int failed = 0;
+	FlowPipeline pipeline(DegrafFlowParams(), [&](int pair, const Mat& from, const Mat& to, const Mat& flow) {
+		if (flow.empty()) {
+			failed++;
+			return;
+		}
+		if (video.isOpened()) {
+			from.copyTo(win_mat(Rect(0, 0, from.cols, from.rows)));
+			flowToDisplay(flow).copyTo(win_mat(Rect(0, from.rows, from.cols, from.rows)));
+			video << win_mat;
+		}
+		if (pair % 50 == 0)
+			printf("  %d pairs\n", pair);
+	}, max_in_flight, threads);
+
+	// Frames are copied by push(), so the reader's buffer goes back straight away
+	int64 start = getTickCount();
+	int index = 0;
+	for (; frames.frame(index, frame); index++) {
+		pipeline.push(frame);
+		frames.release(index);
+	}
+	pipeline.finish();
+	double seconds = (double)(getTickCount() - start) / getTickFrequency();
+
+	int pairs = (std::max)(0, index - 1);
+	printf("%d pairs in %.2f s, %.2f pairs/s (%d in flight)\n", pairs, seconds, seconds > 0 ? pairs / seconds : 0.0, (std::max)(1, max_in_flight));
+	if (failed > 0)
+		printf("%d pairs failed\n", failed);
+	if (video.isOpened())
+		printf("Video written to %s\n", output_video.c_str());
+	return failed == 0 ? 0 : -1;
+}
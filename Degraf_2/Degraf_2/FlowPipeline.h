@@ -0,0 +1,107 @@
+/*!
+\file FlowPipeline.h
+\brief DeGraF-Flow on a video stream as a task graph, stages of consecutive frames overlapped
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FeatureMatcher.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Computes the flow between consecutive frames of a stream, the same per-pair algorithm as
+// FeatureMatcher::degraf_flow_RLOF but split into tasks:
+//
+//     detect(t)  DoGoS saliency and DeGraF points of frame t            needs frame t
+//     track(t)   RLOF of the points of frame t-1 into frame t           needs detect(t-1)
+//     interp(t)  edge-aware interpolation of the matches of pair t      needs track(t)
+//     smooth(t)  FGS post-processing                                    needs interp(t)
+//     emit(t)    hands the flow of pair t to the consumer               needs smooth(t) and emit(t-1)
+//
+// Detection of a frame does not wait for anything but the frame, so it overlaps the tracking and
+// interpolation of the pair before it, and a pair's stages overlap those of its neighbours. emit tasks
+// form a chain, so the consumer sees the pairs in order and never concurrently.
+//
+// At most max_in_flight pairs are between push() and emit; push() blocks beyond that. Each in-flight
+// pair owns a slot (frame copy, points, matcher and flow) from a ring that is reused, so the memory
+// stays fixed however long the stream.
+class FlowPipeline {
+
+	public:
+		// Called in pair order. flow is empty if a stage of the pair failed. An exception thrown by the consumer
+		// does not stop the stream, it is rethrown by the push() that reuses the pair's slot or by finish().
+		/*!
+		\param pair index of the pair, pair t is the flow from frame t-1 to frame t
+		\param from frame t-1
+		\param to frame t
+		\param flow dense flow, CV_32FC2
+		*/
+		typedef std::function<void(int pair, const Mat& from, const Mat& to, const Mat& flow)> Consumer;
+
+		/*!
+		\param params DeGraF-Flow parameters of every pair
+		\param consumer receives the flows, runs on a pool thread
+		\param max_in_flight pairs computed at once
+		\param threads pool threads, <= 0 for one per hardware thread
+		*/
+		FlowPipeline(const DegrafFlowParams& params, Consumer consumer, int max_in_flight = 4, int threads = 0);
+
+		// Finishes the pairs pushed so far, consumer exceptions not yet rethrown are dropped
+		~FlowPipeline();
+
+		// Adds the next frame of the stream (copied), blocks while max_in_flight pairs are unfinished
+		void push(const Mat& frame);
+
+		// Blocks until every pushed pair has been emitted, then rethrows a consumer exception if there was one
+		void finish();
+
+		int framesPushed() const { return pushed; }
+
+	private:
+		struct Slot {
+			Mat frame;
+			std::vector<Point2f> points;		// DeGraF points of frame
+			FeatureMatcher detector;			// detection of frame
+			FeatureMatcher matcher;				// matches of the pair ending at frame
+			Mat flow;
+			bool detect_failed;					// no points, the pair starting at frame fails
+			bool failed;						// the pair ending at frame failed
+			TaskGraph::Handle detected, emitted;
+		};
+
+		DegrafFlowParams params;
+		Consumer consumer;
+		int max_in_flight;
+		std::vector<Slot> slots;			// max_in_flight + 1: the frames of the pairs in flight and the frame before the oldest
+		int pushed;
+
+		std::mutex mutex;
+		std::condition_variable emitted_cv;
+		int emitted;						// pairs handed to the consumer
+
+		SerialOpenCVScope serial_opencv;	// OpenCV count restored after the workers have stopped
+		TaskGraph graph;					// declared last, so its workers stop before the slots go
+
+		Slot& slot(int frame) { return slots[frame % slots.size()]; }
+
+		FlowPipeline(const FlowPipeline&);
+		FlowPipeline& operator=(const FlowPipeline&);
+};
+
+// Command line entry: DeGraF-Flow over a numbered image sequence through the pipeline, prints the
+// throughput and optionally writes a video of frame and flow
+/*!
+\param pattern printf pattern of the frames
+\param output_video .avi to write, empty for none
+\param max_frames frames to read, < 0 for the whole sequence
+\param max_in_flight pairs computed at once, 1 runs the pairs one after the other
+\param threads pool threads, <= 0 for one per hardware thread
+\return 0 on success
+*/
+int runFlowStream(const std::string& pattern, const std::string& output_video, int max_frames, int max_in_flight, int threads);
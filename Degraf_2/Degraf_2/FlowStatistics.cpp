@@ -0,0 +1,170 @@
+/*!
+\file FlowStatistics.cpp
+\brief Typed per-pair evaluation results and a constant-memory aggregate over many pairs
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "FlowStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+RunningStat::RunningStat()
+	: n(0), m(0.0), m2(0.0), lo(std::numeric_limits<double>::quiet_NaN()), hi(std::numeric_limits<double>::quiet_NaN())
+{
+}
+
+void RunningStat::add(double x)
+{
+	n++;
+	double delta = x - m;
+	m += delta / n;
+	m2 += delta * (x - m);
+	if (n == 1 || x < lo)
+		lo = x;
+	if (n == 1 || x > hi)
+		hi = x;
+}
+
+double RunningStat::stddev() const
+{
+	return std::sqrt(variance());
+}
+
+TDigest::TDigest(double p_compression)
+	: compression(p_compression), total_weight(0.0), lo(0.0), hi(0.0)
+{
+}
+
+void TDigest::add(double x, double weight)
+{
+	if (cvIsNaN(x) || weight <= 0)
+		return;
+	if (total_weight == 0) {
+		lo = hi = x;
+	}
+	else {
+		lo = (std::min)(lo, x);
+		hi = (std::max)(hi, x);
+	}
+	total_weight += weight;
+	Centroid c = { x, weight };
+	buffer.push_back(c);
+	if (buffer.size() >= (size_t)(5 * compression))
+		compress();
+}
+
+// Sorts centroids and buffer together and merges neighbours while the merged centroid stays within the
+// size bound 4 N q (1 - q) / compression, which keeps the tails finely resolved
+void TDigest::compress() const
+{
+	if (buffer.empty())
+		return;
+	buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+	std::sort(buffer.begin(), buffer.end(), [](const Centroid& a, const Centroid& b) {
+		return a.mean < b.mean || (a.mean == b.mean && a.weight < b.weight);
+	});
+
+	centroids.clear();
+	Centroid current = buffer[0];
+	double weight_before = 0;
+	for (size_t i = 1; i < buffer.size(); i++) {
+		double proposed = current.weight + buffer[i].weight;
+		double q = (weight_before + proposed / 2) / total_weight;
+		if (proposed <= 4 * total_weight * q * (1 - q) / compression) {
+			current.mean += (buffer[i].mean - current.mean) * buffer[i].weight / proposed;
+			current.weight = proposed;
+		}
+		else {
+			weight_before += current.weight;
+			centroids.push_back(current);
+			current = buffer[i];
+		}
+	}
+	centroids.push_back(current);
+	buffer.clear();
+}
+
+// Linear interpolation between centroid centres, the minimum and maximum bound the outer halves
+double TDigest::quantile(double q) const
+{
+	if (total_weight == 0)
+		return std::numeric_limits<double>::quiet_NaN();
+	compress();
+	if (q <= 0)
+		return lo;
+	if (q >= 1)
+		return hi;
+
+	double target = q * total_weight;
+	double previous_centre = 0, previous_mean = lo;
+	double cumulative = 0;
+	for (size_t i = 0; i < centroids.size(); i++) {
+		double centre = cumulative + centroids[i].weight / 2;
+		if (target < centre) {
+			double t = centre > previous_centre ? (target - previous_centre) / (centre - previous_centre) : 0.0;
+			return previous_mean + t * (centroids[i].mean - previous_mean);
+		}
+		cumulative += centroids[i].weight;
+		previous_centre = centre;
+		previous_mean = centroids[i].mean;
+	}
+	double t = total_weight > previous_centre ? (target - previous_centre) / (total_weight - previous_centre) : 1.0;
+	return previous_mean + t * (hi - previous_mean);
+}
+
+StatsAggregator::StatsAggregator()
+	: pair_count(0)
+{
+}
+
+void StatsAggregator::add(const PairResult& result)
+{
+	pair_count++;
+	stats[FIELD_TIME].add(result.seconds);
+	digests[FIELD_TIME].add(result.seconds);
+	if (!result.has_ground_truth)
+		return;
+
+	double values[FIELD_COUNT];
+	values[FIELD_EPE] = result.error_mean;
+	values[FIELD_STD] = result.error_std;
+	for (int i = 0; i < FlowMetrics::R_COUNT; i++)
+		values[FIELD_R0 + i] = result.R[i];
+	values[FIELD_FL] = result.fl;
+	for (int f = 0; f < FIELD_TIME; f++) {
+		stats[f].add(values[f]);
+		digests[f].add(values[f]);
+	}
+}
+
+std::string StatsAggregator::fieldName(int field)
+{
+	if (field >= FIELD_R0 && field < FIELD_R0 + FlowMetrics::R_COUNT) {
+		char name[16];
+		sprintf(name, "R%.1f", FlowMetrics::R_THRESHOLDS[field - FIELD_R0]);
+		return name;
+	}
+	switch (field) {
+	case FIELD_EPE: return "EPE";
+	case FIELD_STD: return "STD";
+	case FIELD_FL: return "Fl";
+	case FIELD_TIME: return "time";
+	}
+	return "";
+}
+
+void StatsAggregator::print() const
+{
+	printf("%lld pairs, %lld with ground truth\n", pair_count, pairsWithGroundTruth());
+	printf("%-8s %10s %10s %10s %10s %10s %10s\n", "", "mean", "std", "min", "median", "p90", "max");
+	for (int f = 0; f < FIELD_COUNT; f++) {
+		if (stats[f].count() == 0)
+			continue;
+		printf("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", fieldName(f).c_str(), stats[f].mean(), stats[f].stddev(),
+			stats[f].minimum(), quantile(f, 0.5), quantile(f, 0.9), stats[f].maximum());
+	}
+}
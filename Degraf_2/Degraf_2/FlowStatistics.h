@@ -0,0 +1,114 @@
+/*!
+\file FlowStatistics.h
+\brief Typed per-pair evaluation results and a constant-memory aggregate over many pairs
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FlowMetrics.h"
+
+#include <string>
+#include <vector>
+
+// Results of one evaluated image pair
+struct PairResult {
+	int image_no = -1;
+	bool has_ground_truth = false;	// accuracy fields are only set when ground truth was available
+	float error_mean = 0;			// mean endpoint error in px (angular error in degrees with the angular measure)
+	float error_std = 0;
+	float R[FlowMetrics::R_COUNT] = {};	// percentage of pixels above each FlowMetrics::R_THRESHOLDS
+	float fl = 0;					// KITTI Fl in percent, 0 with the angular measure
+	double seconds = 0;				// flow computation time
+};
+
+// Running count, mean, variance, minimum and maximum (Welford)
+class RunningStat {
+
+	public:
+		RunningStat();
+
+		void add(double x);
+
+		long long count() const { return n; }
+		double mean() const { return n > 0 ? m : 0.0; }
+		double variance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+		double stddev() const;
+		double minimum() const { return lo; }
+		double maximum() const { return hi; }
+
+	private:
+		long long n;
+		double m, m2, lo, hi;
+};
+
+// Merging t-digest (Dunning) for streaming quantiles in O(compression) memory. Samples are buffered and
+// folded into the centroid list when the buffer fills; a digest only depends on the order its samples
+// arrive in, so adding them in a fixed order gives reproducible quantiles.
+class TDigest {
+
+	public:
+		explicit TDigest(double p_compression = 100.0);
+
+		void add(double x, double weight = 1.0);
+
+		/*!
+		\param q quantile in [0, 1]
+		\return estimated value, NaN if nothing was added
+		*/
+		double quantile(double q) const;
+		double count() const { return total_weight; }
+
+	private:
+		struct Centroid {
+			double mean;
+			double weight;
+		};
+
+		double compression;
+		double total_weight;
+		double lo, hi;
+		mutable std::vector<Centroid> centroids;	// sorted by mean once compressed
+		mutable std::vector<Centroid> buffer;
+
+		void compress() const;
+};
+
+// Mean, standard deviation, extremes and quantiles of every PairResult field over a stream of pairs,
+// in memory independent of the number of pairs. Add the pairs in a fixed order for bit-identical results.
+class StatsAggregator {
+
+	public:
+		enum Field {
+			FIELD_EPE = 0,
+			FIELD_STD,
+			FIELD_R0,				// FIELD_R0 + i is R at FlowMetrics::R_THRESHOLDS[i]
+			FIELD_FL = FIELD_R0 + FlowMetrics::R_COUNT,
+			FIELD_TIME,
+			FIELD_COUNT,
+
+			// R fields reported by name, indices into FlowMetrics::R_THRESHOLDS
+			FIELD_R2 = FIELD_R0 + 2,	// R2.0
+			FIELD_R3 = FIELD_R0 + 3		// R3.0
+		};
+
+		StatsAggregator();
+
+		void add(const PairResult& result);
+
+		long long pairs() const { return pair_count; }
+		long long pairsWithGroundTruth() const { return stats[FIELD_EPE].count(); }
+		const RunningStat& stat(int field) const { return stats[field]; }
+		double mean(int field) const { return stats[field].mean(); }
+		double quantile(int field, double q) const { return digests[field].quantile(q); }
+
+		static std::string fieldName(int field);
+
+		// Table of mean, std, min, median, 90th percentile and max of every field
+		void print() const;
+
+	private:
+		long long pair_count;
+		RunningStat stats[FIELD_COUNT];
+		TDigest digests[FIELD_COUNT];
+};
@@ -0,0 +1,134 @@
+/*!
+\file FlowVisualization.cpp
+\brief Colour coding of flow fields, error heat maps and the evaluation results window
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "FlowVisualization.h"
+
+#include "opencv2/imgproc.hpp"
+
+#include <limits>
+
+Mat flowToDisplay(const Mat& flow)
+{
+	// Used to show gt for kitti data with NaN values, on a copy as the flow may be shared with other threads
+	Mat flow_copy = flow.clone();
+	patchNaNs(flow_copy, 0.0);
+
+	Mat flow_split[2];
+	split(flow_copy, flow_split);
+
+	///////////////////-- New colour display/////////////////////////
+	Mat flowHSV, flowRGB;
+	std::vector<cv::Mat> flowVec(3);
+
+	cv::cartToPolar(flow_split[0], flow_split[1], flowVec[1], flowVec[0], true);
+	flowVec[2] = cv::Mat::ones(flowVec[0].size(), flowVec[0].type()) * 255;
+	cv::threshold(flowVec[1], flowVec[1], 4, 4, THRESH_TRUNC);
+	flowVec[1] = flowVec[1] * 0.25f;
+	cv::merge(flowVec, flowHSV);
+	cv::cvtColor(flowHSV, flowRGB, cv::COLOR_HSV2BGR);
+	flowRGB.convertTo(flowRGB, CV_8UC3);
+	return flowRGB;
+}
+
+Mat flowToDisplayNormalised(const Mat& flow)
+{
+	Mat flow_split[2];
+	Mat magnitude, angle;
+	Mat hsv_split[3], hsv, rgb;
+	split(flow, flow_split);
+	cartToPolar(flow_split[0], flow_split[1], magnitude, angle, true);
+	normalize(magnitude, magnitude, 0, 1, NORM_MINMAX);
+	hsv_split[0] = angle; // already in degrees - no normalization needed
+	hsv_split[1] = Mat::ones(angle.size(), angle.type());
+	hsv_split[2] = magnitude;
+	merge(hsv_split, 3, hsv);
+	cvtColor(hsv, rgb, COLOR_HSV2BGR);
+	return rgb;
+}
+
+Mat errorHeatMap(const Mat_<Point2f>& flow, const Mat& mask)
+{
+	Mat flow_magnitudes(flow.size(), CV_32FC1);
+	Mat mask_copy;
+	mask.copyTo(mask_copy);
+
+	for (int i = 0; i < flow.rows; i++) {
+		for (int j = 0; j < flow.cols; j++) {
+
+			if (mask_copy.at<char>(i, j) != 0) {
+				float flow_mag = sqrt(flow(i, j).x*flow(i, j).x + flow(i, j).y*flow(i, j).y);
+
+				// Set max error to adjust the colour mapping
+				if (flow_mag > 3) {
+					flow_magnitudes.at<float>(i, j) = 3; // Adjust this range depending on the error range you want to see.
+				}
+				else {
+					flow_magnitudes.at<float>(i, j) = flow_mag;
+				}
+			}
+			else {
+				flow_magnitudes.at<float>(i, j) = std::numeric_limits<float>::quiet_NaN();
+			}
+		}
+	}
+
+	// Convert to 8 bit
+	flow_magnitudes.convertTo(flow_magnitudes, CV_8U);
+
+	Mat norm;
+	// Normailse to get contrast
+	normalize(flow_magnitudes, norm, 255, 0, NORM_INF);
+	applyColorMap(norm, norm, COLORMAP_JET);
+	bitwise_not(mask_copy, mask_copy);
+	norm.setTo(Scalar(0, 0, 0), mask_copy);
+	return norm;
+}
+
+Mat sparseFlowImage(Size size, const std::vector<Point2f>& points1, const std::vector<Point2f>& points2)
+{
+	Mat sparse(size, CV_8UC3, Scalar::all(255));
+	if (points1.empty()) {
+		cv::line(sparse, Point2f(0, 0), Point2f((float)size.width, (float)size.height), cv::Scalar(0, 0, 0), 2, 8);
+		cv::line(sparse, Point2f((float)size.width, 0), Point2f(0, (float)size.height), cv::Scalar(0, 0, 0), 2, 8);
+		return sparse;
+	}
+	for (size_t i = 0; i < points1.size() && i < points2.size(); i += 4)
+		cv::arrowedLine(sparse, points1[i], points2[i], cv::Scalar(0, 0, 0), 2, 8, 0, 0.2);
+	return sparse;
+}
+
+// Frames are shown in colour whatever the method's input format
+static Mat asBGR(const Mat& image)
+{
+	Mat bgr;
+	if (image.channels() == 1)
+		cvtColor(image, bgr, COLOR_GRAY2BGR);
+	else
+		bgr = image;
+	if (bgr.depth() != CV_8U)
+		bgr.convertTo(bgr, CV_8U);
+	return bgr;
+}
+
+Mat resultsWindow(const Mat& i1, const Mat& i2, const Mat& flow, const Mat& ground_truth, const Mat& mask,
+	const std::vector<Point2f>& points1, const std::vector<Point2f>& points2)
+{
+	int w = i1.cols, h = i1.rows;
+	Mat win_mat = Mat::zeros(Size(w * 2, h * 3), CV_8UC3);
+
+	asBGR(i1).copyTo(win_mat(cv::Rect(0, 0, w, h)));
+	asBGR(i2).copyTo(win_mat(cv::Rect(w, 0, w, h)));
+	sparseFlowImage(i1.size(), points1, points2).copyTo(win_mat(cv::Rect(0, h, w, h)));
+	flowToDisplay(flow).copyTo(win_mat(cv::Rect(w, h, w, h)));
+
+	if (!ground_truth.empty()) {
+		Mat difference = ground_truth - flow;
+		flowToDisplay(ground_truth).copyTo(win_mat(cv::Rect(0, h * 2, w, h)));
+		errorHeatMap(difference, mask).copyTo(win_mat(cv::Rect(w, h * 2, w, h)));
+	}
+	return win_mat;
+}
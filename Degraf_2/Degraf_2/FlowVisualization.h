@@ -0,0 +1,57 @@
+/*!
+\file FlowVisualization.h
+\brief Colour coding of flow fields, error heat maps and the evaluation results window
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+
+#include <vector>
+
+using namespace cv;
+
+// Colour codes a flow field, hue is the direction and saturation the magnitude (saturating at 4 px).
+// Pixels without flow (NaN, as in KITTI ground truth) are shown as zero flow; the input is not modified.
+/*!
+\param flow CV_32FC2 flow
+\return CV_8UC3 BGR image
+*/
+Mat flowToDisplay(const Mat& flow);
+
+// Colour codes a flow field with the magnitude normalised to the largest vector in the image
+Mat flowToDisplayNormalised(const Mat& flow);
+
+// Converts an error flow map into a linear heatmap blue -> red
+// N.B set range of colour map in the function where specified
+/*!
+\param flow 2 channel mat of End Point Error vectors
+\param mask Mask specifiying the pixels at which flow was recovered
+\return error heat map from blue (low error) to red (high error)
+*/
+Mat errorHeatMap(const Mat_<Point2f>& flow, const Mat& mask);
+
+// White image with every fourth match drawn as an arrow, or a crossed out placeholder without matches
+/*!
+\param size image size
+\param points1 match positions in the first image
+\param points2 corresponding positions in the second image
+\return CV_8UC3 BGR image
+*/
+Mat sparseFlowImage(Size size, const std::vector<Point2f>& points1, const std::vector<Point2f>& points2);
+
+// Composes all useful outputs of one pair in a 2x3 grid: both frames, the sparse matches and the flow,
+// the ground truth and the error heat map (left black without ground truth)
+/*!
+\param i1 first image, grey or BGR
+\param i2 second image
+\param flow computed flow
+\param ground_truth ground truth flow, may be empty
+\param mask pixels with valid ground truth in the evaluated region
+\param points1 sparse matches of DeGraF-Flow, empty for dense methods
+\param points2 corresponding positions in the second image
+\return CV_8UC3 image of twice the width and three times the height of i1
+*/
+Mat resultsWindow(const Mat& i1, const Mat& i2, const Mat& flow, const Mat& ground_truth, const Mat& mask,
+	const std::vector<Point2f>& points1, const std::vector<Point2f>& points2);
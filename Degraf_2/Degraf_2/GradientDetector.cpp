@@ -9,6 +9,7 @@
 #include "stdafx.h"
 // Include Files
 #include "GradientDetector.h"
+#include "MemoryAccounting.h"
 
 // new for gettickcount()
 #include <windows.h>
@@ -91,8 +92,8 @@ void GradientDetector::Create(IplImage* p_image, int p_window_width, int p_windo
                 gradient_matrix[i][j].weight = 0.0;
             }
         }
-        image_8u = cvCreateImage(image_size, IPL_DEPTH_8U, 1);
-        image_f32 = cvCreateImage(image_size, IPL_DEPTH_32F, 1);
+        image_8u = CreateTrackedImage(image_size, IPL_DEPTH_8U, 1);
+        image_f32 = CreateTrackedImage(image_size, IPL_DEPTH_32F, 1);
 
         // Clear keypoint buffer
         keypoints.clear();
@@ -121,8 +122,8 @@ void GradientDetector::Release(void)
         free(gradient_matrix);
 
         // Release images
-        cvReleaseImage(&image_8u);
-        cvReleaseImage(&image_f32);
+        ReleaseTrackedImage(&image_8u);
+        ReleaseTrackedImage(&image_f32);
 
         // Reset initialisation flag
         init_flag = false;
@@ -274,7 +275,8 @@ int GradientDetector::DetectGradients(IplImage* p_image_src, int p_window_width,
 			// For DeGraF-Flow do not down select points, leaves a uniform grid of points which is good for interpolation  
 			//if (gradient_matrix[y][x].pos_neg_ratio > 0.30)
 			//{ 
-				keypoints.push_back(cv::KeyPoint(cvPoint2D32f(gradient_matrix[y][x].centroid.x + dx, gradient_matrix[y][x].centroid.y + dy), (float)min(window_size.width, window_size.height)));
+				keypoints.push_back(cv::KeyPoint(cvPoint2D32f(gradient_matrix[y][x].centroid.x + dx, gradient_matrix[y][x].centroid.y + dy), (float)min(window_size.width, window_size.height), -1,
+					(float)(gradient_matrix[y][x].magnitude * gradient_matrix[y][x].pos_neg_ratio)));	// response ranks the points for PROSAC
 			//}
 			
             /*gradient_matrix[y][x].active = false;
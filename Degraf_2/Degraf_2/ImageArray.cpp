@@ -9,6 +9,7 @@
 // Include Files
 #include "stdafx.h"
 #include "ImageArray.h"
+#include "MemoryAccounting.h"
 
 //! Class constructor
 ImageArray::ImageArray()
@@ -19,6 +20,7 @@ ImageArray::ImageArray()
 //! Class destructor
 ImageArray::~ImageArray()
 {
+    ReleaseArray();
 }
 
 //! Creates an image array
@@ -44,7 +46,7 @@ void ImageArray::InitArray(IplImage* p_image, uint p_length)
     // Derive any subsequent pyramid level by resolution reduction
     for (i = 0; i < array_length; i++)
     {
-        image[i] = cvCreateImage(image_size, p_image->depth, p_image->nChannels); // Allocate memory for each image
+        image[i] = CreateTrackedImage(image_size, p_image->depth, p_image->nChannels); // Allocate memory for each image
         cvSetZero(image[i]);
     }
 
@@ -61,9 +63,10 @@ void ImageArray::ReleaseArray(void)
     {
         for (i = 0; i < array_length; i++)
         {
-            cvReleaseImage(&image[i]);
+            ReleaseTrackedImage(&image[i]);
         }
         free(image);
+        init_flag = false;
     }
 }
 
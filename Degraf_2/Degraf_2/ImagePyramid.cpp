@@ -9,6 +9,7 @@
 // Include Files
 #include "stdafx.h"
 #include "ImagePyramid.h"
+#include "MemoryAccounting.h"
 
 using namespace std;
 
@@ -52,7 +53,7 @@ void ImagePyramid::Create(IplImage* p_image, uint p_pyr_levels)
     //Initialise variables
     image_size = cvGetSize(p_image);
     level_size[0] = cvGetSize(p_image);
-    level_image[0] = cvCreateImage(level_size[0], p_image->depth, p_image->nChannels); // Allocate memory for pyramid's base
+    level_image[0] = CreateTrackedImage(level_size[0], p_image->depth, p_image->nChannels); // Allocate memory for pyramid's base
 
     // Copy source image to the bottom of the pyramid
     cvCopy(p_image, level_image[0]);
@@ -67,7 +68,7 @@ void ImagePyramid::Create(IplImage* p_image, uint p_pyr_levels)
         }
         level_size[i].width = level_size[i-1].width/2; // Set image width for the current pyramid level
         level_size[i].height = level_size[i-1].height/2;  // Set image height for the current pyramid level
-        level_image[i] = cvCreateImage(level_size[i], p_image->depth, p_image->nChannels); // Allocate memory for the current pyramid level
+        level_image[i] = CreateTrackedImage(level_size[i], p_image->depth, p_image->nChannels); // Allocate memory for the current pyramid level
         cvPyrDown(level_image[i-1], level_image[i]); // Perform pyramidal resolution reduction
     }
 
@@ -144,7 +145,7 @@ void ImagePyramid::Release(void)
 
         for (i = 0; i < pyramid_height; i++)
         {
-            cvReleaseImage(&level_image[i]);
+            ReleaseTrackedImage(&level_image[i]);
         }
         free(level_scale);
         free(level_size);
@@ -0,0 +1,139 @@
+/*!
+\file KittiFlowIO.cpp
+\brief Vectorised conversion between KITTI 16 bit flow images and CV_32FC2 flow
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "KittiFlowIO.h"
+
+#include "opencv2/core/hal/intrin.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include <limits>
+
+// Both directions are elementwise, so rows are split into stripes for parallel_for_ and each row is
+// converted eight pixels at a time with the universal intrinsics. Validity is applied with selects
+// rather than branches. The scalar code handles row tails and builds without SIMD.
+
+static void decodeRow(const ushort* src, float* dst, int cols)
+{
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	int j = 0;
+#if CV_SIMD128
+	v_float32x4 v_scale = v_setall_f32(1.0f / 64.0f), v_offset = v_setall_f32(-512.0f), v_nan = v_setall_f32(nan);
+	v_uint32x4 v_zero = v_setzero_u32();
+	for (; j <= cols - 8; j += 8) {
+		v_uint16x8 valid, v, u;
+		v_load_deinterleave(src + 3 * j, valid, v, u);
+
+		v_uint32x4 valid0, valid1, v0, v1, u0, u1;
+		v_expand(valid, valid0, valid1);
+		v_expand(v, v0, v1);
+		v_expand(u, u0, u1);
+
+		// (x - 32768) / 64 == x / 64 - 512, exact in float for 16 bit x
+		v_float32x4 fu0 = v_cvt_f32(v_reinterpret_as_s32(u0)) * v_scale + v_offset;
+		v_float32x4 fu1 = v_cvt_f32(v_reinterpret_as_s32(u1)) * v_scale + v_offset;
+		v_float32x4 fv0 = v_cvt_f32(v_reinterpret_as_s32(v0)) * v_scale + v_offset;
+		v_float32x4 fv1 = v_cvt_f32(v_reinterpret_as_s32(v1)) * v_scale + v_offset;
+
+		v_float32x4 ok0 = v_reinterpret_as_f32(valid0 != v_zero), ok1 = v_reinterpret_as_f32(valid1 != v_zero);
+		fu0 = v_select(ok0, fu0, v_nan); fv0 = v_select(ok0, fv0, v_nan);
+		fu1 = v_select(ok1, fu1, v_nan); fv1 = v_select(ok1, fv1, v_nan);
+
+		// Interleave to u0 v0 u1 v1 ...
+		v_float32x4 a, b;
+		v_zip(fu0, fv0, a, b);
+		v_store(dst + 2 * j, a);
+		v_store(dst + 2 * j + 4, b);
+		v_zip(fu1, fv1, a, b);
+		v_store(dst + 2 * j + 8, a);
+		v_store(dst + 2 * j + 12, b);
+	}
+#endif
+	for (; j < cols; j++) {
+		const ushort* p = src + 3 * j;
+		float valid = p[0] != 0 ? 0.0f : nan;	// adding NaN poisons invalid pixels
+		dst[2 * j] = (float)p[2] * (1.0f / 64.0f) - 512.0f + valid;
+		dst[2 * j + 1] = (float)p[1] * (1.0f / 64.0f) - 512.0f + valid;
+	}
+}
+
+static inline ushort encodeComponent(float x)
+{
+	return (ushort)(std::max)((std::min)(x * 64.0f + 32768.0f, 65535.0f), 0.0f);
+}
+
+static void encodeRow(const float* src, ushort* dst, int cols)
+{
+	int j = 0;
+#if CV_SIMD128
+	v_float32x4 v_scale = v_setall_f32(64.0f), v_offset = v_setall_f32(32768.0f);
+	v_float32x4 v_lo = v_setzero_f32(), v_hi = v_setall_f32(65535.0f), v_one = v_setall_f32(1.0f), v_limit = v_setall_f32(1e9f);
+	for (; j <= cols - 8; j += 8) {
+		v_float32x4 fu[2], fv[2], ok[2];
+		for (int h = 0; h < 2; h++) {
+			// Deinterleave u0 v0 u1 v1 | u2 v2 u3 v3 with two zips
+			v_float32x4 a0 = v_load(src + 2 * j + 8 * h), a1 = v_load(src + 2 * j + 8 * h + 4), t0, t1;
+			v_zip(a0, a1, t0, t1);
+			v_zip(t0, t1, fu[h], fv[h]);
+			v_float32x4 valid = (fu[h] == fu[h]) & (fv[h] == fv[h]) & (v_abs(fu[h]) < v_limit) & (v_abs(fv[h]) < v_limit);
+			ok[h] = v_select(valid, v_one, v_lo);
+			// Invalid pixels are written as zero flow, matching the KITTI devkit
+			fu[h] = v_select(valid, v_min(v_max(fu[h] * v_scale + v_offset, v_lo), v_hi), v_offset);
+			fv[h] = v_select(valid, v_min(v_max(fv[h] * v_scale + v_offset, v_lo), v_hi), v_offset);
+		}
+		// Truncation as in the devkit's (uint16_t) cast, values are already clamped to [0, 65535]
+		v_uint16x8 u = v_pack_u(v_trunc(fu[0]), v_trunc(fu[1]));
+		v_uint16x8 v = v_pack_u(v_trunc(fv[0]), v_trunc(fv[1]));
+		v_uint16x8 valid = v_pack_u(v_trunc(ok[0]), v_trunc(ok[1]));
+		v_store_interleave(dst + 3 * j, valid, v, u);
+	}
+#endif
+	for (; j < cols; j++) {
+		float u = src[2 * j], v = src[2 * j + 1];
+		bool valid = u == u && v == v && fabs(u) < 1e9f && fabs(v) < 1e9f;
+		dst[3 * j] = valid ? 1 : 0;
+		dst[3 * j + 1] = valid ? encodeComponent(v) : 32768;
+		dst[3 * j + 2] = valid ? encodeComponent(u) : 32768;
+	}
+}
+
+void decodeKittiFlow(const Mat& kitti, Mat& flow)
+{
+	CV_Assert(kitti.type() == CV_16UC3);
+	flow.create(kitti.size(), CV_32FC2);
+	parallel_for_(Range(0, kitti.rows), [&](const Range& range) {
+		for (int i = range.start; i < range.end; i++)
+			decodeRow(kitti.ptr<ushort>(i), flow.ptr<float>(i), kitti.cols);
+	});
+}
+
+void encodeKittiFlow(const Mat& flow, Mat& kitti)
+{
+	CV_Assert(flow.type() == CV_32FC2);
+	kitti.create(flow.size(), CV_16UC3);
+	parallel_for_(Range(0, flow.rows), [&](const Range& range) {
+		for (int i = range.start; i < range.end; i++)
+			encodeRow(flow.ptr<float>(i), kitti.ptr<ushort>(i), flow.cols);
+	});
+}
+
+bool readKittiFlow(const std::string& path, Mat& flow)
+{
+	Mat kitti = imread(path, IMREAD_ANYDEPTH | IMREAD_ANYCOLOR);
+	if (kitti.empty() || kitti.type() != CV_16UC3) {
+		printf("Not a KITTI flow image: %s\n", path.c_str());
+		return false;
+	}
+	decodeKittiFlow(kitti, flow);
+	return true;
+}
+
+bool writeKittiFlow(const std::string& path, const Mat& flow)
+{
+	Mat kitti;
+	encodeKittiFlow(flow, kitti);
+	return imwrite(path, kitti);
+}
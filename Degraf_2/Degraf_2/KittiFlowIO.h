@@ -0,0 +1,34 @@
+/*!
+\file KittiFlowIO.h
+\brief Vectorised conversion between KITTI 16 bit flow images and CV_32FC2 flow
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+
+#include <string>
+
+using namespace cv;
+
+// KITTI stores flow as a 3 channel 16 bit png, read by OpenCV as (valid, v, u) in BGR order with
+// u, v = (value - 32768) / 64 and valid != 0 where ground truth is known.
+
+// Decodes a KITTI flow image, pixels without valid flow become NaN
+/*!
+\param kitti CV_16UC3 image as read by imread(path, IMREAD_ANYDEPTH | IMREAD_ANYCOLOR)
+\param flow output CV_32FC2 (u, v)
+*/
+void decodeKittiFlow(const Mat& kitti, Mat& flow);
+
+// Encodes flow in the KITTI format, non-finite flow is written as invalid
+/*!
+\param flow CV_32FC2 (u, v)
+\param kitti output CV_16UC3 ready for imwrite as png
+*/
+void encodeKittiFlow(const Mat& flow, Mat& kitti);
+
+// File versions, return false if the file cannot be read or written
+bool readKittiFlow(const std::string& path, Mat& flow);
+bool writeKittiFlow(const std::string& path, const Mat& flow);
@@ -0,0 +1,178 @@
+/*!
+\file LazyFlowInterpolator.cpp
+\brief Edge-aware interpolation of sparse matches evaluated only at requested pixel positions
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "LazyFlowInterpolator.h"
+
+#include <queue>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Constructor, defaults follow the parameters used for DeGraF-Flow in EvaluateOptFlow
+LazyFlowInterpolator::LazyFlowInterpolator() {
+	k = 128;
+	sigma = 0.05f;
+	lambda = 1.0f;
+	max_visited = 250000;
+}
+
+// Sets the guide image and the sparse matches used by subsequent queries
+/*!
+\param image first image of the pair (8 bit, 1 or 3 channels), must outlive the queries
+\param from_points match positions in the first image
+\param to_points corresponding positions in the second image
+*/
+void LazyFlowInterpolator::setMatches(InputArray _image, const vector<Point2f>& from_points, const vector<Point2f>& to_points)
+{
+	CV_Assert(!_image.empty() && _image.depth() == CV_8U);
+	CV_Assert(from_points.size() == to_points.size());
+
+	image = _image.getMat();
+	match_pos = from_points;
+	match_flow.resize(from_points.size());
+	seed_index.clear();
+	seed_index.reserve(from_points.size());
+
+	for (size_t i = 0; i < from_points.size(); i++) {
+		match_flow[i] = to_points[i] - from_points[i];
+		int x = (std::min)((std::max)(cvRound(from_points[i].x), 0), image.cols - 1);
+		int y = (std::min)((std::max)(cvRound(from_points[i].y), 0), image.rows - 1);
+		seed_index.push_back(make_pair(y * image.cols + x, (int)i));
+	}
+	sort(seed_index.begin(), seed_index.end());
+}
+
+// Per-pixel edge cost, same normalised Sobel magnitude the EdgeAwareInterpolator uses, evaluated on demand
+float LazyFlowInterpolator::edgeCost(int x, int y) const
+{
+	int x0 = (std::max)(x - 1, 0), x1 = (std::min)(x + 1, image.cols - 1);
+	int y0 = (std::max)(y - 1, 0), y1 = (std::min)(y + 1, image.rows - 1);
+	int cn = image.channels();
+	const uchar* r0 = image.ptr<uchar>(y0);
+	const uchar* r1 = image.ptr<uchar>(y);
+	const uchar* r2 = image.ptr<uchar>(y1);
+
+	float sum = 0.0f;
+	for (int c = 0; c < cn; c++) {
+		int dx = (r0[x1*cn + c] + 2 * r1[x1*cn + c] + r2[x1*cn + c]) - (r0[x0*cn + c] + 2 * r1[x0*cn + c] + r2[x0*cn + c]);
+		int dy = (r2[x0*cn + c] + 2 * r2[x*cn + c] + r2[x1*cn + c]) - (r0[x0*cn + c] + 2 * r0[x*cn + c] + r0[x1*cn + c]);
+		sum += (float)(abs(dx) + abs(dy));
+	}
+	return sum / (cn * 4.0f * 255.0f);
+}
+
+// Edge-aware flow at a single query position
+/*!
+\param q query position in the first image
+\return interpolated flow vector, NaN if no match could be reached
+*/
+Point2f LazyFlowInterpolator::queryOne(Point2f q) const
+{
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	if (match_pos.empty())
+		return Point2f(nan, nan);
+
+	int qx = (std::min)((std::max)(cvRound(q.x), 0), image.cols - 1);
+	int qy = (std::min)((std::max)(cvRound(q.y), 0), image.rows - 1);
+	int cols = image.cols;
+
+	// Dijkstra from the query pixel until k matches have been settled
+	typedef pair<float, int> Node;
+	priority_queue<Node, vector<Node>, greater<Node> > heap;
+	unordered_map<int, float> dist;
+	dist.reserve(4 * k * 16);
+
+	vector<pair<float, int> > support; // (geodesic distance, match index)
+	support.reserve(k);
+
+	int start = qy * cols + qx;
+	dist[start] = 0.0f;
+	heap.push(Node(0.0f, start));
+	int visited = 0;
+	const int dx4[4] = { 1, -1, 0, 0 };
+	const int dy4[4] = { 0, 0, 1, -1 };
+
+	while (!heap.empty() && (int)support.size() < k && visited < max_visited) {
+		Node n = heap.top();
+		heap.pop();
+		if (n.first > dist[n.second])
+			continue; // stale entry
+		visited++;
+
+		// Collect any matches anchored at this pixel
+		vector<pair<int, int> >::const_iterator it = lower_bound(seed_index.begin(), seed_index.end(), make_pair(n.second, -1));
+		for (; it != seed_index.end() && it->first == n.second && (int)support.size() < k; ++it)
+			support.push_back(make_pair(n.first, it->second));
+
+		int x = n.second % cols, y = n.second / cols;
+		for (int d = 0; d < 4; d++) {
+			int nx = x + dx4[d], ny = y + dy4[d];
+			if (nx < 0 || ny < 0 || nx >= cols || ny >= image.rows)
+				continue;
+			int idx = ny * cols + nx;
+			float nd = n.first + edgeCost(nx, ny) + 1e-4f; // small spatial term keeps flat regions ordered
+			unordered_map<int, float>::iterator found = dist.find(idx);
+			if (found == dist.end() || nd < found->second) {
+				dist[idx] = nd;
+				heap.push(Node(nd, idx));
+			}
+		}
+	}
+
+	if (support.empty())
+		return Point2f(nan, nan);
+
+	// Locally-weighted affine fit centred on the query, the constant term is the flow at q
+	float d_min = support[0].first;
+	Matx33d A = Matx33d::zeros();
+	Vec3d bu(0, 0, 0), bv(0, 0, 0);
+	double W = 0.0;
+	Point2d mean_flow(0, 0);
+	for (size_t i = 0; i < support.size(); i++) {
+		double w = exp(-(support[i].first - d_min) / sigma);
+		const Point2f& p = match_pos[support[i].second];
+		const Point2f& f = match_flow[support[i].second];
+		Vec3d a(p.x - q.x, p.y - q.y, 1.0);
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++)
+				A(r, c) += w * a[r] * a[c];
+			bu[r] += w * a[r] * f.x;
+			bv[r] += w * a[r] * f.y;
+		}
+		mean_flow += w * Point2d(f.x, f.y);
+		W += w;
+	}
+	mean_flow *= 1.0 / W;
+
+	if (support.size() < 3)
+		return Point2f((float)mean_flow.x, (float)mean_flow.y);
+
+	A(0, 0) += lambda * W;
+	A(1, 1) += lambda * W;
+	if (fabs(determinant(A)) < 1e-12 * W * W * W)
+		return Point2f((float)mean_flow.x, (float)mean_flow.y);
+
+	Vec3d coef_u = A.solve(bu, DECOMP_CHOLESKY);
+	Vec3d coef_v = A.solve(bv, DECOMP_CHOLESKY);
+	return Point2f((float)coef_u[2], (float)coef_v[2]);
+}
+
+// Edge-aware flow at a list of query positions, queries are processed in parallel
+/*!
+\param query_points pixel positions in the first image
+\param query_flow output flow vectors, one per query (NaN when no match is reachable)
+*/
+void LazyFlowInterpolator::query(const vector<Point2f>& query_points, vector<Point2f>& query_flow) const
+{
+	query_flow.resize(query_points.size());
+	parallel_for_(Range(0, (int)query_points.size()), [&](const Range& range) {
+		for (int i = range.start; i < range.end; i++)
+			query_flow[i] = queryOne(query_points[i]);
+	});
+}
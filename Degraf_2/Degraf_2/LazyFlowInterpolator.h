@@ -0,0 +1,44 @@
+/*!
+\file LazyFlowInterpolator.h
+\brief Edge-aware interpolation of sparse matches evaluated only at requested pixel positions
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include <vector>
+#include <utility>
+
+using namespace cv;
+using namespace std;
+
+// Interpolates sparse matches into flow at an arbitrary list of query pixels.
+// Mirrors the EdgeAwareInterpolator (EPIC) model: the k geodesically nearest matches of each query are
+// found on an edge cost map and fitted with a locally-weighted affine model. Instead of a geodesic
+// distance transform over the whole image, a bounded Dijkstra search is grown from each query until
+// k matches have been reached, so cost scales with the number of queries rather than image size.
+class LazyFlowInterpolator {
+
+	public:
+		int k;				// number of support matches per query
+		float sigma;		// weights decay as exp(-geodesic_distance / sigma)
+		float lambda;		// ridge regularisation of the affine terms (relative to total weight)
+		int max_visited;	// upper bound on pixels expanded per query
+
+		LazyFlowInterpolator();
+
+		void setMatches(InputArray image, const vector<Point2f>& from_points, const vector<Point2f>& to_points);
+		void query(const vector<Point2f>& query_points, vector<Point2f>& query_flow) const;
+		Point2f queryOne(Point2f q) const;
+
+	private:
+		Mat image;								// guide image (header only, no copy)
+		vector<Point2f> match_pos;				// match positions in the first image
+		vector<Point2f> match_flow;				// match displacement vectors
+		vector<pair<int, int> > seed_index;		// (pixel index, match index) sorted by pixel index
+
+		float edgeCost(int x, int y) const;
+};
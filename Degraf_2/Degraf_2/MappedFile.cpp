@@ -0,0 +1,102 @@
+/*!
+\file MappedFile.cpp
+\brief Read-only (copy-on-write) memory mapping of a whole file
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	data_ptr = NULL;
+	file_size = 0;
+#ifdef _WIN32
+	file_handle = NULL;
+	mapping_handle = NULL;
+#else
+	fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (view == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	mapping_handle = mapping;
+	file_size = (size_t)size.QuadPart;
+	data_ptr = (unsigned char*)view;
+#else
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	void* view = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	file_size = (size_t)st.st_size;
+	data_ptr = (unsigned char*)view;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data_ptr == NULL)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data_ptr);
+	CloseHandle((HANDLE)mapping_handle);
+	CloseHandle((HANDLE)file_handle);
+	file_handle = NULL;
+	mapping_handle = NULL;
+#else
+	munmap(data_ptr, file_size);
+	::close(fd);
+	fd = -1;
+#endif
+	data_ptr = NULL;
+	file_size = 0;
+}
@@ -0,0 +1,38 @@
+/*!
+\file MappedFile.h
+\brief Read-only (copy-on-write) memory mapping of a whole file
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include <string>
+
+// Maps a file into memory. Pages are private copy-on-write, so data may be modified in place
+// (e.g. NaN ground truth zeroed for display) without touching the file or other processes.
+class MappedFile {
+
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool open(const std::string& path);
+		void close();
+
+		bool isOpen() const { return data_ptr != NULL; }
+		unsigned char* data() const { return data_ptr; }
+		size_t size() const { return file_size; }
+
+	private:
+		unsigned char* data_ptr;
+		size_t file_size;
+#ifdef _WIN32
+		void* file_handle;
+		void* mapping_handle;
+#else
+		int fd;
+#endif
+
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+};
@@ -0,0 +1,333 @@
+/*!
+\file MemoryAccounting.cpp
+\brief Per-stage allocation counters and byte high-water marks for IplImage, cv::Mat and C++ heap allocations
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "MemoryAccounting.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+using namespace cv;
+
+// Stage of the calling thread, plain int so it is usable from operator new before any static construction
+static thread_local int current_stage = MemoryAccounting::OTHER_STAGE;
+
+// Set while an accounting call is in progress on this thread, so allocations made by the accounting
+// itself (e.g. by the singleton's first construction) are not counted recursively
+static thread_local bool in_accounting = false;
+
+static const char* kind_names[ALLOC_KIND_COUNT] = { "ipl", "mat", "heap" };
+
+MemoryAccounting::MemoryAccounting()
+{
+	for (int s = 0; s <= STAGE_COUNT; s++) {
+		for (int k = 0; k < ALLOC_KIND_COUNT; k++) {
+			allocations[s][k] = 0;
+			bytes[s][k] = 0;
+		}
+		high_water[s] = 0;
+	}
+	for (int k = 0; k < ALLOC_KIND_COUNT; k++)
+		live[k] = 0;
+	peak = 0;
+}
+
+MemoryAccounting& MemoryAccounting::instance()
+{
+	static MemoryAccounting accounting;
+	return accounting;
+}
+
+int MemoryAccounting::enterStage(int stage)
+{
+	int previous = current_stage;
+	current_stage = stage;
+	return previous;
+}
+
+void MemoryAccounting::leaveStage(int previous_stage)
+{
+	current_stage = previous_stage;
+}
+
+static void updateMax(std::atomic<unsigned long long>& target, unsigned long long value)
+{
+	unsigned long long seen = target.load(std::memory_order_relaxed);
+	while (value > seen && !target.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+		;
+}
+
+void MemoryAccounting::onAllocate(int kind, size_t n)
+{
+	int s = current_stage;
+	allocations[s][kind].fetch_add(1, std::memory_order_relaxed);
+	bytes[s][kind].fetch_add(n, std::memory_order_relaxed);
+	unsigned long long now = live[kind].fetch_add(n, std::memory_order_relaxed) + n;
+	for (int k = 0; k < ALLOC_KIND_COUNT; k++)
+		if (k != kind)
+			now += live[k].load(std::memory_order_relaxed);
+	updateMax(high_water[s], now);
+	updateMax(peak, now);
+}
+
+// Frees are not attributed to a stage, buffers are routinely released by a later stage than the one that made them
+void MemoryAccounting::onFree(int kind, size_t n)
+{
+	live[kind].fetch_sub(n, std::memory_order_relaxed);
+}
+
+StageMemory MemoryAccounting::stage(int s) const
+{
+	StageMemory m;
+	for (int k = 0; k < ALLOC_KIND_COUNT; k++) {
+		m.allocations[k] = allocations[s][k].load(std::memory_order_relaxed);
+		m.bytes[k] = bytes[s][k].load(std::memory_order_relaxed);
+	}
+	m.high_water = high_water[s].load(std::memory_order_relaxed);
+	return m;
+}
+
+unsigned long long MemoryAccounting::liveBytes(int kind) const
+{
+	return live[kind].load(std::memory_order_relaxed);
+}
+
+unsigned long long MemoryAccounting::peakBytes() const
+{
+	return peak.load(std::memory_order_relaxed);
+}
+
+// Clears the per-stage counters and restarts the high-water marks from the current live size.
+// Live byte counts are kept since the buffers they describe are still allocated.
+void MemoryAccounting::reset()
+{
+	unsigned long long now = 0;
+	for (int k = 0; k < ALLOC_KIND_COUNT; k++)
+		now += live[k].load(std::memory_order_relaxed);
+	for (int s = 0; s <= STAGE_COUNT; s++) {
+		for (int k = 0; k < ALLOC_KIND_COUNT; k++) {
+			allocations[s][k] = 0;
+			bytes[s][k] = 0;
+		}
+		high_water[s] = 0;
+	}
+	peak = now;
+}
+
+static const char* memoryStageName(int stage)
+{
+	return stage == MemoryAccounting::OTHER_STAGE ? "other" : StageProfiler::stageName(stage);
+}
+
+void MemoryAccounting::printReport() const
+{
+	printf("%-14s %10s %12s %10s %12s %10s %12s %12s\n", "stage", "ipl", "ipl MB", "mat", "mat MB", "heap", "heap MB", "high MB");
+	for (int s = 0; s <= STAGE_COUNT; s++) {
+		StageMemory m = stage(s);
+		printf("%-14s %10llu %12.2f %10llu %12.2f %10llu %12.2f %12.2f\n", memoryStageName(s),
+			m.allocations[ALLOC_IPL], m.bytes[ALLOC_IPL] / 1048576.0,
+			m.allocations[ALLOC_MAT], m.bytes[ALLOC_MAT] / 1048576.0,
+			m.allocations[ALLOC_HEAP], m.bytes[ALLOC_HEAP] / 1048576.0,
+			m.high_water / 1048576.0);
+	}
+	printf("live: ipl %.2f MB, mat %.2f MB, heap %.2f MB, peak %.2f MB\n", liveBytes(ALLOC_IPL) / 1048576.0,
+		liveBytes(ALLOC_MAT) / 1048576.0, liveBytes(ALLOC_HEAP) / 1048576.0, peakBytes() / 1048576.0);
+}
+
+bool MemoryAccounting::writeCSV(const std::string& path) const
+{
+	std::ofstream out(path.c_str());
+	if (!out.is_open())
+		return false;
+	out << "stage";
+	for (int k = 0; k < ALLOC_KIND_COUNT; k++)
+		out << "," << kind_names[k] << "_allocations," << kind_names[k] << "_bytes";
+	out << ",high_water_bytes\n";
+	for (int s = 0; s <= STAGE_COUNT; s++) {
+		StageMemory m = stage(s);
+		out << memoryStageName(s);
+		for (int k = 0; k < ALLOC_KIND_COUNT; k++)
+			out << "," << m.allocations[k] << "," << m.bytes[k];
+		out << "," << m.high_water << "\n";
+	}
+	return true;
+}
+
+size_t MemoryAccounting::residentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return pmc.WorkingSetSize;
+	return 0;
+#else
+	long pages = 0, resident = 0;
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f == NULL)
+		return 0;
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// cv::Mat allocator that forwards to OpenCV's standard allocator and counts the buffers. The UMatData
+// is re-owned by this allocator so that its release comes back through deallocate().
+class AccountingMatAllocator : public MatAllocator {
+
+	public:
+		UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, UMatUsageFlags usageFlags) const
+		{
+			UMatData* u = Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+			if (u != NULL) {
+				u->prevAllocator = u->currAllocator = this;
+				if (!(u->flags & UMatData::USER_ALLOCATED))
+					MemoryAccounting::instance().onAllocate(ALLOC_MAT, u->size);
+			}
+			return u;
+		}
+
+		bool allocate(UMatData* u, int accessFlags, UMatUsageFlags usageFlags) const
+		{
+			return Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+		}
+
+		void deallocate(UMatData* u) const
+		{
+			if (u == NULL)
+				return;
+			if (!(u->flags & UMatData::USER_ALLOCATED))
+				MemoryAccounting::instance().onFree(ALLOC_MAT, u->size);
+			Mat::getStdAllocator()->deallocate(u);
+		}
+};
+
+void MemoryAccounting::install()
+{
+	static AccountingMatAllocator allocator;
+	Mat::setDefaultAllocator(&allocator);
+}
+
+IplImage* CreateTrackedImage(CvSize p_size, int p_depth, int p_channels)
+{
+	IplImage* image = cvCreateImage(p_size, p_depth, p_channels);
+	if (image != NULL)
+		MemoryAccounting::instance().onAllocate(ALLOC_IPL, image->imageSize);
+	return image;
+}
+
+void ReleaseTrackedImage(IplImage** p_image)
+{
+	if (p_image == NULL || *p_image == NULL)
+		return;
+	MemoryAccounting::instance().onFree(ALLOC_IPL, (*p_image)->imageSize);
+	cvReleaseImage(p_image);
+}
+
+#if DEGRAF_MEMORY_ACCOUNTING
+
+// Global operator new/delete replacement (std::vector, new'd detectors, ...). Each block carries a header
+// with its size so frees can be subtracted. The replacement covers every operator new that resolves to
+// this one: the whole process when OpenCV and RLOF are linked statically or as shared objects on Linux,
+// only this module where they are DLLs with their own CRT on Windows, in which case their buffers are
+// seen through the Mat allocator alone.
+static const size_t HEADER_SIZE = 16;
+
+static void* trackedMalloc(size_t n)
+{
+	char* p = (char*)malloc(n + HEADER_SIZE);
+	if (p == NULL)
+		return NULL;
+	*(size_t*)p = n;
+	if (!in_accounting) {
+		in_accounting = true;
+		MemoryAccounting::instance().onAllocate(ALLOC_HEAP, n);
+		in_accounting = false;
+	}
+	return p + HEADER_SIZE;
+}
+
+static void trackedFree(void* ptr)
+{
+	if (ptr == NULL)
+		return;
+	char* p = (char*)ptr - HEADER_SIZE;
+	if (!in_accounting) {
+		in_accounting = true;
+		MemoryAccounting::instance().onFree(ALLOC_HEAP, *(size_t*)p);
+		in_accounting = false;
+	}
+	free(p);
+}
+
+void* operator new(size_t n)
+{
+	void* p = trackedMalloc(n);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t n)
+{
+	void* p = trackedMalloc(n);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t n, const std::nothrow_t&) noexcept
+{
+	return trackedMalloc(n);
+}
+
+void* operator new[](size_t n, const std::nothrow_t&) noexcept
+{
+	return trackedMalloc(n);
+}
+
+void operator delete(void* p) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	trackedFree(p);
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*!
+\file MemoryAccounting.h
+\brief Per-stage allocation counters and byte high-water marks for IplImage, cv::Mat and C++ heap allocations
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "StageProfiler.h"
+
+#include <opencv/cv.h>
+#include <atomic>
+#include <string>
+
+// Set to 1 to compile in the global operator new/delete replacement that counts the C++ heap. Off by
+// default: it adds a header to every allocation of the program, profiled or not.
+#ifndef DEGRAF_MEMORY_ACCOUNTING
+#define DEGRAF_MEMORY_ACCOUNTING 0
+#endif
+
+// Allocation kinds that are tracked separately
+enum AllocKind { ALLOC_IPL = 0, ALLOC_MAT = 1, ALLOC_HEAP = 2, ALLOC_KIND_COUNT = 3 };
+
+// Counters of one stage
+struct StageMemory {
+	unsigned long long allocations[ALLOC_KIND_COUNT];	// number of allocations made while the stage was active
+	unsigned long long bytes[ALLOC_KIND_COUNT];			// bytes allocated while the stage was active
+	unsigned long long high_water;						// peak live tracked bytes observed while the stage was active
+};
+
+// Attributes allocations to the pipeline stage that is active on the allocating thread. Stages are the
+// ones of StageProfiler, entered and left by ScopedStageTimer; allocations outside any stage count as "other".
+// cv::Mat is tracked through a MatAllocator installed with install(), IplImages through CreateTrackedImage /
+// ReleaseTrackedImage, and the remaining C++ heap (std::vector etc.) through a global operator new when
+// DEGRAF_MEMORY_ACCOUNTING is set.
+class MemoryAccounting {
+
+	public:
+		static const int OTHER_STAGE = STAGE_COUNT;
+
+		static MemoryAccounting& instance();
+
+		// Installs the cv::Mat allocator, call once before any tracked work. Only --soak and --profile do, so
+		// ordinary runs keep OpenCV's own allocator.
+		void install();
+
+		// Thread-local stage attribution, returns the previous stage so scopes can nest
+		static int enterStage(int stage);
+		static void leaveStage(int previous_stage);
+
+		void onAllocate(int kind, size_t bytes);
+		void onFree(int kind, size_t bytes);
+
+		StageMemory stage(int stage) const;
+		unsigned long long liveBytes(int kind) const;
+		unsigned long long peakBytes() const;
+		void reset();
+		void printReport() const;
+		bool writeCSV(const std::string& path) const;
+
+		// Resident set size of the process in bytes, 0 if unavailable
+		static size_t residentBytes();
+
+	private:
+		std::atomic<unsigned long long> allocations[STAGE_COUNT + 1][ALLOC_KIND_COUNT];
+		std::atomic<unsigned long long> bytes[STAGE_COUNT + 1][ALLOC_KIND_COUNT];
+		std::atomic<unsigned long long> high_water[STAGE_COUNT + 1];
+		std::atomic<unsigned long long> live[ALLOC_KIND_COUNT];
+		std::atomic<unsigned long long> peak;
+
+		MemoryAccounting();
+};
+
+// IplImage allocation with accounting, drop-in replacements for cvCreateImage / cvReleaseImage
+IplImage* CreateTrackedImage(CvSize p_size, int p_depth, int p_channels);
+void ReleaseTrackedImage(IplImage** p_image);
@@ -0,0 +1,240 @@
+/*!
+\file MethodComparison.cpp
+\brief Head-to-head runtime and accuracy of many flow methods on shared decoded inputs, with a Pareto report
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "MethodComparison.h"
+#include "BatchEvaluator.h"
+#include "DatasetCache.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+// Runs one method on a decoded pair: warm-up runs, then repetitions timed individually. The flow of the
+// last repetition is scored against the ground truth.
+static PairResult runMethod(FlowMethod& method, const Mat& i1, const Mat& i2, const Mat& ground_truth, int image_no,
+	const ComparisonOptions& options)
+{
+	Mat flow;
+	for (int w = 0; w < options.warm_up; w++)
+		method.calc(i1, i2, flow);
+
+	std::vector<double> times(options.repetitions);
+	for (int r = 0; r < options.repetitions; r++) {
+		int64 start = getTickCount();
+		method.calc(i1, i2, flow);
+		times[r] = (double)(getTickCount() - start) / getTickFrequency();
+	}
+	std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+
+	PairResult result;
+	result.image_no = image_no;
+	result.seconds = times[times.size() / 2];
+	if (!ground_truth.empty()) {
+		FlowMetrics metrics;
+		computeFlowMetrics(flow, ground_truth, Mat(), metrics);
+		result.has_ground_truth = true;
+		result.error_mean = (float)metrics.epe_mean;
+		result.error_std = (float)metrics.epe_std;
+		for (int t = 0; t < FlowMetrics::R_COUNT; t++)
+			result.R[t] = metrics.R[t];
+		result.fl = metrics.fl;
+	}
+	return result;
+}
+
+int compareMethods(const std::string& manifest, const ComparisonOptions& options, std::vector<MethodSummary>& summaries)
+{
+	std::vector<String> methods = options.methods.empty() ? FlowMethod::allMethods() : options.methods;
+	for (size_t m = 0; m < methods.size(); m++) {
+		if (FlowMethod::create(methods[m]).empty()) {
+			printf("Unknown flow method %s\n", methods[m].c_str());
+			return -1;
+		}
+	}
+
+	std::vector<ManifestEntry> entries;
+	DatasetCache cache;
+	bool cached = isDatasetCache(manifest);
+	if (cached) {
+		if (!cache.open(manifest))
+			return -1;
+	}
+	else if (!readManifest(manifest, entries)) {
+		return -1;
+	}
+	size_t pair_count = cached ? (size_t)cache.size() : entries.size();
+
+	// [pair][method], image_no stays -1 where the pair could not be evaluated
+	std::vector<std::vector<PairResult> > results(pair_count, std::vector<PairResult>(methods.size()));
+
+	ThreadPool pool((std::max)(1, options.workers));
+	int workers = (std::min)(pool.size(), (int)pair_count);
+	SerialOpenCVScope serial_opencv(workers);
+
+	std::atomic<size_t> next(0);
+	std::atomic<int> done(0);
+	for (int w = 0; w < workers; w++) {
+		pool.submit([&, w]() {
+			if (options.pin && !ThreadPool::pinCurrentThread(w))
+				printf("Could not pin worker %d\n", w);
+
+			// Algorithm objects live as long as the worker, so only the first pair pays for their set-up
+			std::vector<Ptr<FlowMethod> > instances;
+			for (size_t m = 0; m < methods.size(); m++)
+				instances.push_back(FlowMethod::create(methods[m]));
+
+			for (;;) {
+				size_t i = next++;
+				if (i >= pair_count)
+					break;
+
+				// Decoded once, grey conversion once, shared by every method
+				Mat i1, i2, ground_truth, grey1, grey2;
+				bool loaded = true;
+				if (cached) {
+					const DatasetCache::Pair& p = cache.pair((int)i);
+					i1 = p.i1;
+					i2 = p.i2;
+					ground_truth = p.ground_truth;
+				}
+				else {
+					loaded = loadManifestPair(entries[i], i1, i2, ground_truth);
+				}
+
+				if (loaded) {
+					cvtColor(i1, grey1, COLOR_BGR2GRAY);
+					cvtColor(i2, grey2, COLOR_BGR2GRAY);
+				}
+				for (size_t m = 0; loaded && m < instances.size(); m++) {
+					FlowMethod& method = *instances[m];
+					std::string error;		// copied, the exception is gone once its handler ends
+					try {
+						results[i][m] = method.greyInput() ? runMethod(method, grey1, grey2, ground_truth, (int)i, options)
+							: runMethod(method, i1, i2, ground_truth, (int)i, options);
+					}
+					catch (const std::exception& ex) {
+						error = ex.what();
+					}
+					catch (...) {
+						error = "unknown error";
+					}
+					if (error.empty())
+						continue;
+					if (cached)
+						printf("%s on %s: %s\n", method.name().c_str(), cache.pair((int)i).name.c_str(), error.c_str());
+					else
+						printf("%s on manifest line %d: %s\n", method.name().c_str(), entries[i].line, error.c_str());
+				}
+				int finished = ++done;
+				if (finished % 10 == 0 || finished == (int)pair_count)
+					printf("  %d / %d pairs\n", finished, (int)pair_count);
+			}
+		});
+	}
+	pool.wait();
+
+	// Aggregated in pair order, independent of scheduling
+	summaries.assign(methods.size(), MethodSummary());
+	for (size_t m = 0; m < methods.size(); m++) {
+		summaries[m].method = methods[m];
+		for (size_t i = 0; i < pair_count; i++) {
+			if (results[i][m].image_no >= 0)
+				summaries[m].stats.add(results[i][m]);
+		}
+	}
+
+	// Pareto front over (mean runtime, mean EPE) on the pairs every method completed, so no method is
+	// compared on an easier subset; without ground truth only runtime counts
+	std::vector<StatsAggregator> common(methods.size());
+	for (size_t i = 0; i < pair_count; i++) {
+		bool complete = true;
+		for (size_t m = 0; m < methods.size(); m++)
+			complete = complete && results[i][m].image_no >= 0;
+		for (size_t m = 0; complete && m < methods.size(); m++)
+			common[m].add(results[i][m]);
+	}
+	for (size_t a = 0; a < summaries.size(); a++) {
+		const StatsAggregator& sa = common[a];
+		summaries[a].pareto = sa.pairs() > 0;
+		for (size_t b = 0; b < summaries.size() && summaries[a].pareto; b++) {
+			const StatsAggregator& sb = common[b];
+			if (a == b || sb.pairs() == 0)
+				continue;
+			double ta = sa.mean(StatsAggregator::FIELD_TIME), tb = sb.mean(StatsAggregator::FIELD_TIME);
+			double ea = sa.pairsWithGroundTruth() > 0 ? sa.mean(StatsAggregator::FIELD_EPE) : 0.0;
+			double eb = sb.pairsWithGroundTruth() > 0 ? sb.mean(StatsAggregator::FIELD_EPE) : 0.0;
+			if (tb <= ta && eb <= ea && (tb < ta || eb < ea))
+				summaries[a].pareto = false;
+		}
+	}
+	return 0;
+}
+
+int runMethodComparison(int argc, char** argv, int first)
+{
+	std::string manifest = argv[first];
+	ComparisonOptions options;
+	options.output_csv = "method_comparison.csv";
+	int positional = 0;
+	for (int a = first + 1; a < argc; a++) {
+		std::string arg = argv[a];
+		bool has_value = a + 1 < argc;
+		if (arg == "--reps" && has_value)
+			options.repetitions = (std::max)(1, atoi(argv[++a]));
+		else if (arg == "--warmup" && has_value)
+			options.warm_up = (std::max)(0, atoi(argv[++a]));
+		else if (arg == "--workers" && has_value)
+			options.workers = (std::max)(1, atoi(argv[++a]));
+		else if (arg == "--pin")
+			options.pin = true;
+		else if (arg.compare(0, 2, "--") == 0) {
+			printf("Unknown comparison argument %s\n", arg.c_str());
+			return -1;
+		}
+		else if (positional++ == 0) {
+			std::istringstream list(arg);
+			std::string method;
+			while (arg != "all" && std::getline(list, method, ','))
+				options.methods.push_back(method);
+		}
+		else {
+			options.output_csv = arg;
+		}
+	}
+
+	std::vector<MethodSummary> summaries;
+	if (compareMethods(manifest, options, summaries) != 0)
+		return -1;
+
+	std::vector<size_t> order(summaries.size());
+	for (size_t m = 0; m < order.size(); m++)
+		order[m] = m;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return summaries[a].stats.mean(StatsAggregator::FIELD_TIME) < summaries[b].stats.mean(StatsAggregator::FIELD_TIME);
+	});
+
+	std::ofstream csv(options.output_csv.c_str());
+	csv << "method,pairs,epe,epe_p90,fl,r3,time_ms,time_p90_ms,pareto\n";
+
+	cout << "---------------   Method comparison  -------------------\n";
+	printf("%-20s %6s %8s %8s %8s %8s %10s %10s  %s\n", "method", "pairs", "EPE", "EPE p90", "Fl [%]", "R3.0", "time ms", "p90 ms", "pareto");
+	for (size_t j = 0; j < order.size(); j++) {
+		const MethodSummary& s = summaries[order[j]];
+		const StatsAggregator& a = s.stats;
+		double epe = a.mean(StatsAggregator::FIELD_EPE), epe_p90 = a.quantile(StatsAggregator::FIELD_EPE, 0.9);
+		double fl = a.mean(StatsAggregator::FIELD_FL), r3 = a.mean(StatsAggregator::FIELD_R3);
+		double time_ms = a.mean(StatsAggregator::FIELD_TIME) * 1000, time_p90_ms = a.quantile(StatsAggregator::FIELD_TIME, 0.9) * 1000;
+		printf("%-20s %6lld %8.3f %8.3f %8.2f %8.2f %10.2f %10.2f  %s\n", s.method.c_str(), a.pairs(), epe, epe_p90, fl, r3, time_ms, time_p90_ms,
+			s.pareto ? "*" : "");
+		csv << s.method << "," << a.pairs() << "," << epe << "," << epe_p90 << "," << fl << "," << r3 << "," << time_ms << ","
+			<< time_p90_ms << "," << (s.pareto ? 1 : 0) << "\n";
+	}
+	cout << "* on the accuracy / runtime Pareto front\n";
+	cout << "Results written to " << options.output_csv << "\n";
+	return 0;
+}
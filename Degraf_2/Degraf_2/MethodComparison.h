@@ -0,0 +1,42 @@
+/*!
+\file MethodComparison.h
+\brief Head-to-head runtime and accuracy of many flow methods on shared decoded inputs, with a Pareto report
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FlowMethod.h"
+#include "FlowStatistics.h"
+
+#include <string>
+#include <vector>
+
+struct ComparisonOptions {
+	std::vector<String> methods;	// empty for FlowMethod::allMethods()
+	int warm_up = 1;				// untimed runs per method and pair
+	int repetitions = 3;			// timed runs per method and pair, the median is recorded
+	int workers = 1;				// concurrent pairs; more than one trades timing fidelity for throughput
+	bool pin = false;				// pin worker w to logical CPU w
+	std::string output_csv;
+};
+
+// Aggregate of one method over all pairs
+struct MethodSummary {
+	String method;
+	StatsAggregator stats;			// pairs the method completed, seconds is the median of the timed repetitions of each pair
+	bool pareto;					// no other method is both at least as fast and at least as accurate on the pairs all completed
+};
+
+// Decodes each pair once (colour and grey) and runs every method on it with warm algorithm objects.
+/*!
+\param manifest manifest or dataset cache (.dgc)
+\param options methods and timing setup
+\param summaries output, one per method in options order
+\return 0 on success, -1 on error
+*/
+int compareMethods(const std::string& manifest, const ComparisonOptions& options, std::vector<MethodSummary>& summaries);
+
+// Command line entry: arguments after the manifest are [methods|all] [results.csv] [--reps n] [--warmup n]
+// [--workers n] [--pin], methods comma separated. Prints the summary sorted by runtime with the Pareto front marked.
+int runMethodComparison(int argc, char** argv, int first);
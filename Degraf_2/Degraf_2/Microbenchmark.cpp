@@ -0,0 +1,413 @@
+/*!
+\file Microbenchmark.cpp
+\brief Repeatable per-stage microbenchmarks on procedural inputs, thread scaling and baseline regression checks
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "Microbenchmark.h"
+#include "SyntheticFlow.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+
+// A benchmark body, run repeatedly on inputs prepared once per size
+struct Microbenchmark {
+	std::string name;
+	std::function<void()> run;
+};
+
+static std::string sizeName(Size size)
+{
+	std::ostringstream name;
+	name << size.width << "x" << size.height;
+	return name.str();
+}
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::istringstream in(list);
+	std::string item;
+	while (std::getline(in, item, ','))
+		if (!item.empty())
+			items.push_back(item);
+	return items;
+}
+
+bool parseBenchOptions(int argc, char** argv, int first, BenchOptions& options)
+{
+	for (int a = first; a < argc; a++) {
+		std::string arg = argv[a];
+		bool has_value = a + 1 < argc;
+		if (arg.compare(0, 2, "--") != 0) {
+			options.output_json = arg;
+		}
+		else if (arg == "--baseline" && has_value) {
+			options.baseline_json = argv[++a];
+		}
+		else if (arg == "--threshold" && has_value) {
+			options.threshold = atof(argv[++a]);
+		}
+		else if (arg == "--filter" && has_value) {
+			options.filter = argv[++a];
+		}
+		else if (arg == "--reps" && has_value) {
+			options.repetitions = (std::max)(1, atoi(argv[++a]));
+		}
+		else if (arg == "--threads" && has_value) {
+			std::vector<std::string> items = splitList(argv[++a]);
+			for (size_t i = 0; i < items.size(); i++)
+				options.threads.push_back((std::max)(1, atoi(items[i].c_str())));
+		}
+		else if (arg == "--sizes" && has_value) {
+			std::vector<std::string> items = splitList(argv[++a]);
+			for (size_t i = 0; i < items.size(); i++) {
+				int w = 0, h = 0;
+				if (items[i] == "vga")
+					options.sizes.push_back(Size(640, 480));
+				else if (items[i] == "kitti")
+					options.sizes.push_back(Size(1242, 375));
+				else if (items[i] == "1080p")
+					options.sizes.push_back(Size(1920, 1080));
+				else if (items[i] == "4k")
+					options.sizes.push_back(Size(3840, 2160));
+				else if (sscanf(items[i].c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0)
+					options.sizes.push_back(Size(w, h));
+				else {
+					printf("Unknown benchmark size %s\n", items[i].c_str());
+					return false;
+				}
+			}
+		}
+		else {
+			printf("Unknown or incomplete benchmark argument %s\n", arg.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+// Inputs shared by the benchmarks of one size: a textured pair with a known constant motion, its DoGoS
+// image, DeGraF points and RLOF matches, and the resulting dense flow with exact ground truth
+struct BenchInputs {
+	Mat i1, i2, grey1, grey2;
+	IplImage* dog;				// DoGoS of i1, the input of the gradient benchmarks
+	IplImage* divog;			// output of the DIVoG benchmark, kept apart so it cannot change dog
+	vector<Point2f> points;
+	vector<Point2f> matches_from, matches_to;
+	Mat flow, ground_truth, errors, mask;
+
+	BenchInputs() : dog(NULL), divog(NULL) {}
+	~BenchInputs() { ReleaseTrackedImage(&dog); ReleaseTrackedImage(&divog); }
+};
+
+static const double BENCH_DX = 2.5, BENCH_DY = 0.75;
+
+static void prepareInputs(Size size, BenchInputs& in)
+{
+	in.i1 = texturedFrame(size, 1);
+	in.i2 = translatedFrame(in.i1, BENCH_DX, BENCH_DY);
+	cvtColor(in.i1, in.grey1, COLOR_BGR2GRAY);
+	cvtColor(in.i2, in.grey2, COLOR_BGR2GRAY);
+
+	DegrafFlowParams params;
+	in.dog = CreateTrackedImage(cvSize(size.width, size.height), IPL_DEPTH_8U, 3);
+	in.divog = CreateTrackedImage(cvSize(size.width, size.height), IPL_DEPTH_8U, 3);
+	SaliencyDetector saliency_detector;
+	saliency_detector.DoGoS_Saliency(&(IplImage(in.i1)), in.dog, params.saliency_levels, true, true);
+
+	FeatureMatcher matcher;
+	matcher.degraf_detect(in.i1, in.points, params);
+	matcher.degraf_track(in.i1, in.i2, in.points, params);
+	in.matches_from = matcher.points_filtered;
+	in.matches_to = matcher.dst_points_filtered;
+	matcher.degraf_interpolate(in.i1, in.i2, in.flow, params);
+
+	in.ground_truth = Mat(size, CV_32FC2, Scalar(BENCH_DX, BENCH_DY));
+	Mat difference = in.flow - in.ground_truth;
+	std::vector<Mat> channels;
+	split(difference, channels);
+	magnitude(channels[0], channels[1], in.errors);
+	EvaluateOptFlow::regionMask("untextured", Mat(), in.i1, in.mask);
+}
+
+// Benchmarks of every pipeline stage on prepared inputs. Objects with internal buffers (pyramids,
+// detectors, matchers) are created once and reused, as in the pipeline.
+static std::vector<Microbenchmark> stageBenchmarks(BenchInputs& in)
+{
+	std::vector<Microbenchmark> benchmarks;
+	std::shared_ptr<SaliencyDetector> saliency = std::make_shared<SaliencyDetector>();
+	std::shared_ptr<FeatureMatcher> matcher = std::make_shared<FeatureMatcher>();
+	BenchInputs* inputs = &in;
+
+	benchmarks.push_back({ "saliency/dogos", [=]() {
+		saliency->DoGoS_Saliency(&(IplImage(inputs->i1)), inputs->dog, 3, true, true);
+	} });
+	benchmarks.push_back({ "saliency/divog", [=]() {
+		saliency->DIVoG_Saliency(&(IplImage(inputs->i1)), inputs->divog, 3, true, true);
+	} });
+
+	const int pyramid_levels = 4;
+	std::shared_ptr<ImagePyramid> up = std::make_shared<ImagePyramid>();
+	std::shared_ptr<ImagePyramid> down = std::make_shared<ImagePyramid>();
+	up->BuildPyramidUp(&(IplImage(in.grey1)), pyramid_levels);
+	down->Create(&(IplImage(in.grey1)), pyramid_levels);
+	benchmarks.push_back({ "pyramid/up", [=]() {
+		up->BuildPyramidUp(&(IplImage(inputs->grey1)), pyramid_levels);
+	} });
+	benchmarks.push_back({ "pyramid/down", [=]() {
+		down->BuildPyramidDown(up->level_image[pyramid_levels - 1]);
+	} });
+
+	// Window and step of every shipped preset, and the 7x7 window, step 5 of the odometry
+	int windows[] = { 3, 3, 3, 3, 7 };
+	int steps[] = { 7, 9, 11, 13, 5 };
+	for (int s = 0; s < 5; s++) {
+		std::shared_ptr<GradientDetector> detector = std::make_shared<GradientDetector>();
+		int window = windows[s], step = steps[s];
+		benchmarks.push_back({ "gradients/w" + std::to_string(window) + "_s" + std::to_string(step), [=]() {
+			detector->DetectGradients(inputs->dog, window, window, step, step);
+		} });
+	}
+
+	benchmarks.push_back({ "track/lk", [=]() {
+		vector<Point2f> dst_points;
+		vector<uchar> status;
+		vector<float> err;
+		calcOpticalFlowPyrLK(inputs->grey1, inputs->grey2, inputs->points, dst_points, status, err, Size(11, 11), 4);
+	} });
+	benchmarks.push_back({ "track/rlof", [=]() {
+		matcher->degraf_track(inputs->i1, inputs->i2, inputs->points, DegrafFlowParams());
+	} });
+	benchmarks.push_back({ "interpolate/eai", [=]() {
+		DegrafFlowParams params;
+		params.use_post_proc = false;
+		matcher->points_filtered = inputs->matches_from;
+		matcher->dst_points_filtered = inputs->matches_to;
+		Mat flow;
+		matcher->degraf_interpolate(inputs->i1, inputs->i2, flow, params);
+	} });
+	benchmarks.push_back({ "interpolate/fgs", [=]() {
+		Mat flow = inputs->flow.clone();
+		matcher->degraf_post_process(inputs->i1, flow, DegrafFlowParams());
+	} });
+
+	benchmarks.push_back({ "metrics/fused", [=]() {
+		FlowMetrics metrics;
+		computeFlowMetrics(inputs->flow, inputs->ground_truth, Mat(), metrics);
+	} });
+	benchmarks.push_back({ "metrics/fused_masked", [=]() {
+		FlowMetrics metrics;
+		computeFlowMetrics(inputs->flow, inputs->ground_truth, inputs->mask, metrics);
+	} });
+	std::shared_ptr<EvaluateOptFlow> evaluator = std::make_shared<EvaluateOptFlow>();
+	evaluator->verbose = false;
+	benchmarks.push_back({ "metrics/legacy", [=]() {
+		evaluator->calculateStats(inputs->errors, inputs->mask, false);
+	} });
+	benchmarks.push_back({ "metrics/region_discontinuities", [=]() {
+		Mat mask;
+		EvaluateOptFlow::regionMask("discontinuities", inputs->ground_truth, inputs->i1, mask);
+	} });
+	benchmarks.push_back({ "metrics/region_untextured", [=]() {
+		Mat mask;
+		EvaluateOptFlow::regionMask("untextured", Mat(), inputs->i1, mask);
+	} });
+	return benchmarks;
+}
+
+static double median(std::vector<double> values)
+{
+	if (values.empty())
+		return 0.0;
+	size_t mid = values.size() / 2;
+	std::nth_element(values.begin(), values.begin() + mid, values.end());
+	double upper = values[mid];
+	if (values.size() % 2 == 1)
+		return upper;
+	return 0.5 * (upper + *std::max_element(values.begin(), values.begin() + mid));
+}
+
+static BenchResult timeBenchmark(const Microbenchmark& benchmark, const std::string& size, int threads, int repetitions, int warm_up)
+{
+	for (int w = 0; w < warm_up; w++)
+		benchmark.run();
+
+	std::vector<double> times(repetitions);
+	for (int r = 0; r < repetitions; r++) {
+		int64 start = getTickCount();
+		benchmark.run();
+		times[r] = (getTickCount() - start) * 1000.0 / getTickFrequency();
+	}
+
+	BenchResult result;
+	result.name = benchmark.name;
+	result.size = size;
+	result.threads = threads;
+	result.repetitions = repetitions;
+	result.median_ms = median(times);
+	result.min_ms = *std::min_element(times.begin(), times.end());
+	std::vector<double> deviations(repetitions);
+	for (int r = 0; r < repetitions; r++)
+		deviations[r] = std::abs(times[r] - result.median_ms);
+	result.mad_ms = median(deviations);
+	return result;
+}
+
+int runMicrobenchmarks(const BenchOptions& options)
+{
+	std::vector<Size> sizes = options.sizes;
+	if (sizes.empty()) {
+		sizes.push_back(Size(640, 480));
+		sizes.push_back(Size(1242, 375));
+		sizes.push_back(Size(1920, 1080));
+		sizes.push_back(Size(3840, 2160));
+	}
+	std::vector<int> threads = options.threads;
+	if (threads.empty()) {
+		threads.push_back(1);
+		if (ThreadPool::hardwareThreads() > 1)
+			threads.push_back(ThreadPool::hardwareThreads());
+	}
+
+	int cv_threads = getNumThreads();
+	std::vector<BenchResult> results;
+
+	cout << "---------------   Microbenchmarks  -------------------\n";
+	printf("%-32s %-10s %7s %10s %10s %10s %8s\n", "benchmark", "size", "threads", "median ms", "min ms", "mad ms", "speed-up");
+	for (size_t s = 0; s < sizes.size(); s++) {
+		BenchInputs inputs;
+		prepareInputs(sizes[s], inputs);
+		std::vector<Microbenchmark> benchmarks = stageBenchmarks(inputs);
+		std::string size = sizeName(sizes[s]);
+
+		for (size_t b = 0; b < benchmarks.size(); b++) {
+			if (!options.filter.empty() && benchmarks[b].name.find(options.filter) == std::string::npos)
+				continue;
+			double first_median = 0;
+			for (size_t t = 0; t < threads.size(); t++) {
+				setNumThreads(threads[t]);
+				BenchResult r = timeBenchmark(benchmarks[b], size, threads[t], options.repetitions, options.warm_up);
+				if (t == 0)
+					first_median = r.median_ms;
+				printf("%-32s %-10s %7d %10.3f %10.3f %10.3f %7.2fx\n", r.name.c_str(), r.size.c_str(), r.threads, r.median_ms, r.min_ms,
+					r.mad_ms, r.median_ms > 0 ? first_median / r.median_ms : 0.0);
+				results.push_back(r);
+			}
+		}
+	}
+	setNumThreads(cv_threads);
+
+	if (!options.output_json.empty()) {
+		if (!writeBenchJSON(options.output_json, results)) {
+			printf("Could not write %s\n", options.output_json.c_str());
+			return -1;
+		}
+		cout << "Results written to " << options.output_json << "\n";
+	}
+
+	if (!options.baseline_json.empty()) {
+		std::vector<BenchResult> baseline;
+		if (!readBenchJSON(options.baseline_json, baseline)) {
+			printf("Could not read baseline %s\n", options.baseline_json.c_str());
+			return -1;
+		}
+		int regressions = compareBenchResults(results, baseline, options.threshold);
+		if (regressions > 0) {
+			printf("%d benchmarks regressed by more than %.0f%%\n", regressions, options.threshold * 100);
+			return 1;
+		}
+		printf("No regressions against %s\n", options.baseline_json.c_str());
+	}
+	return 0;
+}
+
+bool writeBenchJSON(const std::string& path, const std::vector<BenchResult>& results)
+{
+	std::ofstream out(path.c_str());
+	if (!out.is_open())
+		return false;
+	out << "{\n  \"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		out << "    { \"name\": \"" << r.name << "\", \"size\": \"" << r.size << "\", \"threads\": " << r.threads
+			<< ", \"repetitions\": " << r.repetitions << ", \"median_ms\": " << r.median_ms << ", \"min_ms\": " << r.min_ms
+			<< ", \"mad_ms\": " << r.mad_ms << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+	return true;
+}
+
+// Value of "key": in a line written by writeBenchJSON, without quotes for strings
+static bool jsonField(const std::string& line, const std::string& key, std::string& value)
+{
+	size_t p = line.find("\"" + key + "\":");
+	if (p == std::string::npos)
+		return false;
+	p = line.find_first_not_of(" ", p + key.size() + 3);
+	if (p == std::string::npos)
+		return false;
+	if (line[p] == '"') {
+		size_t end = line.find('"', p + 1);
+		if (end == std::string::npos)
+			return false;
+		value = line.substr(p + 1, end - p - 1);
+	}
+	else {
+		size_t end = line.find_first_of(",}", p);
+		value = line.substr(p, end == std::string::npos ? std::string::npos : end - p);
+	}
+	return true;
+}
+
+bool readBenchJSON(const std::string& path, std::vector<BenchResult>& results)
+{
+	std::ifstream in(path.c_str());
+	if (!in.is_open())
+		return false;
+	results.clear();
+	std::string line;
+	while (std::getline(in, line)) {
+		BenchResult r;
+		std::string threads, repetitions, median_ms, min_ms, mad_ms;
+		if (!jsonField(line, "name", r.name))
+			continue;
+		if (!jsonField(line, "size", r.size) || !jsonField(line, "threads", threads) || !jsonField(line, "repetitions", repetitions) ||
+			!jsonField(line, "median_ms", median_ms) || !jsonField(line, "min_ms", min_ms) || !jsonField(line, "mad_ms", mad_ms))
+			return false;
+		r.threads = atoi(threads.c_str());
+		r.repetitions = atoi(repetitions.c_str());
+		r.median_ms = atof(median_ms.c_str());
+		r.min_ms = atof(min_ms.c_str());
+		r.mad_ms = atof(mad_ms.c_str());
+		results.push_back(r);
+	}
+	return true;
+}
+
+int compareBenchResults(const std::vector<BenchResult>& results, const std::vector<BenchResult>& baseline, double threshold)
+{
+	int regressions = 0;
+	printf("\n%-32s %-10s %7s %12s %12s %8s\n", "benchmark", "size", "threads", "baseline ms", "current ms", "change");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		for (size_t j = 0; j < baseline.size(); j++) {
+			const BenchResult& b = baseline[j];
+			if (b.name != r.name || b.size != r.size || b.threads != r.threads)
+				continue;
+			double change = b.median_ms > 0 ? r.median_ms / b.median_ms - 1.0 : 0.0;
+			bool regressed = change > threshold && r.median_ms - b.median_ms > 2 * (std::max)(r.mad_ms, b.mad_ms);
+			printf("%-32s %-10s %7d %12.3f %12.3f %+7.1f%%%s\n", r.name.c_str(), r.size.c_str(), r.threads, b.median_ms, r.median_ms,
+				change * 100, regressed ? "  REGRESSION" : "");
+			if (regressed)
+				regressions++;
+			break;
+		}
+	}
+	return regressions;
+}
@@ -0,0 +1,60 @@
+/*!
+\file Microbenchmark.h
+\brief Repeatable per-stage microbenchmarks on procedural inputs, thread scaling and baseline regression checks
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FeatureMatcher.h"
+#include "EvaluateOptFlow.h"
+
+#include <string>
+#include <vector>
+
+// Timing of one benchmark at one input size and OpenCV thread count
+struct BenchResult {
+	std::string name;		// stage/variant, e.g. "gradients/w3_s9"
+	std::string size;		// WxH
+	int threads;
+	int repetitions;
+	double median_ms, min_ms;
+	double mad_ms;			// median absolute deviation, the noise estimate used by the regression check
+};
+
+struct BenchOptions {
+	std::vector<Size> sizes;		// empty for 640x480, KITTI (1242x375), 1080p and 4K
+	std::vector<int> threads;		// OpenCV thread counts to sweep, empty for 1 and the hardware thread count
+	int repetitions = 15;
+	int warm_up = 2;
+	std::string filter;				// only benchmarks whose name contains this
+	std::string output_json;		// results file, empty for none
+	std::string baseline_json;		// results of an earlier run to compare against, empty for none
+	double threshold = 0.10;		// relative median slowdown reported as a regression
+};
+
+// Parses the --bench arguments following argv[first]:
+//     [results.json] [--baseline <file>] [--threshold <fraction>] [--filter <text>]
+//     [--sizes vga,kitti,1080p,4k,<W>x<H>] [--threads 1,2,4] [--reps <n>]
+/*!
+\return false on an unknown or incomplete argument
+*/
+bool parseBenchOptions(int argc, char** argv, int first, BenchOptions& options);
+
+// Runs every stage benchmark for each size and thread count, prints the timings with the speed-up over
+// the smallest thread count, and writes and compares results as requested.
+/*!
+\return 0 on success, 1 if a benchmark regressed against the baseline, -1 on error
+*/
+int runMicrobenchmarks(const BenchOptions& options);
+
+// One benchmark per line inside a "benchmarks" array, so files diff cleanly
+bool writeBenchJSON(const std::string& path, const std::vector<BenchResult>& results);
+bool readBenchJSON(const std::string& path, std::vector<BenchResult>& results);
+
+// A benchmark regresses when its median is more than threshold slower than the baseline and the
+// difference exceeds twice the larger MAD of the two runs (so noisy benchmarks do not trip the check)
+/*!
+\return number of regressions
+*/
+int compareBenchResults(const std::vector<BenchResult>& results, const std::vector<BenchResult>& baseline, double threshold);
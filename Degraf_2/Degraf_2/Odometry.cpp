@@ -4,38 +4,59 @@
 
 #include "stdafx.h"
 #include "vo_features.h"
+#include "PoseStore.h"
+#include "TrackTable.h"
+#include "EssentialEstimator.h"
+#include "SequenceReader.h"
+#include "TrajectoryView.h"
+
+#include <memory>
 
 using namespace cv;
 using namespace std;
 
 #define MAX_FRAME 4539
 #define MIN_NUM_FEAT 2000
+#define GRID_COLS 8          // redetection cells across the image
+#define GRID_ROWS 4          // redetection cells down the image
+#define CELL_MARGIN 16       // context around a cell for the saliency pyramid and gradient windows
 
 // IMP: Change the file directories (4 places) according to where your dataset is saved before running!
 
 Odometry::Odometry() {
-
+	image_pattern = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/VO/00/image_0/%06d.png";  // Change dir here
+	pose_file = "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/VO/00.txt";  // Change dir here
+	focal = 718.8560;
+	pp = cv::Point2d(607.1928, 185.2157);
+	max_frame = MAX_FRAME;
 }
 
-vector<Mat> loadPoses(string file_name) {
-	vector<Mat> poses;
-	FILE *fp = fopen(file_name.c_str(), "r");
-	if (!fp)
-		return poses;
+bool Odometry::loadCalibration(const string& calib_path) {
+	ifstream in(calib_path.c_str());
+	if (!in.is_open()) {
+		cout << "Could not open calibration " << calib_path << endl;
+		return false;
+	}
 
-	
-	while (!feof(fp)) {
-		
-		Mat P = Mat::eye(3, 4, CV_64FC1);
-		if (fscanf(fp, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",
-			&P.at<long float>(0,0), &P.at<long float>(0,1), &P.at<long float>(0,2), &P.at<long float>(0, 3),
-			&P.at<long float>(1, 0), &P.at<long float>(1, 1), &P.at<long float>(1, 2), &P.at<long float>(1, 3),
-			&P.at<long float>(2,0), &P.at<long float>(2, 1), &P.at<long float>(2,2), &P.at<long float>(2,3)) == 12) {		
-			poses.push_back(P);
+	// P0: fx 0 cx 0 0 fy cy 0 0 0 1 0, the projection matrix of the left grey camera
+	string line;
+	while (getline(in, line)) {
+		if (line.compare(0, 3, "P0:") != 0)
+			continue;
+		double p[12];
+		istringstream values(line.substr(3));
+		for (int i = 0; i < 12; i++) {
+			if (!(values >> p[i])) {
+				cout << calib_path << ": P0 does not hold 12 values" << endl;
+				return false;
+			}
 		}
+		focal = p[0];
+		pp = cv::Point2d(p[2], p[6]);
+		return true;
 	}
-	fclose(fp);
-	return poses;
+	cout << calib_path << ": no P0 line" << endl;
+	return false;
 }
 
 void featureTracking(Mat img_1, Mat img_2, vector<Point2f>& points1, vector<Point2f>& points2, vector<uchar>& status) {
@@ -47,24 +68,27 @@ void featureTracking(Mat img_1, Mat img_2, vector<Point2f>& points1, vector<Poin
 
 	calcOpticalFlowPyrLK(img_1, img_2, points1, points2, status, err, winSize, 3, termcrit, 0, 0.001);
 
-	//getting rid of points for which the LK tracking failed or those who have gone outside the frame
-	int indexCorrection = 0;
-	for (int i = 0; i<status.size(); i++)
+	//getting rid of points for which the LK tracking failed or those who have gone outside the frame,
+	//kept points are moved down in one pass instead of erasing each failure
+	size_t n = 0;
+	for (size_t i = 0; i < status.size(); i++)
 	{
-		Point2f pt = points2.at(i - indexCorrection);
-		if ((status.at(i) == 0) || (pt.x<0) || (pt.y<0)) {
-			if ((pt.x<0) || (pt.y<0)) {
-				status.at(i) = 0;
-			}
-			points1.erase(points1.begin() + (i - indexCorrection));
-			points2.erase(points2.begin() + (i - indexCorrection));
-			indexCorrection++;
-		}
-
+		Point2f pt = points2[i];
+		if ((pt.x < 0) || (pt.y < 0))
+			status[i] = 0;
+		if (status[i] == 0)
+			continue;
+		points1[n] = points1[i];
+		points2[n] = pt;
+		n++;
 	}
+	points1.resize(n);
+	points2.resize(n);
 }
 
-void featureDetection(Mat img_1, vector<Point2f>& points1) { 
+// responses, if given, receives the detector response of every point (FAST score or DeGraF gradient
+// magnitude x pos/neg ratio), used to rank the points for PROSAC
+void featureDetection(Mat img_1, vector<Point2f>& points1, vector<float>* responses) { 
 	// Use either FAST or DeGraF points 
 	int point = 2;
 	if (point == 1) {
@@ -73,6 +97,11 @@ void featureDetection(Mat img_1, vector<Point2f>& points1) {
 		bool nonmaxSuppression = true;
 		FAST(img_1, keypoints_1, fast_threshold, nonmaxSuppression);
 		KeyPoint::convert(keypoints_1, points1, vector<int>());
+		if (responses != NULL) {
+			responses->resize(keypoints_1.size());
+			for (size_t i = 0; i < keypoints_1.size(); i++)
+				(*responses)[i] = keypoints_1[i].response;
+		}
 		cout << points1.size() << "\n";
 	}
 	else if (point == 2) {
@@ -84,7 +113,7 @@ void featureDetection(Mat img_1, vector<Point2f>& points1) {
 		cv::Size s = img_1.size();
 		
 		cvtColor(img_1, img_1, CV_GRAY2RGB);
-		IplImage *dog_1 = cvCreateImage(cvSize(s.width, s.height), IPL_DEPTH_8U, 3);
+		IplImage *dog_1 = CreateTrackedImage(cvSize(s.width, s.height), IPL_DEPTH_8U, 3);
 
 		SaliencyDetector saliency_detector;
 		saliency_detector.DoGoS_Saliency(&(IplImage(img_1)), dog_1, 5, true, true);
@@ -97,135 +126,187 @@ void featureDetection(Mat img_1, vector<Point2f>& points1) {
 
 		// Convert from keyPoint type to Point2f
 		cv::KeyPoint::convert(gradient_detector_1->keypoints, points1);
+		if (responses != NULL) {
+			responses->resize(gradient_detector_1->keypoints.size());
+			for (size_t i = 0; i < gradient_detector_1->keypoints.size(); i++)
+				(*responses)[i] = gradient_detector_1->keypoints[i].response;
+		}
 		
 		// Release memory
-		gradient_detector_1->Release();
-		cvReleaseImage(&dog_1);
+		delete gradient_detector_1;
+		ReleaseTrackedImage(&dog_1);
 		img_1.release();
 	}
 }
 
-double getAbsoluteScale(int frame_id, int sequence_id, double z_cal) {
+int bucketedRedetection(const Mat& img, TrackTable& tracks, int grid_cols, int grid_rows, int cell_target) {
+
+	// Live tracks per cell, counted at the positions in img
+	const vector<Point2f>& live = tracks.latest();
+	int cell_count = grid_cols * grid_rows;
+	vector<int> counts(cell_count, 0);
+	for (size_t i = 0; i < live.size(); i++) {
+		int cx = (int)(live[i].x * grid_cols / img.cols);
+		int cy = (int)(live[i].y * grid_rows / img.rows);
+		if (cx >= 0 && cx < grid_cols && cy >= 0 && cy < grid_rows)
+			counts[cy * grid_cols + cx]++;
+	}
 
-	string line;
-	int i = 0;
-	ifstream myfile("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/VO/00.txt"); // Change dir here
-	double x = 0, y = 0, z = 0;
-	double x_prev, y_prev, z_prev;
-	if (myfile.is_open())
-	{
-		while ((getline(myfile, line)) && (i <= frame_id))
-		{
-			z_prev = z;
-			x_prev = x;
-			y_prev = y;
-			std::istringstream in(line);
-			for (int j = 0; j<12; j++) {
-				in >> z;
-				if (j == 7) y = z;
-				if (j == 3)  x = z;
+	vector<int> sparse;
+	for (int c = 0; c < cell_count; c++)
+		if (counts[c] < cell_target)
+			sparse.push_back(c);
+	if (sparse.empty())
+		return 0;
+
+	// Cells are detected independently, each with its own detectors
+	vector<vector<Point2f> > cell_points(sparse.size());
+	vector<vector<float> > cell_responses(sparse.size());
+	parallel_for_(Range(0, (int)sparse.size()), [&](const Range& r) {
+		for (int k = r.start; k < r.end; k++) {
+			int cx = sparse[k] % grid_cols, cy = sparse[k] / grid_cols;
+			Rect cell(cx * img.cols / grid_cols, cy * img.rows / grid_rows, 0, 0);
+			cell.width = (cx + 1) * img.cols / grid_cols - cell.x;
+			cell.height = (cy + 1) * img.rows / grid_rows - cell.y;
+			Rect crop = Rect(cell.x - CELL_MARGIN, cell.y - CELL_MARGIN, cell.width + 2 * CELL_MARGIN, cell.height + 2 * CELL_MARGIN)
+				& Rect(0, 0, img.cols, img.rows);
+
+			vector<Point2f> points;
+			vector<float> responses;
+			featureDetection(img(crop), points, &responses);
+
+			// Points of the cell itself, strongest first, as many as the cell is short of
+			vector<int> order;
+			for (size_t i = 0; i < points.size(); i++) {
+				points[i] += Point2f((float)crop.x, (float)crop.y);
+				if (cell.contains(Point((int)points[i].x, (int)points[i].y)))
+					order.push_back((int)i);
+			}
+			std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return responses[a] > responses[b]; });
+			order.resize((std::min)(order.size(), (size_t)(cell_target - counts[sparse[k]])));
+			for (size_t i = 0; i < order.size(); i++) {
+				cell_points[k].push_back(points[order[i]]);
+				cell_responses[k].push_back(responses[order[i]]);
 			}
-			i++;
 		}
-		myfile.close();
-	}
+	});
 
-	else {
-		cout << "Unable to open file";
-		return 0;
+	// Appended in cell order, so new ids do not depend on the thread timing
+	int added = 0;
+	for (size_t k = 0; k < sparse.size(); k++) {
+		tracks.append(cell_points[k], cell_responses[k]);
+		added += (int)cell_points[k].size();
 	}
-
-	return sqrt((x - x_prev)*(x - x_prev) + (y - y_prev)*(y - y_prev) + (z - z_prev)*(z - z_prev));
+	return added;
 }
 
-
 int Odometry::run() {
 
+	// Ground truth scale of every frame, parsed once (a .dgp pose cache is mapped instead)
+	PoseStore poses;
+	if (!poses.load(pose_file))
+		return -1;
+	int frame_count = max_frame < 0 ? poses.size() : max_frame;
+	report = OdometryReport();
+
 	Mat img_1, img_2;
 	Mat R_f, t_f; 
 
-	//ofstream myfile;
-	//myfile.open("results1_1.txt"); // file for printing numerical results to
+	// Estimated poses in the KITTI format, one line per frame
+	PoseWriter pose_writer;
+	if (!pose_output.empty() && !pose_writer.open(pose_output))
+		return -1;
 
 	double scale = 1.00;
-	char filename1[200];
-	char filename2[200];
-	sprintf(filename1, "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/VO/00/image_0/%06d.png", 0);  // Change dir here
-	sprintf(filename2, "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/VO/00/image_0/%06d.png", 1);  // Change dir here
 
-	char text[100];
-	int fontFace = FONT_HERSHEY_PLAIN;
-	double fontScale = 1;
-	int thickness = 1;
-	cv::Point textOrg(10, 50);
+	// Frames are decoded to grey on background threads, ahead of the tracking
+	SequenceReader frames(image_pattern, 0, frame_count, IMREAD_GRAYSCALE, ring_size);
 
-	//read the first two frames from the dataset
-	Mat img_1_c = imread(filename1);
-	Mat img_2_c = imread(filename2);
-
-	if (!img_1_c.data || !img_2_c.data) {
+	//read the first two frames from the dataset, we work with grayscale images
+	if (!frames.frame(0, img_1) || !frames.frame(1, img_2)) {
 		std::cout << " --(!) Error reading images " << std::endl; return -1;
 	}
 
-	// we work with grayscale images
-	cvtColor(img_1_c, img_1, COLOR_BGR2GRAY);
-	cvtColor(img_2_c, img_2, COLOR_BGR2GRAY);
-
 	// feature detection, tracking
-	vector<Point2f> points1, points2;        //vectors to store the coordinates of the feature points
-	featureDetection(img_1, points1);        //detect features in img_1
-	vector<uchar> status;
-	featureTracking(img_1, img_2, points1, points2, status); //track those features to img_2
+	vector<Point2f> points1;                 //vector to store the coordinates of the detected feature points
+	vector<float> responses;                 //detector response of each point
+	featureDetection(img_1, points1, &responses);  //detect features in img_1
+	TrackTable tracks;                       //positions, ids and ages of the tracked features
+	tracks.reset(points1, responses);
+	tracks.track(img_1, img_2);              //track those features to img_2
 
-	double focal = 718.8560;
-	cv::Point2d pp(607.1928, 185.2157);
 	//recovering the pose and the essential matrix
 	Mat E, R, t, mask;
-	E = findEssentialMat(points2, points1, focal, pp, RANSAC, 0.999, 1.0, mask);
-	recoverPose(E, points2, points1, R, t, focal, pp, mask);
+	// PROSAC samples the strongest, best tracked features first (same confidence and threshold as RANSAC)
+	EssentialParams essential;
+	vector<float> quality;
+	tracks.quality(quality);
+	E = findEssentialMatProsac(tracks.current(), tracks.previous(), quality, focal, pp, mask, essential);
+	recoverPose(E, tracks.current(), tracks.previous(), R, t, focal, pp, mask);
 
 
-	cout << "R: " << R << "\nT: " << t;
+	if (verbose)
+		cout << "R: " << R << "\nT: " << t;
 	Mat prevImage = img_2;
 	Mat currImage;
-	vector<Point2f> prevFeatures = points2;
-	vector<Point2f> currFeatures;
-
-	char filename[100];
+	tracks.advance();
 
 	R_f = R.clone();
 	t_f = t.clone();
 
 	clock_t begin = clock();
-
-	namedWindow("Road facing camera", WINDOW_AUTOSIZE);// Create a window for display.
-	namedWindow("Trajectory", WINDOW_AUTOSIZE);// Create a window for display.
-
-	//Mat traj = Mat::zeros(600, 600, CV_8UC3);
-	Mat traj = imread("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/images/output/VO/ground.png", 1);
-	for (int numFrame = 0; numFrame < MAX_FRAME; numFrame++) {
+	int64 start = getTickCount();
+	double squared_error = 0;
+
+	// Writes a frame's pose and adds it to the drift report
+	auto record = [&](int frame, const Mat& R_frame, const Mat& t_frame) {
+		pose_writer.write(R_frame, t_frame);
+		Vec3d position(t_frame.at<double>(0), t_frame.at<double>(1), t_frame.at<double>(2));
+		double error = norm(position - poses.translation((std::min)(frame, poses.size() - 1)));
+		squared_error += error * error;
+		report.final_error = error;
+		report.frames++;
+	};
+
+	// Adaptive keyframes: frames that barely moved from the keyframe in prevImage are skipped and get
+	// their pose once the next keyframe is estimated. Skipped frames stay held in the reader, so a run of
+	// skips is cut short before it fills the ring.
+	int key_frame = -1;                      // frame in prevImage, -1 while it is simply the previous one
+	vector<int> skipped;
+	int max_skip = (std::min)(max_skipped, ring_size - 2);
+
+	// Drawing and HighGUI run on the view's own thread, which drops camera frames rather than slow the tracking
+	std::unique_ptr<TrajectoryView> view;
+	if (!headless)
+		view.reset(new TrajectoryView(imread("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/images/output/VO/ground.png", 1)));  // Change dir here
+	for (int numFrame = 0; numFrame < frame_count; numFrame++) {
 		
-		sprintf(filename, "C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/VO/00/image_0/%06d.png", numFrame);  // Change dir here
+		if (!frames.frame(numFrame, currImage)) {
+			std::cout << " --(!) Error reading frame " << numFrame << std::endl;
+			break;
+		}
+		if (keyframe_motion > 0 && (int)skipped.size() < max_skip) {
+			double motion = tracks.probeMotion(prevImage, currImage);
+			if (motion >= 0 && motion < keyframe_motion) {
+				skipped.push_back(numFrame);
+				report.skipped++;
+				continue;
+			}
+		}
 
-		Mat currImage_c = imread(filename);
-		cvtColor(currImage_c, currImage, COLOR_BGR2GRAY);
-		vector<uchar> status;
-		featureTracking(prevImage, currImage, prevFeatures, currFeatures, status);
+		tracks.track(prevImage, currImage);
 		
-		E = findEssentialMat(currFeatures, prevFeatures, focal, pp, RANSAC, 0.999, 1.0, mask);
-		recoverPose(E, currFeatures, prevFeatures, R, t, focal, pp, mask);
-
-		Mat prevPts(2, prevFeatures.size(), CV_64F), currPts(2, currFeatures.size(), CV_64F);
-
-		for (int i = 0; i<prevFeatures.size(); i++) {   //this (x,y) combination makes sense as observed from the source code of triangulatePoints on GitHub
-			prevPts.at<double>(0, i) = prevFeatures.at(i).x;
-			prevPts.at<double>(1, i) = prevFeatures.at(i).y;
-
-			currPts.at<double>(0, i) = currFeatures.at(i).x;
-			currPts.at<double>(1, i) = currFeatures.at(i).y;
+		tracks.quality(quality);
+		E = findEssentialMatProsac(tracks.current(), tracks.previous(), quality, focal, pp, mask, essential);
+		recoverPose(E, tracks.current(), tracks.previous(), R, t, focal, pp, mask);
+
+		// Ground truth distance from the keyframe, one frame unless frames were skipped
+		scale = skipped.empty() ? poses.scale(numFrame) : poses.distance(key_frame, numFrame);
+		Mat R_key, t_key;
+		if (!skipped.empty()) {
+			R_key = R_f.clone();
+			t_key = t_f.clone();
 		}
-
-		scale = getAbsoluteScale(numFrame, 0, t.at<double>(2));
 		
 		if ((scale>0.1) && (t.at<double>(2) > t.at<double>(0)) && (t.at<double>(2) > t.at<double>(1))) {
 
@@ -237,38 +318,60 @@ int Odometry::run() {
 			//cout << "scale below 0.1, or incorrect translation" << endl;
 		}
 
-		// lines for printing results
-		// myfile << t_f.at<double>(0) << " " << t_f.at<double>(1) << " " << t_f.at<double>(2) << endl;
+		// Skipped frames are placed along the translation between the two keyframes, with the earlier rotation
+		for (size_t s = 0; s < skipped.size(); s++) {
+			double alpha = (double)(skipped[s] - key_frame) / (numFrame - key_frame);
+			record(skipped[s], R_key, t_key + alpha * (t_f - t_key));
+		}
+		skipped.clear();
+		record(numFrame, R_f, t_f);
+		report.path_length += scale;
 
 		// a redetection is triggered in case the number of feautres being tracked go below a particular threshold
-		if (prevFeatures.size() < MIN_NUM_FEAT) {
-			featureDetection(prevImage, prevFeatures);
-			featureTracking(prevImage, currImage, prevFeatures, currFeatures, status);
+		if (tracks.size() < MIN_NUM_FEAT) {
+			if (bucketed_redetection) {
+				// Only the cells that lost their tracks are detected again, in the current frame; live tracks are kept
+				bucketedRedetection(currImage, tracks, GRID_COLS, GRID_ROWS, 2 * MIN_NUM_FEAT / (GRID_COLS * GRID_ROWS));
+			}
+			else {
+				featureDetection(prevImage, points1, &responses);
+				tracks.reset(points1, responses);
+				tracks.track(prevImage, currImage);
+			}
 		}
 
-		prevImage = currImage.clone();
-		prevFeatures.clear();
-		prevFeatures = currFeatures;
-		currFeatures.clear(); // FS added to try to solve memory overflow when running on many frames
-
-		int x = int(t_f.at<double>(0)) + 300;
-		int y = int(t_f.at<double>(2)) + 100;
-		circle(traj, Point(x, y), 1, CV_RGB(0, 0, 255), 1);
-
-		rectangle(traj, Point(10, 30), Point(550, 50), CV_RGB(0, 0, 0), CV_FILLED);
-		sprintf(text, "Coordinates: x = %02fm y = %02fm z = %02fm", t_f.at<double>(0), t_f.at<double>(1), t_f.at<double>(2));
-		putText(traj, text, textOrg, fontFace, fontScale, Scalar::all(255), thickness, 8);
-
-		imshow("Road facing camera", currImage_c);
-		imshow("Trajectory", traj);
-
-		waitKey(1);
+		// The previous frame's buffer goes back to the reader and the tracks swap positions, nothing is copied
+		frames.release(numFrame - 1);
+		prevImage = currImage;
+		key_frame = numFrame;
+		tracks.advance();
 
+		if (view)
+			view->update(currImage, Vec3d(t_f.at<double>(0), t_f.at<double>(1), t_f.at<double>(2)));
 	}
 
+	// Frames skipped at the end keep the last pose
+	for (size_t s = 0; s < skipped.size(); s++)
+		record(skipped[s], R_f, t_f);
+
 	clock_t end = clock();
 	double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
-	cout << "Total time taken: " << elapsed_secs << "s" << endl;
+	report.seconds = (double)(getTickCount() - start) / getTickFrequency();
+	if (report.frames > 0)
+		report.rmse = sqrt(squared_error / report.frames);
+	if (report.path_length > 0)
+		report.drift_percent = 100.0 * report.final_error / report.path_length;
+	if (verbose) {
+		cout << "Total time taken: " << elapsed_secs << "s" << endl;
+		if (report.skipped > 0)
+			cout << report.skipped << " frames skipped as stationary" << endl;
+		cout << tracks.pyramidBuilds() << " LK pyramids built" << endl;
+		cout << "Final position error " << report.final_error << " m over " << report.path_length << " m (" << report.drift_percent << "%)" << endl;
+	}
+	if (view)
+		cout << view->shownFrames() << " frames shown, " << view->droppedFrames() << " dropped by the display" << endl;
+	if (pose_writer.isOpen())
+		cout << "Poses written to " << pose_output << endl;
 
 	return 0;
 }
@@ -276,12 +379,12 @@ int Odometry::run() {
 // Added by FS to draw the groundtruth path
 int Odometry::runGroundTruth() {
 	cout << "Start";
-	vector<Mat> poses = loadPoses("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/evaluation/VO/00.txt");  // Change dir here
+	PoseStore poses;
+	if (!poses.load(pose_file))
+		return -1;
 	cout << "Poses loaded!";
 
-	Mat R_f, t_f; 
-
-	double scale = 1.00;
+	Vec3d t_f;
 
 	char text[100];
 	int fontFace = FONT_HERSHEY_PLAIN;
@@ -291,14 +394,11 @@ int Odometry::runGroundTruth() {
 
 	double focal = 718.8560;
 	cv::Point2d pp(607.1928, 185.2157);
-	//recovering the pose and the essential matrix
-	Mat R, t, mask;
 
-	R_f = poses[0].colRange(0,3);
-	t_f = poses[0].col(3);
+	t_f = poses.translation(0);
 
 	cout << "T_f: " << t_f << "\n";
-	cout << "R_f: " << R_f;
+	cout << "R_f: " << poses.rotation(0);
 
 	clock_t begin = clock();
 
@@ -310,17 +410,14 @@ int Odometry::runGroundTruth() {
 	cout << "# POSES: " << poses.size();
 	for (int row = 1; row < poses.size(); row++) {
 
-		R_f = poses[row].colRange(0, 3);
-		t_f = poses[row].col(3);
-				
-		scale = getAbsoluteScale(row+1, 0, t_f.at<double>(2)); // If error check this line for +1
+		t_f = poses.translation(row);
 
-		int x = int(t_f.at<double>(0)) + 300;
-		int y = int(t_f.at<double>(2)) + 100;
+		int x = int(t_f[0]) + 300;
+		int y = int(t_f[2]) + 100;
 		circle(traj, Point(x, y), 1, CV_RGB(0, 255, 0), 2);
 
 		rectangle(traj, Point(10, 30), Point(550, 50), CV_RGB(0, 0, 0), CV_FILLED);
-		sprintf(text, "Coordinates: x = %02fm y = %02fm z = %02fm", t_f.at<double>(0), t_f.at<double>(1), t_f.at<double>(2));
+		sprintf(text, "Coordinates: x = %02fm y = %02fm z = %02fm", t_f[0], t_f[1], t_f[2]);
 		putText(traj, text, textOrg, fontFace, fontScale, Scalar::all(255), thickness, 8);
 
 		imshow("Trajectory", traj);
@@ -0,0 +1,171 @@
+/*!
+\file OdometryRunner.cpp
+\brief Runs the visual odometry over a list of sequences concurrently, with per-sequence timing and drift reports
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "OdometryRunner.h"
+#include "BatchEvaluator.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <fstream>
+
+bool readSequenceList(const std::string& path, std::vector<SequenceEntry>& entries)
+{
+	std::ifstream in(path.c_str());
+	if (!in.is_open()) {
+		printf("Could not open sequence list %s\n", path.c_str());
+		return false;
+	}
+
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+
+	std::string line;
+	int line_no = 0;
+	while (std::getline(in, line)) {
+		line_no++;
+		std::vector<std::string> fields = splitFields(line);
+		if (fields.empty())
+			continue;
+		if (fields.size() != 4) {
+			printf("%s:%d: expected <name> <image pattern> <calib.txt> <poses>\n", path.c_str(), line_no);
+			return false;
+		}
+		for (int f = 1; f < 4; f++) {
+			if (!isAbsolutePath(fields[f]))
+				fields[f] = directory + fields[f];
+		}
+
+		SequenceEntry entry;
+		entry.name = fields[0];
+		entry.image_pattern = fields[1];
+		entry.calib_path = fields[2];
+		entry.pose_path = fields[3];
+		entry.line = line_no;
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+int writeSequenceList(const std::string& root, const std::string& path)
+{
+	std::ofstream out(path.c_str());
+	if (!out.is_open())
+		return -1;
+
+	out << "# KITTI odometry training sequences under " << root << "\n";
+	char num[16];
+	for (int i = 0; i <= 10; i++) {
+		sprintf(num, "%02d", i);
+		out << num << " \"" << root << "/sequences/" << num << "/image_0/%06d.png\" \"" << root << "/sequences/" << num
+			<< "/calib.txt\" \"" << root << "/poses/" << num << ".txt\"\n";
+	}
+	return 11;
+}
+
+std::vector<SequenceReport> runSequences(const std::vector<SequenceEntry>& entries, const std::string& output_dir, int threads,
+	int frame_budget)
+{
+	std::vector<SequenceReport> reports(entries.size());
+	if (entries.empty())
+		return reports;
+
+	ThreadPool pool(threads);
+	int workers = (std::min)(pool.size(), (int)entries.size());
+
+	// Each running sequence holds its reader's ring; two frames are always held, one more is decoded ahead
+	int ring_size = (std::max)(3, frame_budget / workers);
+
+	SerialOpenCVScope serial_opencv(workers);
+
+	std::atomic<size_t> next(0);
+	std::atomic<int> done(0);
+	for (int w = 0; w < workers; w++) {
+		pool.submit([&]() {
+			for (;;) {
+				size_t i = next++;
+				if (i >= entries.size())
+					break;
+				const SequenceEntry& entry = entries[i];
+
+				// A fresh Odometry per sequence, nothing carries over between them
+				Odometry vo;
+				vo.headless = true;
+				vo.verbose = false;
+				vo.image_pattern = entry.image_pattern;
+				vo.pose_file = entry.pose_path;
+				vo.max_frame = -1;
+				vo.ring_size = ring_size;
+				if (!output_dir.empty())
+					vo.pose_output = output_dir + "/" + entry.name + ".txt";
+
+				if (!vo.loadCalibration(entry.calib_path)) {
+					reports[i].status = -1;
+				}
+				else {
+					try {
+						reports[i].status = vo.run();
+					}
+					catch (const std::exception& ex) {
+						printf("Sequence list line %d: %s\n", entry.line, ex.what());
+						reports[i].status = -1;
+					}
+					catch (...) {
+						printf("Sequence list line %d: unknown error\n", entry.line);
+						reports[i].status = -1;
+					}
+				}
+				reports[i].odometry = vo.report;
+
+				const OdometryReport& r = vo.report;
+				printf("  %s: %d frames in %.1f s (%.1f fps), drift %.2f%%  [%d / %d]\n", entry.name.c_str(), r.frames, r.seconds,
+					r.seconds > 0 ? r.frames / r.seconds : 0.0, r.drift_percent, ++done, (int)entries.size());
+			}
+		});
+	}
+	pool.wait();
+	return reports;
+}
+
+int runOdometryBatch(const std::string& list, const std::string& output_dir, int threads, const std::string& output_csv, int frame_budget)
+{
+	std::vector<SequenceEntry> entries;
+	if (!readSequenceList(list, entries))
+		return -1;
+
+	printf("Running odometry on %d sequences from %s\n", (int)entries.size(), list.c_str());
+	int64 start = getTickCount();
+	std::vector<SequenceReport> reports = runSequences(entries, output_dir, threads, frame_budget);
+	double wall = (double)(getTickCount() - start) / getTickFrequency();
+
+	std::ofstream csv(output_csv.c_str());
+	csv << "sequence,status,frames,skipped,time_s,fps,path_m,final_error_m,drift_percent,rmse_m\n";
+
+	int failures = 0, frames = 0;
+	double seconds = 0;
+	printf("\n%-10s %8s %10s %8s %10s %10s %9s %9s\n", "sequence", "frames", "time (s)", "fps", "path (m)", "error (m)", "drift %", "rmse (m)");
+	for (size_t i = 0; i < reports.size(); i++) {
+		const OdometryReport& r = reports[i].odometry;
+		double fps = r.seconds > 0 ? r.frames / r.seconds : 0.0;
+		csv << entries[i].name << "," << reports[i].status << "," << r.frames << "," << r.skipped << "," << r.seconds << "," << fps << ","
+			<< r.path_length << "," << r.final_error << "," << r.drift_percent << "," << r.rmse << "\n";
+		if (reports[i].status != 0) {
+			failures++;
+			printf("%-10s failed\n", entries[i].name.c_str());
+			continue;
+		}
+		printf("%-10s %8d %10.1f %8.1f %10.1f %10.2f %9.2f %9.2f\n", entries[i].name.c_str(), r.frames, r.seconds, fps, r.path_length,
+			r.final_error, r.drift_percent, r.rmse);
+		frames += r.frames;
+		seconds += r.seconds;
+	}
+
+	printf("\n%d frames of %d sequences in %.1f s wall time (%.1f s of tracking)\n", frames, (int)entries.size() - failures, wall, seconds);
+	if (failures > 0)
+		printf("%d sequences failed\n", failures);
+	printf("Per-sequence reports written to %s\n", output_csv.c_str());
+	return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,64 @@
+/*!
+\file OdometryRunner.h
+\brief Runs the visual odometry over a list of sequences concurrently, with per-sequence timing and drift reports
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "vo_features.h"
+
+#include <string>
+#include <vector>
+
+// One sequence of a sequence list. Lines read
+//     <name> <image pattern> <calib.txt> <poses>
+// with fields separated by whitespace and quoted with "" when a path contains spaces, as in a flow manifest.
+// The image pattern is a printf pattern of the grey left frames, calib.txt a KITTI calibration file (its P0
+// line gives the camera) and poses the ground truth in KITTI text or .dgp form. Relative paths are taken
+// relative to the list's directory; # starts a comment.
+struct SequenceEntry {
+	std::string name;
+	std::string image_pattern, calib_path, pose_path;
+	int line;			// line number in the list, for error messages
+};
+
+// Result of one sequence
+struct SequenceReport {
+	int status = -1;	// return value of Odometry::run, -1 until it finishes or if the calibration could not be read
+	OdometryReport odometry;
+};
+
+/*!
+\param path sequence list
+\param entries output, sequences in list order
+\return false (with a message) if the list cannot be read or a line is malformed
+*/
+bool readSequenceList(const std::string& path, std::vector<SequenceEntry>& entries);
+
+// Writes a sequence list for the KITTI odometry training sequences 00-10 under root
+// (root/sequences/NN/image_0, root/sequences/NN/calib.txt, root/poses/NN.txt)
+/*!
+\return number of sequences written, -1 if the list cannot be written
+*/
+int writeSequenceList(const std::string& root, const std::string& path);
+
+// Runs every sequence headless as a job of one thread pool. Each job owns its Odometry (tracks, reader and
+// pose writer), so sequences share nothing but the pool. Decoded frames are the bulk of a run's memory: the
+// frame budget is split between the sequences running at once, which bounds the total whatever the list length.
+/*!
+\param entries sequences to run
+\param output_dir if not empty, each sequence's estimated poses are written to output_dir/<name>.txt
+\param threads sequences run at once, <= 0 for one per hardware thread
+\param frame_budget decoded frames held over all running sequences
+\return reports in list order
+*/
+std::vector<SequenceReport> runSequences(const std::vector<SequenceEntry>& entries, const std::string& output_dir, int threads = 0,
+	int frame_budget = 64);
+
+// Command line entry, prints a report per sequence and writes them to output_csv
+/*!
+\return 0 if every sequence ran, -1 otherwise
+*/
+int runOdometryBatch(const std::string& list, const std::string& output_dir, int threads, const std::string& output_csv,
+	int frame_budget = 64);
@@ -0,0 +1,537 @@
+/*!
+\file ParameterSweep.cpp
+\brief Grid search over DegrafFlowParams with per-stage result reuse and successive halving over the data set
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "ParameterSweep.h"
+#include "FlowMetrics.h"
+#include "ThreadPool.h"
+
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+
+// Sweepable DegrafFlowParams fields, with the pipeline stage each one belongs to
+struct SweepField {
+	const char* name;
+	int stage;
+	int DegrafFlowParams::* i;
+	float DegrafFlowParams::* f;
+	bool DegrafFlowParams::* b;
+};
+
+static const SweepField sweep_fields[] = {
+	{ "saliency_levels", SWEEP_DETECTION, &DegrafFlowParams::saliency_levels, NULL, NULL },
+	{ "window_width", SWEEP_DETECTION, &DegrafFlowParams::window_width, NULL, NULL },
+	{ "window_height", SWEEP_DETECTION, &DegrafFlowParams::window_height, NULL, NULL },
+	{ "step_x", SWEEP_DETECTION, &DegrafFlowParams::step_x, NULL, NULL },
+	{ "step_y", SWEEP_DETECTION, &DegrafFlowParams::step_y, NULL, NULL },
+	{ "max_points", SWEEP_DETECTION, &DegrafFlowParams::max_points, NULL, NULL },
+	{ "rlof_small_win", SWEEP_TRACKING, &DegrafFlowParams::rlof_small_win, NULL, NULL },
+	{ "rlof_large_win", SWEEP_TRACKING, &DegrafFlowParams::rlof_large_win, NULL, NULL },
+	{ "rlof_max_level", SWEEP_TRACKING, &DegrafFlowParams::rlof_max_level, NULL, NULL },
+	{ "rlof_max_iter", SWEEP_TRACKING, &DegrafFlowParams::rlof_max_iter, NULL, NULL },
+	{ "max_flow_length", SWEEP_TRACKING, &DegrafFlowParams::max_flow_length, NULL, NULL },
+	{ "k", SWEEP_INTERPOLATION, &DegrafFlowParams::k, NULL, NULL },
+	{ "sigma", SWEEP_INTERPOLATION, NULL, &DegrafFlowParams::sigma, NULL },
+	{ "use_post_proc", SWEEP_FGS, NULL, NULL, &DegrafFlowParams::use_post_proc },
+	{ "fgs_lambda", SWEEP_FGS, NULL, &DegrafFlowParams::fgs_lambda, NULL },
+	{ "fgs_sigma", SWEEP_FGS, NULL, &DegrafFlowParams::fgs_sigma, NULL },
+};
+static const int SWEEP_FIELD_COUNT = sizeof(sweep_fields) / sizeof(sweep_fields[0]);
+
+static const char* stage_names[SWEEP_STAGE_COUNT] = { "detection", "tracking", "interpolation", "fgs" };
+
+static double fieldValue(const DegrafFlowParams& params, const SweepField& field)
+{
+	if (field.i)
+		return params.*field.i;
+	if (field.f)
+		return params.*field.f;
+	return params.*field.b ? 1.0 : 0.0;
+}
+
+static void setField(DegrafFlowParams& params, const SweepField& field, double value)
+{
+	if (field.i)
+		params.*field.i = cvRound(value);
+	else if (field.f)
+		params.*field.f = (float)value;
+	else
+		params.*field.b = value != 0.0;
+}
+
+// "step" and "window" set both the x and y field
+static bool setParam(DegrafFlowParams& params, const std::string& name, double value)
+{
+	if (name == "step")
+		return setParam(params, "step_x", value) && setParam(params, "step_y", value);
+	if (name == "window")
+		return setParam(params, "window_width", value) && setParam(params, "window_height", value);
+	for (int f = 0; f < SWEEP_FIELD_COUNT; f++) {
+		if (name == sweep_fields[f].name) {
+			setField(params, sweep_fields[f], value);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool readSweepGrid(const std::string& path, DegrafFlowParams& base, std::vector<SweepAxis>& axes)
+{
+	std::ifstream in(path.c_str());
+	if (!in.is_open()) {
+		printf("Could not open grid file %s\n", path.c_str());
+		return false;
+	}
+
+	base = DegrafFlowParams::preset(DegrafFlowParams::PRESET_BALANCED);
+	axes.clear();
+	std::string line;
+	int line_no = 0;
+	while (std::getline(in, line)) {
+		line_no++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.resize(comment);
+		std::istringstream fields(line);
+		std::string name;
+		if (!(fields >> name))
+			continue;
+
+		if (name == "preset") {
+			std::string preset;
+			fields >> preset;
+			int p = DegrafFlowParams::PRESET_ULTRAFAST;
+			while (p <= DegrafFlowParams::PRESET_ACCURATE && preset != DegrafFlowParams::presetName(p))
+				p++;
+			if (p > DegrafFlowParams::PRESET_ACCURATE) {
+				printf("%s:%d: unknown preset %s\n", path.c_str(), line_no, preset.c_str());
+				return false;
+			}
+			base = DegrafFlowParams::preset(p);
+			continue;
+		}
+
+		SweepAxis axis;
+		axis.name = name;
+		double value;
+		while (fields >> value)
+			axis.values.push_back(value);
+		DegrafFlowParams check;
+		if (axis.values.empty() || !fields.eof() || !setParam(check, name, axis.values[0])) {
+			printf("%s:%d: expected <parameter> <value> [<value> ...]\n", path.c_str(), line_no);
+			return false;
+		}
+		axes.push_back(axis);
+	}
+	return true;
+}
+
+std::vector<DegrafFlowParams> expandSweepGrid(const DegrafFlowParams& base, const std::vector<SweepAxis>& axes)
+{
+	std::vector<DegrafFlowParams> configs(1, base);
+	for (size_t a = 0; a < axes.size(); a++) {
+		std::vector<DegrafFlowParams> expanded;
+		for (size_t c = 0; c < configs.size(); c++) {
+			for (size_t v = 0; v < axes[a].values.size(); v++) {
+				DegrafFlowParams params = configs[c];
+				setParam(params, axes[a].name, axes[a].values[v]);
+				expanded.push_back(params);
+			}
+		}
+		configs.swap(expanded);
+	}
+	return configs;
+}
+
+ParameterSweep::ParameterSweep(const std::vector<ManifestEntry>& p_entries)
+	: entries(&p_entries), cache(NULL), pair_count((int)p_entries.size())
+{
+	for (int s = 0; s < SWEEP_STAGE_COUNT; s++)
+		computed[s] = reused[s] = 0;
+}
+
+ParameterSweep::ParameterSweep(const DatasetCache& p_cache)
+	: entries(NULL), cache(&p_cache), pair_count(p_cache.size())
+{
+	for (int s = 0; s < SWEEP_STAGE_COUNT; s++)
+		computed[s] = reused[s] = 0;
+}
+
+bool ParameterSweep::loadPair(int p, Mat& i1, Mat& i2, Mat& ground_truth, Mat& mask) const
+{
+	if (cache != NULL) {
+		const DatasetCache::Pair& pair = cache->pair(p);
+		i1 = pair.i1;
+		i2 = pair.i2;
+		ground_truth = pair.ground_truth;
+		mask = pair.regionMask(region);
+		if (ground_truth.empty())
+			printf("Pair %s has no ground truth, skipped\n", pair.name.c_str());
+		return !ground_truth.empty();
+	}
+
+	const ManifestEntry& entry = (*entries)[p];
+	if (entry.groundtruth_path.empty()) {
+		printf("Manifest line %d has no ground truth, skipped\n", entry.line);
+		return false;
+	}
+	if (!loadManifestPair(entry, i1, i2, ground_truth))
+		return false;
+	return EvaluateOptFlow::regionMask(region, ground_truth, i1, mask);
+}
+
+// Evaluates the configurations todo (sorted by stage key) on pair p. Detection and tracking outputs are
+// memoised by key for the whole pair; the dense flow of the last interpolation key is kept, which with
+// sorted keys is enough for every configuration that shares it.
+void ParameterSweep::evaluatePair(FeatureMatcher& matcher, int p, const std::vector<int>& todo)
+{
+	Mat i1, i2, ground_truth, mask;
+	if (!loadPair(p, i1, i2, ground_truth, mask)) {
+		for (size_t t = 0; t < todo.size(); t++)
+			scores[todo[t]][p].done = true;
+		return;
+	}
+
+	struct Points {
+		vector<Point2f> points;
+		double seconds;
+	};
+	struct Matches {
+		vector<Point2f> from, to;
+		double seconds;
+	};
+	std::map<std::string, Points> points;
+	std::map<std::string, Matches> matches;
+	std::string flow_key, score_key;
+	Mat raw_flow, flow;
+	double flow_seconds = 0;
+	PairScore last_score;
+
+	for (size_t t = 0; t < todo.size(); t++) {
+		int c = todo[t];
+		const DegrafFlowParams& params = configs[c];
+
+		// Configurations that only differ in parameters that have no effect (e.g. fgs_lambda without FGS)
+		if (keys[SWEEP_FGS][c] == score_key) {
+			scores[c][p] = last_score;
+			stage_reused[SWEEP_FGS]++;
+			continue;
+		}
+
+		std::map<std::string, Points>::iterator detected = points.find(keys[SWEEP_DETECTION][c]);
+		if (detected == points.end()) {
+			detected = points.insert(std::make_pair(keys[SWEEP_DETECTION][c], Points())).first;
+			matcher.stage_times = DegrafStageTimes();
+			matcher.degraf_detect(i1, detected->second.points, params);
+			detected->second.seconds = matcher.stage_times.detection;
+			stage_computed[SWEEP_DETECTION]++;
+		}
+		else {
+			stage_reused[SWEEP_DETECTION]++;
+		}
+
+		std::map<std::string, Matches>::iterator tracked = matches.find(keys[SWEEP_TRACKING][c]);
+		if (tracked == matches.end()) {
+			tracked = matches.insert(std::make_pair(keys[SWEEP_TRACKING][c], Matches())).first;
+			matcher.stage_times = DegrafStageTimes();
+			matcher.degraf_track(i1, i2, detected->second.points, params);
+			tracked->second.from.swap(matcher.points_filtered);
+			tracked->second.to.swap(matcher.dst_points_filtered);
+			tracked->second.seconds = matcher.stage_times.tracking;
+			stage_computed[SWEEP_TRACKING]++;
+		}
+		else {
+			stage_reused[SWEEP_TRACKING]++;
+		}
+
+		if (keys[SWEEP_INTERPOLATION][c] != flow_key) {
+			DegrafFlowParams interpolation_params = params;
+			interpolation_params.use_post_proc = false;
+			matcher.stage_times = DegrafStageTimes();
+			matcher.points_filtered.swap(tracked->second.from);
+			matcher.dst_points_filtered.swap(tracked->second.to);
+			matcher.degraf_interpolate(i1, i2, raw_flow, interpolation_params);
+			matcher.points_filtered.swap(tracked->second.from);
+			matcher.dst_points_filtered.swap(tracked->second.to);
+			flow_seconds = matcher.stage_times.interpolation;
+			flow_key = keys[SWEEP_INTERPOLATION][c];
+			stage_computed[SWEEP_INTERPOLATION]++;
+		}
+		else {
+			stage_reused[SWEEP_INTERPOLATION]++;
+		}
+
+		double fgs_seconds = 0;
+		if (params.use_post_proc) {
+			raw_flow.copyTo(flow);
+			matcher.stage_times = DegrafStageTimes();
+			matcher.degraf_post_process(i1, flow, params);
+			fgs_seconds = matcher.stage_times.interpolation;
+		}
+		else {
+			// A copy, not a shared header: FGS of a later configuration smooths flow in place and must not
+			// reach the cached interpolation
+			raw_flow.copyTo(flow);
+		}
+		stage_computed[SWEEP_FGS]++;
+
+		FlowMetrics metrics;
+		computeFlowMetrics(flow, ground_truth, mask, metrics);
+
+		PairScore& score = scores[c][p];
+		score.done = true;
+		score.valid = metrics.valid_pixels > 0;
+		score.epe = (float)metrics.epe_mean;
+		score.fl = metrics.fl;
+		score.r3 = metrics.R[3];
+		score.seconds = detected->second.seconds + tracked->second.seconds + flow_seconds + fgs_seconds;
+		last_score = score;
+		score_key = keys[SWEEP_FGS][c];
+	}
+}
+
+// Evaluates the alive configurations on pairs, skipping (configuration, pair) results of earlier rungs
+void ParameterSweep::evaluateRung(const std::vector<int>& alive, const std::vector<int>& pairs)
+{
+	std::vector<std::vector<int> > todo(pairs.size());
+	for (size_t j = 0; j < pairs.size(); j++) {
+		for (size_t a = 0; a < alive.size(); a++) {
+			if (!scores[alive[a]][pairs[j]].done)
+				todo[j].push_back(alive[a]);
+		}
+		const std::vector<std::string>& order = keys[SWEEP_FGS];
+		std::sort(todo[j].begin(), todo[j].end(), [&](int x, int y) { return order[x] < order[y] || (order[x] == order[y] && x < y); });
+	}
+
+	ThreadPool pool(threads);
+	int workers = (std::min)(pool.size(), (int)pairs.size());
+
+	SerialOpenCVScope serial_opencv(workers);
+
+	std::atomic<size_t> next(0);
+	for (int w = 0; w < workers; w++) {
+		pool.submit([&]() {
+			FeatureMatcher matcher;
+			for (;;) {
+				size_t j = next++;
+				if (j >= pairs.size())
+					break;
+				if (todo[j].empty())
+					continue;
+				try {
+					evaluatePair(matcher, pairs[j], todo[j]);
+				}
+				catch (const std::exception& ex) {
+					printf("Pair %d: %s\n", pairs[j], ex.what());
+					for (size_t t = 0; t < todo[j].size(); t++)
+						scores[todo[j][t]][pairs[j]].done = true;
+				}
+				catch (...) {
+					printf("Pair %d: unknown error\n", pairs[j]);
+					for (size_t t = 0; t < todo[j].size(); t++)
+						scores[todo[j][t]][pairs[j]].done = true;
+				}
+			}
+		});
+	}
+	pool.wait();
+}
+
+double ParameterSweep::meanEPE(int c) const
+{
+	double sum = 0;
+	int n = 0;
+	for (int p = 0; p < pair_count; p++) {
+		if (scores[c][p].valid) {
+			sum += scores[c][p].epe;
+			n++;
+		}
+	}
+	return n > 0 ? sum / n : std::numeric_limits<double>::infinity();
+}
+
+std::vector<SweepResult> ParameterSweep::run(const std::vector<DegrafFlowParams>& p_configs)
+{
+	configs = p_configs;
+	int configuration_count = (int)configs.size();
+	scores.assign(configuration_count, std::vector<PairScore>(pair_count));
+	for (int s = 0; s < SWEEP_STAGE_COUNT; s++) {
+		stage_computed[s] = 0;
+		stage_reused[s] = 0;
+	}
+
+	// Stage keys: the parameter values of a stage appended to the key of the stage before it. Without
+	// post-processing the FGS parameters have no effect and are left out of the key.
+	for (int s = 0; s < SWEEP_STAGE_COUNT; s++)
+		keys[s].assign(configuration_count, std::string());
+	for (int c = 0; c < configuration_count; c++) {
+		std::ostringstream key;
+		key << std::setprecision(9);
+		for (int s = 0; s < SWEEP_STAGE_COUNT; s++) {
+			for (int f = 0; f < SWEEP_FIELD_COUNT; f++) {
+				if (sweep_fields[f].stage == s && (s != SWEEP_FGS || configs[c].use_post_proc || sweep_fields[f].b))
+					key << fieldValue(configs[c], sweep_fields[f]) << "|";
+			}
+			key << "/";
+			keys[s][c] = key.str();
+		}
+	}
+
+	// Fixed shuffle, so the pair subsets of the early rungs are spread over the data set
+	std::vector<int> order(pair_count);
+	for (int p = 0; p < pair_count; p++)
+		order[p] = p;
+	RNG rng(0x5eed);
+	for (int p = pair_count - 1; p > 0; p--)
+		std::swap(order[p], order[rng.uniform(0, p + 1)]);
+
+	int rung_count = (std::max)(rungs, 1);
+	int factor = (std::max)(eta, 2);
+	std::vector<int> alive(configuration_count);
+	for (int c = 0; c < configuration_count; c++)
+		alive[c] = c;
+	std::vector<int> rung_reached(configuration_count, 0);
+
+	for (int r = 0; r < rung_count && !alive.empty(); r++) {
+		int n = pair_count;
+		for (int k = r; k < rung_count - 1; k++)
+			n = (n + factor - 1) / factor;
+		n = (std::max)(n, (std::min)(pair_count, 1));
+
+		printf("Rung %d: %d configurations on %d pairs\n", r, (int)alive.size(), n);
+		evaluateRung(alive, std::vector<int>(order.begin(), order.begin() + n));
+		for (size_t a = 0; a < alive.size(); a++)
+			rung_reached[alive[a]] = r;
+
+		if (r + 1 < rung_count) {
+			std::vector<double> epe(configuration_count);
+			for (size_t a = 0; a < alive.size(); a++)
+				epe[alive[a]] = meanEPE(alive[a]);
+			std::stable_sort(alive.begin(), alive.end(), [&](int x, int y) { return epe[x] < epe[y]; });
+			alive.resize((std::max)((size_t)1, (alive.size() + factor - 1) / factor));
+			std::sort(alive.begin(), alive.end());
+		}
+	}
+
+	std::vector<SweepResult> results(configuration_count);
+	for (int c = 0; c < configuration_count; c++) {
+		SweepResult& result = results[c];
+		result.params = configs[c];
+		result.rung = rung_reached[c];
+		result.pairs = 0;
+		result.epe = result.fl = result.r3 = result.seconds = 0;
+		for (int p = 0; p < pair_count; p++) {
+			const PairScore& score = scores[c][p];
+			if (!score.valid)
+				continue;
+			result.pairs++;
+			result.epe += score.epe;
+			result.fl += score.fl;
+			result.r3 += score.r3;
+			result.seconds += score.seconds;
+		}
+		if (result.pairs > 0) {
+			result.epe /= result.pairs;
+			result.fl /= result.pairs;
+			result.r3 /= result.pairs;
+			result.seconds /= result.pairs;
+		}
+		else {
+			result.epe = result.fl = result.r3 = std::numeric_limits<double>::quiet_NaN();
+		}
+	}
+
+	for (int s = 0; s < SWEEP_STAGE_COUNT; s++) {
+		computed[s] = stage_computed[s];
+		reused[s] = stage_reused[s];
+	}
+	return results;
+}
+
+int runParameterSweep(const std::string& manifest, const std::string& grid, const std::string& output_csv, int rungs, int threads)
+{
+	DegrafFlowParams base;
+	std::vector<SweepAxis> axes;
+	if (!readSweepGrid(grid, base, axes))
+		return -1;
+	std::vector<DegrafFlowParams> configs = expandSweepGrid(base, axes);
+
+	std::vector<ManifestEntry> entries;
+	DatasetCache cache;
+	bool cached = isDatasetCache(manifest);
+	if (cached) {
+		if (!cache.open(manifest))
+			return -1;
+	}
+	else if (!readManifest(manifest, entries)) {
+		return -1;
+	}
+
+	std::unique_ptr<ParameterSweep> sweep(cached ? new ParameterSweep(cache) : new ParameterSweep(entries));
+	sweep->rungs = rungs;
+	sweep->threads = threads;
+
+	printf("Sweeping %d configurations over %d pairs from %s\n", (int)configs.size(), cached ? cache.size() : (int)entries.size(), manifest.c_str());
+	int64 start = getTickCount();
+	std::vector<SweepResult> results = sweep->run(configs);
+	double wall = (double)(getTickCount() - start) / getTickFrequency();
+
+	std::ofstream csv(output_csv.c_str());
+	if (!csv.is_open()) {
+		printf("Could not write %s\n", output_csv.c_str());
+		return -1;
+	}
+	for (int f = 0; f < SWEEP_FIELD_COUNT; f++)
+		csv << sweep_fields[f].name << ",";
+	csv << "rung,pairs,epe,fl,r3,time_s\n";
+	for (size_t c = 0; c < results.size(); c++) {
+		for (int f = 0; f < SWEEP_FIELD_COUNT; f++)
+			csv << fieldValue(results[c].params, sweep_fields[f]) << ",";
+		csv << results[c].rung << "," << results[c].pairs << ",";
+		if (results[c].pairs > 0)
+			csv << results[c].epe << "," << results[c].fl << "," << results[c].r3 << "," << results[c].seconds;
+		else
+			csv << ",,,";
+		csv << "\n";
+	}
+
+	// Best configurations: furthest rung first, then lowest EPE
+	std::vector<int> ranked(results.size());
+	for (size_t c = 0; c < results.size(); c++)
+		ranked[c] = (int)c;
+	std::stable_sort(ranked.begin(), ranked.end(), [&](int x, int y) {
+		if (results[x].rung != results[y].rung)
+			return results[x].rung > results[y].rung;
+		if (results[x].pairs == 0 || results[y].pairs == 0)
+			return results[x].pairs > results[y].pairs;
+		return results[x].epe < results[y].epe;
+	});
+
+	cout << "---------------   Parameter sweep  -------------------\n";
+	cout << "# config  pairs   EPE      Fl [%]   R3.0     time [s]   parameters\n";
+	for (size_t j = 0; j < ranked.size() && j < 10; j++) {
+		const SweepResult& r = results[ranked[j]];
+		printf("%8d %6d   %6.3f   %6.2f   %6.2f   %8.3f  ", ranked[j], r.pairs, r.epe, r.fl, r.r3, r.seconds);
+		for (size_t a = 0; a < axes.size(); a++) {
+			for (int f = 0; f < SWEEP_FIELD_COUNT; f++) {
+				// Aliases are reported through their x / width field
+				std::string name = axes[a].name == "step" ? "step_x" : axes[a].name == "window" ? "window_width" : axes[a].name;
+				if (name == sweep_fields[f].name)
+					printf(" %s=%g", axes[a].name.c_str(), fieldValue(r.params, sweep_fields[f]));
+			}
+		}
+		printf("\n");
+	}
+	for (int s = 0; s < SWEEP_STAGE_COUNT; s++)
+		printf("%-14s computed %8lld   reused %8lld\n", stage_names[s], sweep->computed[s], sweep->reused[s]);
+	printf("Sweep took %.1f s\n", wall);
+	cout << "Results written to " << output_csv << "\n";
+
+	return 0;
+}
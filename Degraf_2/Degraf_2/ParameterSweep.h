@@ -0,0 +1,113 @@
+/*!
+\file ParameterSweep.h
+\brief Grid search over DegrafFlowParams with per-stage result reuse and successive halving over the data set
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FeatureMatcher.h"
+#include "BatchEvaluator.h"
+#include "DatasetCache.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Stages of the RLOF pipeline whose outputs are reused between configurations. A stage's output only
+// depends on the pair and on the parameters of that stage and the stages before it.
+enum SweepStage { SWEEP_DETECTION = 0, SWEEP_TRACKING, SWEEP_INTERPOLATION, SWEEP_FGS, SWEEP_STAGE_COUNT };
+
+// One swept parameter: a DegrafFlowParams field name and the values it takes
+struct SweepAxis {
+	std::string name;
+	std::vector<double> values;
+};
+
+// Mean results of one configuration over the pairs it was evaluated on
+struct SweepResult {
+	DegrafFlowParams params;
+	int pairs;			// pairs evaluated, fewer than the data set if successive halving dropped the configuration
+	int rung;			// last successive halving rung reached
+	double epe, fl, r3;
+	double seconds;		// per pair, sum of the stage times of the stages this configuration uses
+};
+
+// Reads a grid file. Each line names a DegrafFlowParams field followed by its values, e.g.
+//     k 64 127 255
+//     fgs_lambda 250 500 1000
+// "preset <name>" sets the values of the parameters that are not swept; # starts a comment.
+/*!
+\param path grid file
+\param base output, preset the grid is applied to (balanced if not given)
+\param axes output, swept parameters in file order
+\return false if the file could not be read or names an unknown parameter
+*/
+bool readSweepGrid(const std::string& path, DegrafFlowParams& base, std::vector<SweepAxis>& axes);
+
+// Cartesian product of the axes applied to base, the last axis varies fastest
+std::vector<DegrafFlowParams> expandSweepGrid(const DegrafFlowParams& base, const std::vector<SweepAxis>& axes);
+
+// Evaluates many configurations of degraf_flow_rlof on a set of pairs. Per pair, configurations are
+// visited in order of their stage keys and every stage output is memoised under (pair, stage parameters
+// and upstream parameters), so e.g. a sweep over fgs_lambda runs detection, tracking and interpolation
+// once per pair. Sparse stage outputs are kept for the duration of the pair; dense flows only while
+// configurations sharing them are consecutive.
+//
+// With rungs > 1, successive halving is used: rung r evaluates the surviving configurations on the first
+// N / eta^(rungs-1-r) pairs of a fixed shuffle of the data set and keeps the best 1/eta by mean EPE. Pair
+// results of earlier rungs are reused, only the new pairs are evaluated.
+class ParameterSweep {
+
+	public:
+		ParameterSweep(const std::vector<ManifestEntry>& p_entries);
+		ParameterSweep(const DatasetCache& p_cache);
+
+		String region = "all";		// evaluation region, see EvaluateOptFlow::region
+		int threads = 0;			// concurrent pairs, <= 0 for one per hardware thread
+		int rungs = 1;
+		int eta = 3;
+
+		/*!
+		\param configs configurations to evaluate
+		\return one result per configuration, in the order of configs
+		*/
+		std::vector<SweepResult> run(const std::vector<DegrafFlowParams>& configs);
+
+		// Number of times each stage was computed and reused during the last run
+		long long computed[SWEEP_STAGE_COUNT];
+		long long reused[SWEEP_STAGE_COUNT];
+
+	private:
+		struct PairScore {
+			bool done = false;
+			bool valid = false;
+			float epe = 0, fl = 0, r3 = 0;
+			double seconds = 0;
+		};
+
+		const std::vector<ManifestEntry>* entries;
+		const DatasetCache* cache;
+		int pair_count;
+
+		std::vector<DegrafFlowParams> configs;
+		std::vector<std::string> keys[SWEEP_STAGE_COUNT];	// per configuration, key of each stage including upstream stages
+		std::vector<std::vector<PairScore> > scores;		// [configuration][pair]
+		std::atomic<long long> stage_computed[SWEEP_STAGE_COUNT], stage_reused[SWEEP_STAGE_COUNT];
+
+		bool loadPair(int p, Mat& i1, Mat& i2, Mat& ground_truth, Mat& mask) const;
+		void evaluatePair(FeatureMatcher& matcher, int p, const std::vector<int>& todo);
+		void evaluateRung(const std::vector<int>& alive, const std::vector<int>& pairs);
+		double meanEPE(int c) const;
+};
+
+// Command line entry, prints the best configurations and writes every configuration to output_csv
+/*!
+\param manifest manifest or dataset cache (.dgc)
+\param grid grid file, see readSweepGrid
+\param output_csv results file
+\param rungs successive halving rungs, 1 evaluates every configuration on every pair
+\param threads concurrent pairs, <= 0 for one per hardware thread
+\return 0 on success, -1 on error
+*/
+int runParameterSweep(const std::string& manifest, const std::string& grid, const std::string& output_csv, int rungs = 1, int threads = 0);
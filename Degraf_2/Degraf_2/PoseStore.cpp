@@ -0,0 +1,193 @@
+/*!
+\file PoseStore.cpp
+\brief Ground truth camera poses of a KITTI odometry sequence, parsed once into a contiguous array
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "PoseStore.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static const char POSE_MAGIC[8] = { 'D', 'G', 'F', 'P', 'O', 'S', 'E', 'S' };
+static const unsigned int POSE_VERSION = 1;
+
+#pragma pack(push, 1)
+struct PoseHeader {
+	char magic[8];
+	unsigned int version;
+	unsigned int pose_count;
+	unsigned long long reserved;	// keeps the poses 8 byte aligned
+};
+#pragma pack(pop)
+
+bool isPoseCache(const std::string& path)
+{
+	return path.size() > 4 && path.substr(path.size() - 4) == ".dgp";
+}
+
+PoseStore::PoseStore()
+{
+	values = NULL;
+	count = 0;
+}
+
+bool PoseStore::load(const std::string& path)
+{
+	parsed.clear();
+	file.close();
+	values = NULL;
+	count = 0;
+	return isPoseCache(path) ? loadBinary(path) : loadText(path);
+}
+
+// The whole file is read at once and parsed with strtod in a single pass
+bool PoseStore::loadText(const std::string& path)
+{
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in.is_open()) {
+		printf("Unable to open pose file %s\n", path.c_str());
+		return false;
+	}
+	std::ostringstream contents;
+	contents << in.rdbuf();
+	std::string text = contents.str();
+
+	int line = 1;
+	const char* c = text.c_str();
+	for (;;) {
+		while (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n') {
+			if (*c == '\n')
+				line++;
+			c++;
+		}
+		if (*c == '\0')
+			break;
+
+		for (int v = 0; v < POSE_VALUES; v++) {
+			char* end;
+			double value = strtod(c, &end);
+			if (end == c) {
+				printf("%s line %d: expected %d pose values\n", path.c_str(), line, POSE_VALUES);
+				parsed.clear();
+				return false;
+			}
+			parsed.push_back(value);
+			c = end;
+		}
+	}
+
+	values = parsed.empty() ? NULL : &parsed[0];
+	count = (int)(parsed.size() / POSE_VALUES);
+	return true;
+}
+
+bool PoseStore::loadBinary(const std::string& path)
+{
+	if (!file.open(path)) {
+		printf("Could not map %s\n", path.c_str());
+		return false;
+	}
+	PoseHeader header;
+	if (file.size() < sizeof(header))
+		return false;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, POSE_MAGIC, sizeof(POSE_MAGIC)) != 0 || header.version != POSE_VERSION) {
+		printf("%s is not a pose cache of version %u\n", path.c_str(), POSE_VERSION);
+		file.close();
+		return false;
+	}
+	if (file.size() < sizeof(header) + (size_t)header.pose_count * POSE_VALUES * sizeof(double)) {
+		printf("%s is truncated\n", path.c_str());
+		file.close();
+		return false;
+	}
+
+	values = (const double*)(file.data() + sizeof(header));
+	count = (int)header.pose_count;
+	return true;
+}
+
+bool PoseStore::writeBinary(const std::string& path) const
+{
+	std::ofstream out(path.c_str(), std::ios::binary);
+	if (!out.is_open())
+		return false;
+	PoseHeader header;
+	memcpy(header.magic, POSE_MAGIC, sizeof(POSE_MAGIC));
+	header.version = POSE_VERSION;
+	header.pose_count = (unsigned int)count;
+	header.reserved = 0;
+	out.write((const char*)&header, sizeof(header));
+	if (count > 0)
+		out.write((const char*)values, (std::streamsize)count * POSE_VALUES * sizeof(double));
+	return out.good();
+}
+
+Matx33d PoseStore::rotation(int frame) const
+{
+	const double* p = pose(frame);
+	return Matx33d(p[0], p[1], p[2], p[4], p[5], p[6], p[8], p[9], p[10]);
+}
+
+Vec3d PoseStore::translation(int frame) const
+{
+	const double* p = pose(frame);
+	return Vec3d(p[3], p[7], p[11]);
+}
+
+double PoseStore::scale(int frame) const
+{
+	return distance(frame - 1, frame);
+}
+
+double PoseStore::distance(int from, int to) const
+{
+	if (to < 0 || to >= count || from >= count)
+		return 0;
+	Vec3d start = from >= 0 ? translation(from) : Vec3d(0, 0, 0);
+	return norm(translation(to) - start);
+}
+
+PoseWriter::PoseWriter()
+{
+	fp = NULL;
+}
+
+PoseWriter::~PoseWriter()
+{
+	close();
+}
+
+bool PoseWriter::open(const std::string& path)
+{
+	close();
+	fp = fopen(path.c_str(), "w");
+	if (fp == NULL) {
+		printf("Could not write poses to %s\n", path.c_str());
+		return false;
+	}
+	buffer.resize(1 << 20);
+	setvbuf(fp, &buffer[0], _IOFBF, buffer.size());
+	return true;
+}
+
+void PoseWriter::close()
+{
+	if (fp != NULL)
+		fclose(fp);
+	fp = NULL;
+}
+
+void PoseWriter::write(const Mat& R, const Mat& t)
+{
+	if (fp == NULL)
+		return;
+	for (int r = 0; r < 3; r++) {
+		fprintf(fp, "%e %e %e %e%s", R.at<double>(r, 0), R.at<double>(r, 1), R.at<double>(r, 2), t.at<double>(r),
+			r < 2 ? " " : "\n");
+	}
+}
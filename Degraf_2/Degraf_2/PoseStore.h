@@ -0,0 +1,101 @@
+/*!
+\file PoseStore.h
+\brief Ground truth camera poses of a KITTI odometry sequence, parsed once into a contiguous array
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include "opencv2/core.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace cv;
+
+// Poses of every frame as row-major 3x4 [R|t] matrices of doubles, 12 per frame and back to back, so
+// a lookup by frame is a pointer offset. The text form is the KITTI poses/<sequence>.txt file (one
+// pose of 12 values per line); the binary form (.dgp) holds the same array behind a small header and
+// is opened by memory mapping, without parsing.
+class PoseStore {
+
+	public:
+		static const int POSE_VALUES = 12;
+
+		PoseStore();
+
+		// Reads the binary form for paths ending in .dgp, the KITTI text form otherwise
+		/*!
+		\return false (with a message) if the file cannot be read or a line does not hold 12 values
+		*/
+		bool load(const std::string& path);
+
+		// Writes the binary form
+		bool writeBinary(const std::string& path) const;
+
+		int size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		// 12 values of a frame's pose, row-major
+		const double* pose(int frame) const { return values + (size_t)frame * POSE_VALUES; }
+		Matx34d matrix(int frame) const { return Matx34d(pose(frame)); }
+		Matx33d rotation(int frame) const;
+		Vec3d translation(int frame) const;
+
+		// Distance travelled from the previous frame (from the origin for frame 0), the scale monocular
+		// odometry cannot observe
+		/*!
+		\return 0 for frames outside the sequence
+		*/
+		double scale(int frame) const;
+
+		// Distance between the positions of two frames, e.g. across skipped frames; from < 0 is the origin
+		/*!
+		\return 0 if to is outside the sequence
+		*/
+		double distance(int from, int to) const;
+
+	private:
+		std::vector<double> parsed;		// storage of the text form
+		MappedFile file;				// storage of the binary form
+		const double* values;
+		int count;
+
+		bool loadText(const std::string& path);
+		bool loadBinary(const std::string& path);
+
+		PoseStore(const PoseStore&);
+		PoseStore& operator=(const PoseStore&);
+};
+
+// Writes estimated poses in the KITTI text format, one row-major 3x4 [R|t] per line, through a large
+// stdio buffer so a sequence costs a handful of disk writes
+class PoseWriter {
+
+	public:
+		PoseWriter();
+		~PoseWriter();
+
+		bool open(const std::string& path);
+		void close();
+		bool isOpen() const { return fp != NULL; }
+
+		/*!
+		\param R 3x3 rotation, CV_64F
+		\param t 3x1 translation, CV_64F
+		*/
+		void write(const Mat& R, const Mat& t);
+
+	private:
+		FILE* fp;
+		std::vector<char> buffer;
+
+		PoseWriter(const PoseWriter&);
+		PoseWriter& operator=(const PoseWriter&);
+};
+
+// True for file names ending in the binary pose extension (.dgp)
+bool isPoseCache(const std::string& path);
@@ -0,0 +1,51 @@
+/*!
+\file PresetBenchmark.cpp
+\brief Runtime and accuracy of every DeGraF-Flow preset on the KITTI and Middlebury training sets
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "PresetBenchmark.h"
+
+#include <fstream>
+
+int runPresetBenchmark(const std::string& output_csv, int kitti_pairs, int middlebury_pairs)
+{
+	const char* data_sets[] = { "kitti", "middlebury" };
+	const int pair_counts[] = { kitti_pairs, middlebury_pairs };
+	int failures = 0;
+
+	std::ofstream csv(output_csv.c_str());
+	csv << "preset,data_set,pairs,mean_time_s,mean_epe,mean_r2,mean_r3\n";
+
+	cout << "---------------   DeGraF-Flow presets  -------------------\n";
+	cout << "# preset      data set     pairs   time [s]   EPE      R2.0     R3.0\n";
+
+	for (int p = DegrafFlowParams::PRESET_ULTRAFAST; p <= DegrafFlowParams::PRESET_ACCURATE; p++) {
+		String method = String("degraf_flow_") + DegrafFlowParams::presetName(p);
+
+		for (int d = 0; d < 2; d++) {
+			EvaluateOptFlow e = EvaluateOptFlow();
+			e.data_set = data_sets[d];
+			e.fixed_image_no = -1;
+
+			for (int i = 0; i < pair_counts[d]; i++) {
+				if (e.runEvaluation(method, false, i) != 0)
+					failures++;
+			}
+
+			long long n = e.stats.pairs();
+			double time = e.stats.mean(StatsAggregator::FIELD_TIME);
+			double epe = e.stats.mean(StatsAggregator::FIELD_EPE);
+			double r2 = e.stats.mean(StatsAggregator::FIELD_R2);
+			double r3 = e.stats.mean(StatsAggregator::FIELD_R3);
+
+			printf("%-12s %-12s %5d   %8.3f   %6.3f   %6.2f   %6.2f\n", DegrafFlowParams::presetName(p), data_sets[d], (int)n, time, epe, r2, r3);
+			csv << DegrafFlowParams::presetName(p) << "," << data_sets[d] << "," << n << "," << time << "," << epe << "," << r2 << "," << r3 << "\n";
+		}
+	}
+	cout << "----------------------------------------------------------\n";
+	cout << "Results written to " << output_csv << "\n";
+
+	return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,22 @@
+/*!
+\file PresetBenchmark.h
+\brief Runtime and accuracy of every DeGraF-Flow preset on the KITTI and Middlebury training sets
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "EvaluateOptFlow.h"
+#include "FeatureMatcher.h"
+
+#include <string>
+
+// Evaluates each DegrafFlowParams preset over a data set and publishes mean runtime and EPE.
+// Data locations are the ones configured in EvaluateOptFlow::runEvaluation.
+/*!
+\param output_csv file the results table is written to (one row per preset and data set)
+\param kitti_pairs number of KITTI training pairs to evaluate (194 for the full 2012 training set)
+\param middlebury_pairs number of Middlebury pairs to evaluate
+\return 0 on success, -1 if any pair failed to evaluate
+*/
+int runPresetBenchmark(const std::string& output_csv, int kitti_pairs = 194, int middlebury_pairs = 7);
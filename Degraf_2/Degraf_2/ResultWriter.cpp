@@ -0,0 +1,207 @@
+/*!
+\file ResultWriter.cpp
+\brief Background writer for flow fields and visual artefacts, fed through a bounded queue
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "ResultWriter.h"
+#include "FlowVisualization.h"
+#include "KittiFlowIO.h"
+
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/optflow.hpp"
+
+#include <sstream>
+
+ResultWriter::ResultWriter(const std::string& p_output_dir, int p_capacity, int threads, int p_policy, int p_outputs)
+	: output_dir(p_output_dir), capacity((size_t)(std::max)(1, p_capacity)), policy(p_policy), outputs(p_outputs)
+{
+	writing = 0;
+	stopping = false;
+	written_count = dropped_count = failed_count = 0;
+
+	index.open((output_dir + "/index.csv").c_str());
+	if (index.is_open())
+		index << "name,method,data_set,epe,fl,time_s\n";
+	else
+		printf("Could not write %s/index.csv\n", output_dir.c_str());
+
+	for (int i = 0; i < (std::max)(1, threads); i++)
+		workers.push_back(std::thread(&ResultWriter::workerLoop, this));
+}
+
+ResultWriter::~ResultWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	not_empty.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+bool ResultWriter::push(const ResultRecord& record)
+{
+	bool kept = true;
+	{
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		if (queue.size() >= capacity) {
+			if (policy == POLICY_DROP_NEWEST) {
+				dropped_count++;
+				return false;
+			}
+			if (policy == POLICY_DROP_OLDEST) {
+				queue.pop_front();
+				dropped_count++;
+				kept = false;
+			}
+			else {
+				not_full.wait(lock, [this]() { return queue.size() < capacity; });
+			}
+		}
+		queue.push_back(record);
+	}
+	not_empty.notify_one();
+	return kept;
+}
+
+void ResultWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	idle.wait(lock, [this]() { return queue.empty() && writing == 0; });
+}
+
+long long ResultWriter::written() const
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	return written_count;
+}
+
+long long ResultWriter::dropped() const
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	return dropped_count;
+}
+
+long long ResultWriter::failed() const
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	return failed_count;
+}
+
+void ResultWriter::workerLoop()
+{
+	for (;;) {
+		ResultRecord record;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			not_empty.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (queue.empty())
+				return;
+			record = std::move(queue.front());
+			queue.pop_front();
+			writing++;
+		}
+		not_full.notify_one();
+
+		// An exception (e.g. from the encoders) counts the record as failed; writing must still be released or
+		// flush() would wait forever
+		bool ok = false;
+		try {
+			ok = write(record);
+		}
+		catch (const std::exception& ex) {
+			printf("Could not write %s: %s\n", record.name.c_str(), ex.what());
+		}
+		catch (...) {
+			printf("Could not write %s: unknown exception\n", record.name.c_str());
+		}
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			writing--;
+			if (ok)
+				written_count++;
+			else
+				failed_count++;
+		}
+		idle.notify_all();
+	}
+}
+
+bool ResultWriter::write(const ResultRecord& record)
+{
+	std::string base = output_dir + "/" + record.name;
+	bool ok = true;
+
+	if (outputs & OUTPUT_FLOW) {
+		if (record.data_set == "kitti")
+			ok &= writeKittiFlow(base + ".png", record.flow);
+		else
+			ok &= optflow::writeOpticalFlow(base + ".flo", record.flow);
+	}
+	if (outputs & OUTPUT_COLOUR)
+		ok &= imwrite(base + "_flow.png", flowToDisplay(record.flow));
+	if ((outputs & OUTPUT_ERROR) && !record.ground_truth.empty()) {
+		Mat mask = record.mask.empty() ? Mat(record.flow.size(), CV_8U, Scalar(255)) : record.mask;
+		ok &= imwrite(base + "_error.png", errorHeatMap(Mat(record.ground_truth - record.flow), mask));
+	}
+	if ((outputs & OUTPUT_COMPOSITE) && !record.i1.empty()) {
+		Mat mask = record.mask.empty() ? Mat(record.flow.size(), CV_8U, Scalar(255)) : record.mask;
+		ok &= imwrite(base + "_results.png", resultsWindow(record.i1, record.i2, record.flow, record.ground_truth, mask,
+			record.points1, record.points2));
+	}
+	if (!ok)
+		printf("Could not write all results of %s to %s\n", record.name.c_str(), output_dir.c_str());
+
+	if (index.is_open()) {
+		std::ostringstream line;
+		line << record.name << "," << record.method << "," << record.data_set << ",";
+		if (record.result.has_ground_truth)
+			line << record.result.error_mean << "," << record.result.fl;
+		else
+			line << ",";
+		line << "," << record.result.seconds << "\n";
+		std::lock_guard<std::mutex> lock(index_mutex);
+		index << line.str();
+	}
+	return ok;
+}
+
+bool ResultWriter::parsePolicy(const std::string& name, int& policy)
+{
+	if (name == "block")
+		policy = POLICY_BLOCK;
+	else if (name == "drop-newest")
+		policy = POLICY_DROP_NEWEST;
+	else if (name == "drop-oldest")
+		policy = POLICY_DROP_OLDEST;
+	else
+		return false;
+	return true;
+}
+
+bool ResultWriter::parseOutputs(const std::string& names, int& outputs)
+{
+	if (names == "all") {
+		outputs = OUTPUT_ALL;
+		return true;
+	}
+	outputs = 0;
+	std::istringstream list(names);
+	std::string name;
+	while (std::getline(list, name, ',')) {
+		if (name == "flow")
+			outputs |= OUTPUT_FLOW;
+		else if (name == "colour")
+			outputs |= OUTPUT_COLOUR;
+		else if (name == "error")
+			outputs |= OUTPUT_ERROR;
+		else if (name == "composite")
+			outputs |= OUTPUT_COMPOSITE;
+		else
+			return false;
+	}
+	return outputs != 0;
+}
@@ -0,0 +1,109 @@
+/*!
+\file ResultWriter.h
+\brief Background writer for flow fields and visual artefacts, fed through a bounded queue
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FlowStatistics.h"
+
+#include "opencv2/core.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cv;
+
+// Everything needed to write the artefacts of one pair. Mats are shared, not copied, so the producer
+// must not write into them after pushing (freshly allocated results and read-only inputs are safe).
+struct ResultRecord {
+	String name;						// file name stem
+	String method;
+	String data_set;					// "kitti" writes the flow as a KITTI png, anything else as Middlebury .flo
+	Mat i1, i2;							// frames, only needed for the composite
+	Mat flow;							// computed flow, CV_32FC2
+	Mat ground_truth;					// may be empty
+	Mat mask;							// pixels with valid ground truth in the evaluated region, empty for all
+	std::vector<Point2f> points1, points2;	// sparse matches of DeGraF-Flow, empty for dense methods
+	PairResult result;
+};
+
+// Evaluation threads push records and return at once; writer threads do the colour coding, heat maps,
+// encoding and disk writes. The queue holds at most capacity records, and the policy decides what
+// happens when it is full. A line per written record is appended to <output_dir>/index.csv.
+class ResultWriter {
+
+	public:
+		enum Policy {
+			POLICY_BLOCK,			// the producer waits for a free slot, nothing is lost
+			POLICY_DROP_NEWEST,		// the pushed record is discarded
+			POLICY_DROP_OLDEST		// the oldest queued record is discarded to make room
+		};
+
+		// Artefacts written per record, combined as flags
+		enum Output {
+			OUTPUT_FLOW = 1,		// <name>.png (KITTI) or <name>.flo (Middlebury), as used for submissions
+			OUTPUT_COLOUR = 2,		// <name>_flow.png, colour coded flow
+			OUTPUT_ERROR = 4,		// <name>_error.png, error heat map (needs ground truth)
+			OUTPUT_COMPOSITE = 8,	// <name>_results.png, the 2x3 results window
+			OUTPUT_ALL = 15
+		};
+
+		/*!
+		\param output_dir existing directory the files are written to
+		\param capacity maximum number of queued records
+		\param threads writer threads
+		\param policy behaviour when the queue is full
+		\param outputs combination of Output flags
+		*/
+		ResultWriter(const std::string& output_dir, int capacity = 8, int threads = 1, int policy = POLICY_BLOCK, int outputs = OUTPUT_ALL);
+
+		// Writes everything still queued, then joins the writer threads
+		~ResultWriter();
+
+		// Queues a record for writing
+		/*!
+		\return false if the record (or with POLICY_DROP_OLDEST an older one) was dropped
+		*/
+		bool push(const ResultRecord& record);
+
+		// Blocks until every queued record has been written
+		void flush();
+
+		long long written() const;
+		long long dropped() const;
+		long long failed() const;		// records with at least one file that could not be written
+
+		// Parses "block", "drop-newest" or "drop-oldest"
+		static bool parsePolicy(const std::string& name, int& policy);
+
+		// Parses "flow", "all" or a comma separated list of flow, colour, error and composite
+		static bool parseOutputs(const std::string& names, int& outputs);
+
+	private:
+		std::string output_dir;
+		size_t capacity;
+		int policy;
+		int outputs;
+
+		std::deque<ResultRecord> queue;
+		mutable std::mutex queue_mutex;
+		std::condition_variable not_empty, not_full, idle;
+		int writing;
+		bool stopping;
+		long long written_count, dropped_count, failed_count;
+
+		std::mutex index_mutex;
+		std::ofstream index;
+
+		std::vector<std::thread> workers;
+
+		void workerLoop();
+		bool write(const ResultRecord& record);
+};
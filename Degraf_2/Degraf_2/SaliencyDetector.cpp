@@ -9,6 +9,7 @@
 // Include Files
 #include "stdafx.h"
 #include "SaliencyDetector.h"
+#include "MemoryAccounting.h"
 
 //#include <iostream>	// new
 //
@@ -30,6 +31,10 @@ SaliencyDetector::SaliencyDetector()
 //! Class destructor
 SaliencyDetector::~SaliencyDetector()
 {
+    if(init_status == TRUE)
+    {
+        Release();
+    }
 }
 
 //! Initialises a saliency detector
@@ -48,28 +53,28 @@ void SaliencyDetector::Create(IplImage* p_image, uint p_pyr_levels)
     pyramid_height = p_pyr_levels;
 
     // Setup image templates
-    image_32f = cvCreateImage(image_size, IPL_DEPTH_32F, 1);
-    image_8u = cvCreateImage(image_size, IPL_DEPTH_8U, 1);
+    image_32f = CreateTrackedImage(image_size, IPL_DEPTH_32F, 1);
+    image_8u = CreateTrackedImage(image_size, IPL_DEPTH_8U, 1);
 
     // Initialise pyramids
     pyramid = new ImagePyramid();
     pyramid->Create(image_32f, pyramid_height);
     pyramid_inv = new ImagePyramid();
     pyramid_inv->Create(image_32f, pyramid_height);
-    cvReleaseImage(&image_32f);
+    ReleaseTrackedImage(&image_32f);
 
     // Initialise image arrays
-    image_32f = cvCreateImage(image_size, IPL_DEPTH_32F, 1);
+    image_32f = CreateTrackedImage(image_size, IPL_DEPTH_32F, 1);
     image_3ch = new ImageArray();
     image_3ch->InitArray(image_32f, 3);
-    cvReleaseImage(&image_32f);
+    ReleaseTrackedImage(&image_32f);
 
     // Initialise images
-    saliency_matrix = cvCreateImage(image_size, IPL_DEPTH_32F, 1);
-    matrix_ratio = cvCreateImage(image_size, IPL_DEPTH_32F, 1);
-    matrix_ratio_inv = cvCreateImage(image_size, IPL_DEPTH_32F, 1);
-    matrix_min_ratio = cvCreateImage(image_size, IPL_DEPTH_32F, 1);
-    unit_matrix = cvCreateImage(image_size, IPL_DEPTH_32F, 1);
+    saliency_matrix = CreateTrackedImage(image_size, IPL_DEPTH_32F, 1);
+    matrix_ratio = CreateTrackedImage(image_size, IPL_DEPTH_32F, 1);
+    matrix_ratio_inv = CreateTrackedImage(image_size, IPL_DEPTH_32F, 1);
+    matrix_min_ratio = CreateTrackedImage(image_size, IPL_DEPTH_32F, 1);
+    unit_matrix = CreateTrackedImage(image_size, IPL_DEPTH_32F, 1);
     cvSet(unit_matrix, cvScalar(1.0, 1.0, 1.0));
 
     // Set initialisation flag
@@ -79,16 +84,25 @@ void SaliencyDetector::Create(IplImage* p_image, uint p_pyr_levels)
 //! Releases saliency detector
 void SaliencyDetector::Release(void)
 {
+    if(init_status == FALSE)
+    {
+        return;
+    }
+
     // Free memory
-    cvReleaseImage(&image_8u);
-    cvReleaseImage(&saliency_matrix);
-    cvReleaseImage(&matrix_ratio);
-    cvReleaseImage(&matrix_ratio_inv);
-    cvReleaseImage(&matrix_min_ratio);
-    cvReleaseImage(&unit_matrix);
-    pyramid->Release();
-    pyramid_inv->Release();
+    ReleaseTrackedImage(&image_8u);
+    ReleaseTrackedImage(&saliency_matrix);
+    ReleaseTrackedImage(&matrix_ratio);
+    ReleaseTrackedImage(&matrix_ratio_inv);
+    ReleaseTrackedImage(&matrix_min_ratio);
+    ReleaseTrackedImage(&unit_matrix);
+    delete pyramid;             // destructors release the levels
+    delete pyramid_inv;
     image_3ch->ReleaseArray();
+    delete image_3ch;
+    pyramid = NULL;
+    pyramid_inv = NULL;
+    image_3ch = NULL;
 
     // Reset initialisation flag
     init_status = FALSE;
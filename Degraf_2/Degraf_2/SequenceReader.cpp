@@ -0,0 +1,118 @@
+/*!
+\file SequenceReader.cpp
+\brief Prefetching reader for numbered image sequences, frames decoded ahead into a ring of reused buffers
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "SequenceReader.h"
+
+#include <climits>
+#include <cstdio>
+#include <fstream>
+
+SequenceReader::SequenceReader(const std::string& p_pattern, int first, int count, int p_flags, int ring_size, int threads)
+	: pattern(p_pattern), flags(p_flags)
+{
+	first_frame = first;
+	end_frame = count < 0 ? INT_MAX : first + count;
+	slots.resize((std::max)(2, ring_size));
+	for (size_t s = 0; s < slots.size(); s++) {
+		slots[s].frame = -1;
+		slots[s].done = false;
+		slots[s].ok = false;
+	}
+	next_decode = first;
+	released = first - 1;
+	stopping = false;
+	for (int i = 0; i < (std::max)(1, threads); i++)
+		decoders.push_back(std::thread(&SequenceReader::decodeLoop, this));
+}
+
+SequenceReader::~SequenceReader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	freed.notify_all();
+	for (size_t i = 0; i < decoders.size(); i++)
+		decoders[i].join();
+}
+
+std::string SequenceReader::path(int index) const
+{
+	char name[1024];
+	snprintf(name, sizeof(name), pattern.c_str(), index);
+	return name;
+}
+
+bool SequenceReader::frame(int index, Mat& image)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	CV_Assert(index > released);
+	CV_Assert(index - released <= (int)slots.size());		// otherwise the frame could never be decoded
+
+	Slot& slot = slots[(index - first_frame) % slots.size()];
+	decoded.wait(lock, [&]() { return index >= end_frame || (slot.frame == index && slot.done); });
+	if (index >= end_frame && !(slot.frame == index && slot.done && slot.ok))
+		return false;
+	image = slot.image;
+	return slot.ok;
+}
+
+void SequenceReader::release(int index)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (index <= released)
+			return;
+		released = index;
+	}
+	freed.notify_all();
+}
+
+void SequenceReader::decodeLoop()
+{
+	std::vector<uchar> bytes;	// file contents, reused
+	for (;;) {
+		int index;
+		Slot* slot;
+		{
+			// A buffer is free once the frame a lap behind has been released
+			std::unique_lock<std::mutex> lock(mutex);
+			freed.wait(lock, [this]() { return stopping || (next_decode < end_frame && next_decode - (int)slots.size() <= released); });
+			if (stopping)
+				return;
+			index = next_decode++;
+			slot = &slots[(index - first_frame) % slots.size()];
+			slot->frame = index;
+			slot->done = false;
+		}
+
+		// The slot's buffer is only touched by this thread until done is set; imdecode reuses it when the
+		// size and type match, which they do for every frame of a sequence
+		bool ok = false;
+		std::ifstream file(path(index).c_str(), std::ios::binary);
+		if (file.is_open()) {
+			file.seekg(0, std::ios::end);
+			bytes.resize((size_t)file.tellg());
+			file.seekg(0, std::ios::beg);
+			if (!bytes.empty() && file.read((char*)&bytes[0], bytes.size())) {
+				imdecode(bytes, flags, &slot->image);
+				ok = !slot->image.empty();
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			slot->done = true;
+			slot->ok = ok;
+			// The first frame that cannot be read ends the sequence
+			if (!ok && index < end_frame)
+				end_frame = index;
+		}
+		decoded.notify_all();
+		freed.notify_all();
+	}
+}
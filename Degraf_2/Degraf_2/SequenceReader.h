@@ -0,0 +1,82 @@
+/*!
+\file SequenceReader.h
+\brief Prefetching reader for numbered image sequences, frames decoded ahead into a ring of reused buffers
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cv;
+
+// Background threads decode the frames of a numbered sequence (e.g. KITTI image_0/%06d.png) in order,
+// straight to the requested format, into a fixed ring of buffers. Each ring buffer is decoded into again
+// once its frame is released, so after the first lap nothing is allocated. frame() hands out a header
+// to the buffer, without a copy.
+//
+// Frames are released in order: release(i) frees every frame up to i. A frame stays valid until it is
+// released, and at most ring_size frames can be held at once.
+class SequenceReader {
+
+	public:
+		/*!
+		\param pattern printf pattern of the file names with one integer conversion, e.g. ".../image_0/%06d.png"
+		\param first index of the first frame
+		\param count number of frames, < 0 to read until the first missing file
+		\param flags imread flags, IMREAD_GRAYSCALE by default
+		\param ring_size frames decoded ahead and held
+		\param threads decoding threads
+		*/
+		SequenceReader(const std::string& pattern, int first = 0, int count = -1, int flags = IMREAD_GRAYSCALE, int ring_size = 8, int threads = 2);
+
+		// Stops the decoders, frames still held become invalid
+		~SequenceReader();
+
+		// Waits until a frame is decoded
+		/*!
+		\param index frame index, not yet released and less than ring_size after the oldest held frame
+		\param image output, refers to the ring buffer
+		\return false past the end of the sequence or if the file could not be decoded
+		*/
+		bool frame(int index, Mat& image);
+
+		// Frees the buffers of every frame up to index for decoding ahead
+		void release(int index);
+
+		std::string path(int index) const;
+		int first() const { return first_frame; }
+
+	private:
+		struct Slot {
+			Mat image;
+			int frame;			// frame decoded or being decoded in this buffer, -1 before the first
+			bool done;			// decoding finished
+			bool ok;
+		};
+
+		std::string pattern;
+		int flags;
+		int first_frame;
+		int end_frame;			// one past the last frame, lowered to the first missing file when count < 0
+		std::vector<Slot> slots;
+
+		std::mutex mutex;
+		std::condition_variable decoded, freed;
+		int next_decode;
+		int released;			// frames up to here are released
+		bool stopping;
+		std::vector<std::thread> decoders;
+
+		void decodeLoop();
+
+		SequenceReader(const SequenceReader&);
+		SequenceReader& operator=(const SequenceReader&);
+};
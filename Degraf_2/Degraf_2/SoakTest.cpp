@@ -0,0 +1,113 @@
+/*!
+\file SoakTest.cpp
+\brief Long-run soak of the flow and odometry front ends on synthetic frames, checks memory does not grow
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "SoakTest.h"
+
+#include <fstream>
+
+struct SoakSample {
+	int frame;
+	size_t resident;
+	unsigned long long live;
+};
+
+// Least squares slope of y over x
+static double slope(const std::vector<SoakSample>& samples, bool resident)
+{
+	double n = (double)samples.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+	if (samples.size() < 2)
+		return 0.0;
+	for (size_t i = 0; i < samples.size(); i++) {
+		double x = samples[i].frame;
+		double y = resident ? (double)samples[i].resident : (double)samples[i].live;
+		sx += x; sy += y; sxx += x * x; sxy += x * y;
+	}
+	double d = n * sxx - sx * sx;
+	return d != 0.0 ? (n * sxy - sx * sy) / d : 0.0;
+}
+
+int runSoak(int frames, double max_growth_mb, const std::string& output_csv)
+{
+	MemoryAccounting& accounting = MemoryAccounting::instance();
+	accounting.install();
+
+	// KITTI sized frames, two pairs with different texture and motion so buffers are not trivially reused
+	const Size size(1242, 375);
+	Mat pairs[2][2];
+	pairs[0][0] = texturedFrame(size, 1);
+	pairs[0][1] = translatedFrame(pairs[0][0], 2.5, 0.75);
+	pairs[1][0] = texturedFrame(size, 2);
+	pairs[1][1] = translatedFrame(pairs[1][0], -1.25, 1.5);
+	Mat grey[2][2];
+	for (int p = 0; p < 2; p++)
+		for (int f = 0; f < 2; f++)
+			cvtColor(pairs[p][f], grey[p][f], COLOR_BGR2GRAY);
+
+	int warm_up = (std::min)(50, frames / 10);
+	int sample_every = (std::max)(1, frames / 200);
+	std::vector<SoakSample> samples;
+
+	FeatureMatcher matcher;
+	DegrafFlowParams params;
+	Mat flow;
+	vector<Point2f> points1, points2;
+	vector<uchar> status;
+
+	printf("Soak: %d frames of %dx%d, warm-up %d\n", frames, size.width, size.height, warm_up);
+	for (int i = 0; i < frames; i++) {
+		int p = i & 1;
+
+		matcher.degraf_flow_RLOF(pairs[p][0], pairs[p][1], flow, params);
+
+		// Odometry front end, points1 is cleared by the detector
+		featureDetection(grey[p][0], points1);
+		featureTracking(grey[p][0], grey[p][1], points1, points2, status);
+
+		if (i == warm_up)
+			accounting.reset();
+		if (i >= warm_up && (i - warm_up) % sample_every == 0) {
+			SoakSample s;
+			s.frame = i;
+			s.resident = MemoryAccounting::residentBytes();
+			s.live = accounting.liveBytes(ALLOC_IPL) + accounting.liveBytes(ALLOC_MAT) + accounting.liveBytes(ALLOC_HEAP);
+			samples.push_back(s);
+		}
+		if ((i + 1) % 100 == 0)
+			printf("  frame %d: resident %.1f MB\n", i + 1, MemoryAccounting::residentBytes() / 1048576.0);
+	}
+
+	if (samples.size() < 2) {
+		printf("Soak: too few frames to measure growth\n");
+		return 0;
+	}
+
+	double resident_growth = ((double)samples.back().resident - (double)samples.front().resident) / 1048576.0;
+	double live_growth = ((double)samples.back().live - (double)samples.front().live) / 1048576.0;
+	double resident_drift = slope(samples, true) * 1000.0 / 1048576.0;
+	double live_drift = slope(samples, false) * 1000.0 / 1048576.0;
+
+	printf("\n");
+	accounting.printReport();
+	printf("\nResident: %.1f -> %.1f MB, growth %.2f MB, drift %.3f MB / 1000 frames\n", samples.front().resident / 1048576.0,
+		samples.back().resident / 1048576.0, resident_growth, resident_drift);
+	printf("Tracked live: %.1f -> %.1f MB, growth %.2f MB, drift %.3f MB / 1000 frames\n", samples.front().live / 1048576.0,
+		samples.back().live / 1048576.0, live_growth, live_drift);
+
+	if (!output_csv.empty()) {
+		std::ofstream out(output_csv.c_str());
+		out << "frame,resident_bytes,live_bytes\n";
+		for (size_t i = 0; i < samples.size(); i++)
+			out << samples[i].frame << "," << samples[i].resident << "," << samples[i].live << "\n";
+	}
+
+	if (resident_growth > max_growth_mb || live_growth > max_growth_mb) {
+		printf("Soak FAILED: memory grew by more than %.1f MB\n", max_growth_mb);
+		return 1;
+	}
+	printf("Soak passed\n");
+	return 0;
+}
@@ -0,0 +1,25 @@
+/*!
+\file SoakTest.h
+\brief Long-run soak of the flow and odometry front ends on synthetic frames, checks memory does not grow
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "FeatureMatcher.h"
+#include "MemoryAccounting.h"
+#include "SyntheticFlow.h"
+#include "vo_features.h"
+
+#include <string>
+
+// Runs DeGraF-Flow (RLOF) and the odometry detection/tracking front end over a stream of procedurally
+// textured frames, sampling the process resident set and the tracked live bytes as it goes. After a warm-up
+// the growth of both is reported along with the per-stage allocation counters.
+/*!
+\param frames number of frames to process
+\param max_growth_mb largest acceptable growth of resident or tracked live memory after warm-up
+\param output_csv file the memory samples are written to, empty for none
+\return 0 if memory stayed flat, 1 if it grew by more than max_growth_mb
+*/
+int runSoak(int frames, double max_growth_mb = 16.0, const std::string& output_csv = "");
@@ -0,0 +1,289 @@
+/*!
+\file StageProfiler.cpp
+\brief Low-overhead per-stage timing of the DeGraF-Flow pipeline with JSON, CSV, Prometheus and Chrome trace export
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "StageProfiler.h"
+#include "MemoryAccounting.h"
+
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+using namespace cv;
+
+// Buckets 0-15 hold 0-15 us exactly, above that each power of two is split into 16 linear sub-buckets
+int StageProfiler::binIndex(unsigned long long us)
+{
+	if (us < 16)
+		return (int)us;
+	int msb = 63;
+	while (!(us >> msb))
+		msb--;
+	int sub = (int)((us >> (msb - 4)) & 15);
+	int bin = 16 + (msb - 4) * 16 + sub;
+	return bin < HIST_BINS ? bin : HIST_BINS - 1;
+}
+
+// Representative value (bucket midpoint) in microseconds
+double StageProfiler::binValue(int bin)
+{
+	if (bin < 16)
+		return (double)bin;
+	int msb = (bin - 16) / 16 + 4;
+	int sub = (bin - 16) % 16;
+	double lower = (double)(1ULL << msb) + (double)sub * (double)(1ULL << (msb - 4));
+	return lower + 0.5 * (double)(1ULL << (msb - 4));
+}
+
+StageProfiler::StageProfiler()
+{
+	enabled = true;
+	trace_enabled = false;
+	epoch_tick = getTickCount();
+}
+
+StageProfiler& StageProfiler::instance()
+{
+	static StageProfiler profiler;
+	return profiler;
+}
+
+const char* StageProfiler::stageName(int stage)
+{
+	static const char* names[STAGE_COUNT] = { "grey", "saliency", "gradients", "tracking", "filtering", "interpolation", "fgs", "total" };
+	return names[stage];
+}
+
+// Returns the calling thread's block, registering it on first use. Blocks are owned by the profiler so
+// that samples of finished worker threads are still exported; a thread that exits hands its block on to
+// the next new thread, so short-lived pools do not add a block per thread.
+StageProfiler::ThreadBlock* StageProfiler::threadBlock()
+{
+	static thread_local BlockLease lease;
+	if (lease.block == NULL) {
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		if (!free_blocks.empty()) {
+			lease.block = free_blocks.back();
+			free_blocks.pop_back();
+			return lease.block;
+		}
+
+		ThreadBlock* b = new ThreadBlock();
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			b->count[s] = 0;
+			b->total_us[s] = 0;
+			b->max_us[s] = 0;
+			for (int h = 0; h < HIST_BINS; h++)
+				b->hist[s][h] = 0;
+		}
+		b->trace_count = 0;
+		b->thread_index = (int)blocks.size();
+		blocks.push_back(std::unique_ptr<ThreadBlock>(b));
+		lease.block = b;
+	}
+	return lease.block;
+}
+
+void StageProfiler::releaseBlock(ThreadBlock* block)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	free_blocks.push_back(block);
+}
+
+StageProfiler::BlockLease::~BlockLease()
+{
+	if (block != NULL)
+		StageProfiler::instance().releaseBlock(block);
+}
+
+// Adds one sample, only the owning thread writes to its block so plain load/store pairs are sufficient
+void StageProfiler::record(int stage, int64 start_tick, int64 end_tick)
+{
+	if (!enabled)
+		return;
+	ThreadBlock* b = threadBlock();
+	unsigned long long us = (unsigned long long)((double)(end_tick - start_tick) * 1e6 / getTickFrequency());
+
+	b->count[stage].store(b->count[stage].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	b->total_us[stage].store(b->total_us[stage].load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+	if (us > b->max_us[stage].load(std::memory_order_relaxed))
+		b->max_us[stage].store(us, std::memory_order_relaxed);
+	std::atomic<unsigned int>& bin = b->hist[stage][binIndex(us)];
+	bin.store(bin.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	if (trace_enabled) {
+		int n = b->trace_count.load(std::memory_order_relaxed);
+		if (b->trace.empty())
+			b->trace.resize(TRACE_CAPACITY);
+		if (n < TRACE_CAPACITY) {
+			b->trace[n].stage = stage;
+			b->trace[n].start_tick = start_tick;
+			b->trace[n].end_tick = end_tick;
+			b->trace_count.store(n + 1, std::memory_order_release);
+		}
+	}
+}
+
+// Merges all thread blocks for one stage
+StageSummary StageProfiler::summary(int stage) const
+{
+	StageSummary s;
+	unsigned long long total_us = 0, max_us = 0;
+	std::vector<unsigned long long> hist(HIST_BINS, 0);
+	s.count = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		for (size_t i = 0; i < blocks.size(); i++) {
+			s.count += blocks[i]->count[stage].load(std::memory_order_relaxed);
+			total_us += blocks[i]->total_us[stage].load(std::memory_order_relaxed);
+			max_us = (std::max)(max_us, blocks[i]->max_us[stage].load(std::memory_order_relaxed));
+			for (int h = 0; h < HIST_BINS; h++)
+				hist[h] += blocks[i]->hist[stage][h].load(std::memory_order_relaxed);
+		}
+	}
+
+	s.total_ms = total_us / 1000.0;
+	s.mean_ms = s.count ? s.total_ms / s.count : 0.0;
+	s.max_ms = max_us / 1000.0;
+
+	const double quantiles[3] = { 0.50, 0.95, 0.99 };
+	double* outputs[3] = { &s.p50_ms, &s.p95_ms, &s.p99_ms };
+	for (int q = 0; q < 3; q++) {
+		*outputs[q] = 0.0;
+		if (s.count == 0)
+			continue;
+		unsigned long long target = (unsigned long long)ceil(quantiles[q] * s.count);
+		unsigned long long seen = 0;
+		for (int h = 0; h < HIST_BINS; h++) {
+			seen += hist[h];
+			if (seen >= target) {
+				*outputs[q] = (std::min)(binValue(h), (double)max_us) / 1000.0;
+				break;
+			}
+		}
+	}
+	return s;
+}
+
+// Clears all samples, must not run concurrently with record()
+void StageProfiler::reset()
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	for (size_t i = 0; i < blocks.size(); i++) {
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			blocks[i]->count[s] = 0;
+			blocks[i]->total_us[s] = 0;
+			blocks[i]->max_us[s] = 0;
+			for (int h = 0; h < HIST_BINS; h++)
+				blocks[i]->hist[s][h] = 0;
+		}
+		blocks[i]->trace_count = 0;
+	}
+	epoch_tick = getTickCount();
+}
+
+bool StageProfiler::writeJSON(const std::string& path) const
+{
+	std::ofstream out(path.c_str());
+	if (!out.is_open())
+		return false;
+	out << "{\n  \"stages\": {\n";
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		StageSummary s = summary(stage);
+		out << "    \"" << stageName(stage) << "\": { \"count\": " << s.count << ", \"total_ms\": " << s.total_ms
+			<< ", \"mean_ms\": " << s.mean_ms << ", \"p50_ms\": " << s.p50_ms << ", \"p95_ms\": " << s.p95_ms
+			<< ", \"p99_ms\": " << s.p99_ms << ", \"max_ms\": " << s.max_ms << " }" << (stage + 1 < STAGE_COUNT ? "," : "") << "\n";
+	}
+	out << "  }\n}\n";
+	return true;
+}
+
+bool StageProfiler::writeCSV(const std::string& path) const
+{
+	std::ofstream out(path.c_str());
+	if (!out.is_open())
+		return false;
+	out << "stage,count,total_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		StageSummary s = summary(stage);
+		out << stageName(stage) << "," << s.count << "," << s.total_ms << "," << s.mean_ms << "," << s.p50_ms << ","
+			<< s.p95_ms << "," << s.p99_ms << "," << s.max_ms << "\n";
+	}
+	return true;
+}
+
+// Prometheus text exposition format, suitable for the node exporter textfile collector
+bool StageProfiler::writePrometheus(const std::string& path) const
+{
+	std::ofstream out(path.c_str());
+	if (!out.is_open())
+		return false;
+	out << "# HELP degraf_stage_seconds DeGraF-Flow stage latency.\n";
+	out << "# TYPE degraf_stage_seconds summary\n";
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		StageSummary s = summary(stage);
+		const char* name = stageName(stage);
+		out << "degraf_stage_seconds{stage=\"" << name << "\",quantile=\"0.5\"} " << s.p50_ms / 1000.0 << "\n";
+		out << "degraf_stage_seconds{stage=\"" << name << "\",quantile=\"0.95\"} " << s.p95_ms / 1000.0 << "\n";
+		out << "degraf_stage_seconds{stage=\"" << name << "\",quantile=\"0.99\"} " << s.p99_ms / 1000.0 << "\n";
+		out << "degraf_stage_seconds_sum{stage=\"" << name << "\"} " << s.total_ms / 1000.0 << "\n";
+		out << "degraf_stage_seconds_count{stage=\"" << name << "\"} " << s.count << "\n";
+	}
+	return true;
+}
+
+// Chrome trace event format (load in chrome://tracing), one row per thread block; threads that ran one
+// after the other may share a row
+bool StageProfiler::writeChromeTrace(const std::string& path) const
+{
+	std::ofstream out(path.c_str());
+	if (!out.is_open())
+		return false;
+	double us_per_tick = 1e6 / getTickFrequency();
+	bool first = true;
+	out << "{\"traceEvents\":[\n";
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	for (size_t i = 0; i < blocks.size(); i++) {
+		int n = blocks[i]->trace_count.load(std::memory_order_acquire);
+		for (int e = 0; e < n; e++) {
+			const TraceEvent& ev = blocks[i]->trace[e];
+			out << (first ? "" : ",\n") << "{\"name\":\"" << stageName(ev.stage) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << blocks[i]->thread_index
+				<< ",\"ts\":" << (ev.start_tick - epoch_tick) * us_per_tick << ",\"dur\":" << (ev.end_tick - ev.start_tick) * us_per_tick << "}";
+			first = false;
+		}
+	}
+	out << "\n]}\n";
+	return true;
+}
+
+ScopedStageTimer::ScopedStageTimer(int p_stage, double* p_elapsed_s)
+{
+	stage = p_stage;
+	elapsed_s = p_elapsed_s;
+	running = true;
+	previous_memory_stage = MemoryAccounting::enterStage(p_stage);
+	start_tick = getTickCount();
+}
+
+ScopedStageTimer::~ScopedStageTimer()
+{
+	stop();
+}
+
+// Ends the sample early, for stages that do not coincide with a C++ scope
+void ScopedStageTimer::stop()
+{
+	if (!running)
+		return;
+	running = false;
+	int64 end_tick = getTickCount();
+	MemoryAccounting::leaveStage(previous_memory_stage);
+	StageProfiler::instance().record(stage, start_tick, end_tick);
+	if (elapsed_s != NULL)
+		*elapsed_s += (double)(end_tick - start_tick) / getTickFrequency();
+}
@@ -0,0 +1,110 @@
+/*!
+\file StageProfiler.h
+\brief Low-overhead per-stage timing of the DeGraF-Flow pipeline with JSON, CSV, Prometheus and Chrome trace export
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Pipeline stages that are timed
+enum ProfileStage {
+	STAGE_GREY = 0,			// colour to grey conversion
+	STAGE_SALIENCY,			// DoGoS saliency
+	STAGE_GRADIENTS,		// DeGraF gradient detection
+	STAGE_TRACKING,			// LK / RLOF point tracking
+	STAGE_FILTERING,		// match filtering
+	STAGE_INTERPOLATION,	// edge-aware interpolation
+	STAGE_FGS,				// fast global smoother post-processing
+	STAGE_TOTAL,			// whole flow computation
+	STAGE_COUNT
+};
+
+// Summary of one stage over all threads
+struct StageSummary {
+	unsigned long long count;
+	double total_ms, mean_ms, max_ms;
+	double p50_ms, p95_ms, p99_ms;
+};
+
+// Collects stage latencies. Every thread writes to its own block of counters and histogram bins
+// (single writer, relaxed atomics, no locks on the hot path); readers merge the blocks on export.
+class StageProfiler {
+
+	public:
+		static const int HIST_BINS = 512;			// log-linear latency buckets in microseconds
+		static const int TRACE_CAPACITY = 1 << 16;	// trace events kept per thread, allocated on the first traced sample
+
+		bool enabled;			// record counters and histograms
+		bool trace_enabled;		// additionally record a timeline for the Chrome trace
+
+		static StageProfiler& instance();
+		static const char* stageName(int stage);
+
+		void record(int stage, int64 start_tick, int64 end_tick);
+		StageSummary summary(int stage) const;
+		void reset();
+
+		bool writeJSON(const std::string& path) const;
+		bool writeCSV(const std::string& path) const;
+		bool writePrometheus(const std::string& path) const;
+		bool writeChromeTrace(const std::string& path) const;
+
+	private:
+		struct TraceEvent {
+			int stage;
+			int64 start_tick, end_tick;
+		};
+
+		struct ThreadBlock {
+			int thread_index;
+			std::atomic<unsigned long long> count[STAGE_COUNT];
+			std::atomic<unsigned long long> total_us[STAGE_COUNT];
+			std::atomic<unsigned long long> max_us[STAGE_COUNT];
+			std::atomic<unsigned int> hist[STAGE_COUNT][HIST_BINS];
+			std::vector<TraceEvent> trace;		// empty until tracing is enabled
+			std::atomic<int> trace_count;
+		};
+
+		// Hands a thread's block back to the profiler when the thread exits
+		struct BlockLease {
+			ThreadBlock* block;
+			BlockLease() : block(NULL) {}
+			~BlockLease();
+		};
+
+		mutable std::mutex registry_mutex;		// only taken when a thread registers or exits and on export
+		std::vector<std::unique_ptr<ThreadBlock> > blocks;
+		std::vector<ThreadBlock*> free_blocks;	// blocks of exited threads, samples kept, reused by new threads
+		int64 epoch_tick;
+
+		StageProfiler();
+		ThreadBlock* threadBlock();
+		void releaseBlock(ThreadBlock* block);
+		static int binIndex(unsigned long long us);
+		static double binValue(int bin);
+};
+
+// Times the enclosing scope as one stage sample, allocations made inside it are attributed to the stage
+class ScopedStageTimer {
+
+	public:
+		// elapsed_s, if given, has the elapsed seconds added to it when the timer stops
+		ScopedStageTimer(int p_stage, double* p_elapsed_s = NULL);
+		~ScopedStageTimer();
+		void stop();
+
+	private:
+		int stage;
+		double* elapsed_s;
+		int64 start_tick;
+		int previous_memory_stage;
+		bool running;
+};
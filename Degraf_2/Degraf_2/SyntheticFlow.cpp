@@ -0,0 +1,246 @@
+/*!
+\file SyntheticFlow.cpp
+\brief Synthetic image pairs with exact ground truth flow from parametric and layered motion fields
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "SyntheticFlow.h"
+#include "KittiFlowIO.h"
+
+#include "opencv2/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/optflow.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+// Smooth random texture, blurred so gradients and saliency are well defined
+Mat texturedFrame(Size size, uint64 seed)
+{
+	RNG rng(seed);
+	Mat frame(size, CV_8UC3);
+	rng.fill(frame, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+	GaussianBlur(frame, frame, Size(7, 7), 2.0);
+	return frame;
+}
+
+// Second frame of a pair, the first translated by a sub-pixel offset
+Mat translatedFrame(const Mat& frame, double dx, double dy)
+{
+	Mat shifted;
+	Matx23d m(1, 0, dx, 0, 1, dy);
+	warpAffine(frame, shifted, m, frame.size(), INTER_LINEAR, BORDER_REFLECT);
+	return shifted;
+}
+
+const char* syntheticMotionName(int model)
+{
+	static const char* names[] = { "translation", "affine", "homography", "layered", "large" };
+	CV_Assert(model >= 0 && model < MOTION_COUNT);
+	return names[model];
+}
+
+// Rotation by angle (radians) and scale about centre, followed by a translation
+static Matx33d similarityAbout(Point2d centre, double angle, double scale, Point2d translation)
+{
+	double c = scale * cos(angle), s = scale * sin(angle);
+	return Matx33d(c, -s, centre.x - c * centre.x + s * centre.y + translation.x,
+		s, c, centre.y - s * centre.x - c * centre.y + translation.y,
+		0, 0, 1);
+}
+
+static Point2d randomDirection(RNG& rng, double min_length, double max_length)
+{
+	double angle = rng.uniform(0.0, 2 * CV_PI);
+	double length = rng.uniform(min_length, max_length);
+	return Point2d(length * cos(angle), length * sin(angle));
+}
+
+// Displacement of every pixel under the forward transform H, rows in parallel
+static void transformFlow(const Matx33d& H, Size size, Mat& flow)
+{
+	flow.create(size, CV_32FC2);
+	parallel_for_(Range(0, size.height), [&](const Range& rows) {
+		for (int y = rows.start; y < rows.end; y++) {
+			float* f = flow.ptr<float>(y);
+			for (int x = 0; x < size.width; x++) {
+				double w = H(2, 0) * x + H(2, 1) * y + H(2, 2);
+				f[2 * x] = (float)((H(0, 0) * x + H(0, 1) * y + H(0, 2)) / w - x);
+				f[2 * x + 1] = (float)((H(1, 0) * x + H(1, 1) * y + H(1, 2)) / w - y);
+			}
+		}
+	});
+}
+
+// Random convex layer outline in the first frame: an ellipse, a rotated rectangle or a polygon
+static void drawLayerMask(RNG& rng, Size size, Mat& mask, Point2d& centre)
+{
+	mask = Mat::zeros(size, CV_8U);
+	int extent = (std::min)(size.width, size.height);
+	centre = Point2d(rng.uniform(0.15, 0.85) * size.width, rng.uniform(0.15, 0.85) * size.height);
+	double a = rng.uniform(0.08, 0.2) * extent, b = rng.uniform(0.08, 0.2) * extent;
+	double angle = rng.uniform(0.0, 180.0);
+
+	int shape = rng.uniform(0, 3);
+	if (shape == 0) {
+		ellipse(mask, RotatedRect(centre, Size2f((float)(2 * a), (float)(2 * b)), (float)angle), Scalar(255), FILLED);
+	}
+	else if (shape == 1) {
+		Point2f corners[4];
+		RotatedRect(centre, Size2f((float)(2 * a), (float)(2 * b)), (float)angle).points(corners);
+		std::vector<Point> polygon;
+		for (int i = 0; i < 4; i++)
+			polygon.push_back(Point(cvRound(corners[i].x), cvRound(corners[i].y)));
+		fillConvexPoly(mask, polygon, Scalar(255));
+	}
+	else {
+		std::vector<Point> points, hull;
+		for (int i = 0; i < 7; i++) {
+			double t = rng.uniform(0.0, 2 * CV_PI);
+			points.push_back(Point(cvRound(centre.x + a * cos(t)), cvRound(centre.y + b * sin(t))));
+		}
+		convexHull(points, hull);
+		fillConvexPoly(mask, hull, Scalar(255));
+	}
+}
+
+void makeSyntheticPair(const Mat& source, const SyntheticMotionParams& params, SyntheticPair& pair)
+{
+	CV_Assert(!source.empty() && source.type() == CV_8UC3);
+	CV_Assert(params.model >= 0 && params.model < MOTION_COUNT);
+
+	static const double default_magnitude[MOTION_COUNT] = { 8.0, 6.0, 10.0, 10.0, 160.0 };
+	double m = params.magnitude > 0 ? params.magnitude : default_magnitude[params.model];
+	Size size = source.size();
+	Point2d centre(size.width / 2.0, size.height / 2.0);
+	RNG rng(params.seed * 2654435761u + 1);
+
+	// Background motion
+	Matx33d background;
+	switch (params.model) {
+	case MOTION_TRANSLATION:
+		background = similarityAbout(centre, 0, 1, Point2d(rng.uniform(-m, m), rng.uniform(-m, m)));
+		break;
+	case MOTION_AFFINE: {
+		Matx33d shear(1, rng.uniform(-0.02, 0.02), 0, rng.uniform(-0.02, 0.02), 1, 0, 0, 0, 1);
+		Matx33d to_origin(1, 0, -centre.x, 0, 1, -centre.y, 0, 0, 1), back(1, 0, centre.x, 0, 1, centre.y, 0, 0, 1);
+		background = similarityAbout(centre, rng.uniform(-3.0, 3.0) * CV_PI / 180, rng.uniform(0.97, 1.03),
+			Point2d(rng.uniform(-m, m), rng.uniform(-m, m))) * back * shear * to_origin;
+		break;
+	}
+	case MOTION_HOMOGRAPHY: {
+		Point2f from[4] = { Point2f(0, 0), Point2f((float)size.width, 0), Point2f((float)size.width, (float)size.height), Point2f(0, (float)size.height) };
+		Point2f to[4];
+		for (int i = 0; i < 4; i++)
+			to[i] = from[i] + Point2f((float)rng.uniform(-m, m), (float)rng.uniform(-m, m));
+		Mat H = getPerspectiveTransform(from, to);
+		background = Matx33d(H.ptr<double>());
+		break;
+	}
+	case MOTION_LAYERED:
+		background = similarityAbout(centre, rng.uniform(-1.0, 1.0) * CV_PI / 180, rng.uniform(0.99, 1.01), randomDirection(rng, 0, 0.5 * m));
+		break;
+	case MOTION_LARGE:
+		background = similarityAbout(centre, 0, 1, randomDirection(rng, 0, 0.25 * m));
+		break;
+	}
+
+	pair.i1 = source.clone();
+	warpPerspective(source, pair.i2, background, size, INTER_LINEAR, BORDER_REFLECT);
+	transformFlow(background, size, pair.flow);
+
+	// Surface labels, 0 for the background and k + 1 for layer k, in each frame
+	Mat labels1 = Mat::zeros(size, CV_8U), labels2 = Mat::zeros(size, CV_8U);
+
+	int layers = (params.model == MOTION_LAYERED || params.model == MOTION_LARGE) ? (std::min)(params.layers, 254) : 0;
+	for (int k = 0; k < layers; k++) {
+		Mat mask1, mask2, texture, texture2, layer_flow;
+		Point2d layer_centre;
+		drawLayerMask(rng, size, mask1, layer_centre);
+
+		Point2d translation = params.model == MOTION_LARGE ? randomDirection(rng, 0.7 * m, 1.3 * m) : randomDirection(rng, 0.3 * m, m);
+		Matx33d motion = similarityAbout(layer_centre, rng.uniform(-5.0, 5.0) * CV_PI / 180, rng.uniform(0.97, 1.03), translation);
+
+		// Layers carry a different texture than the background so their boundaries are visible
+		flip(source, texture, k % 2 == 0 ? -1 : 1);
+		warpPerspective(texture, texture2, motion, size, INTER_LINEAR, BORDER_REFLECT);
+		warpPerspective(mask1, mask2, motion, size, INTER_NEAREST, BORDER_CONSTANT, Scalar(0));
+
+		// Later layers are in front of earlier ones in both frames
+		texture.copyTo(pair.i1, mask1);
+		texture2.copyTo(pair.i2, mask2);
+		transformFlow(motion, size, layer_flow);
+		layer_flow.copyTo(pair.flow, mask1);
+		labels1.setTo(k + 1, mask1);
+		labels2.setTo(k + 1, mask2);
+	}
+
+	// A pixel is occluded when its surface is not the one visible at its destination, or it leaves the image
+	pair.occluded.create(size, CV_8U);
+	parallel_for_(Range(0, size.height), [&](const Range& rows) {
+		for (int y = rows.start; y < rows.end; y++) {
+			const float* f = pair.flow.ptr<float>(y);
+			const uchar* l1 = labels1.ptr<uchar>(y);
+			uchar* o = pair.occluded.ptr<uchar>(y);
+			for (int x = 0; x < size.width; x++) {
+				int x2 = cvRound(x + f[2 * x]), y2 = cvRound(y + f[2 * x + 1]);
+				bool inside = x2 >= 0 && x2 < size.width && y2 >= 0 && y2 < size.height;
+				o[x] = (!inside || labels2.at<uchar>(y2, x2) != l1[x]) ? 255 : 0;
+			}
+		}
+	});
+}
+
+int writeSyntheticDataset(const std::string& output_dir, int pairs, Size size, const std::string& source_path)
+{
+	Mat source;
+	if (!source_path.empty()) {
+		source = imread(source_path, IMREAD_COLOR);
+		if (source.empty()) {
+			printf("Could not read texture %s\n", source_path.c_str());
+			return -1;
+		}
+		resize(source, source, size, 0, 0, INTER_AREA);
+	}
+
+	std::ofstream kitti_manifest((output_dir + "/synthetic_kitti.txt").c_str());
+	std::ofstream middlebury_manifest((output_dir + "/synthetic_middlebury.txt").c_str());
+	if (!kitti_manifest.is_open() || !middlebury_manifest.is_open()) {
+		printf("Could not write manifests to %s\n", output_dir.c_str());
+		return -1;
+	}
+	kitti_manifest << "# synthetic pairs, " << size.width << "x" << size.height << ", KITTI ground truth of non-occluded pixels\n";
+	middlebury_manifest << "# synthetic pairs, " << size.width << "x" << size.height << ", .flo ground truth of all pixels\n";
+
+	for (int i = 0; i < pairs; i++) {
+		SyntheticMotionParams params;
+		params.model = i % MOTION_COUNT;
+		params.seed = (uint64)i + 1;
+		SyntheticPair pair;
+		makeSyntheticPair(source.empty() ? texturedFrame(size, params.seed) : source, params, pair);
+
+		char name[32];
+		sprintf(name, "synthetic_%06d", i);
+		std::string base = output_dir + "/" + name;
+		Mat flow_noc = pair.flow.clone();
+		flow_noc.setTo(Scalar::all(std::numeric_limits<float>::quiet_NaN()), pair.occluded);
+
+		if (!imwrite(base + "_10.png", pair.i1) || !imwrite(base + "_11.png", pair.i2) || !imwrite(base + "_occ.png", pair.occluded) ||
+			!optflow::writeOpticalFlow(base + ".flo", pair.flow) || !writeKittiFlow(base + "_flow_occ.png", pair.flow) ||
+			!writeKittiFlow(base + "_flow_noc.png", flow_noc)) {
+			printf("Could not write %s\n", base.c_str());
+			return -1;
+		}
+
+		std::string n = name;
+		kitti_manifest << "kitti " << n << "_10.png " << n << "_11.png " << n << "_flow_noc.png\n";
+		middlebury_manifest << "middlebury " << n << "_10.png " << n << "_11.png " << n << ".flo\n";
+		if ((i + 1) % 10 == 0 || i + 1 == pairs)
+			printf("  %d / %d pairs (%s)\n", i + 1, pairs, syntheticMotionName(params.model));
+	}
+	return pairs;
+}
@@ -0,0 +1,65 @@
+/*!
+\file SyntheticFlow.h
+\brief Synthetic image pairs with exact ground truth flow from parametric and layered motion fields
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+
+#include <string>
+
+using namespace cv;
+
+// Procedural test frames: a blurred random texture (same seed, same frame) and a copy of a frame
+// translated by a sub-pixel offset with reflected borders
+Mat texturedFrame(Size size, uint64 seed);
+Mat translatedFrame(const Mat& frame, double dx, double dy);
+
+enum SyntheticMotion {
+	MOTION_TRANSLATION = 0,
+	MOTION_AFFINE,				// rotation, scale and shear about the image centre plus translation
+	MOTION_HOMOGRAPHY,			// image corners displaced independently
+	MOTION_LAYERED,				// moving background with piecewise-rigid foreground layers that occlude it
+	MOTION_LARGE,				// layered, with displacements beyond DegrafFlowParams::max_flow_length
+	MOTION_COUNT
+};
+
+// One generated pair. The second frame is the first warped forward, so flow(x) is exactly the motion of
+// the surface visible at x in the first frame.
+struct SyntheticPair {
+	Mat i1, i2;					// CV_8UC3
+	Mat flow;					// CV_32FC2, every pixel
+	Mat occluded;				// CV_8U, non-zero where the pixel is hidden or leaves the image in the second frame
+};
+
+struct SyntheticMotionParams {
+	int model = MOTION_TRANSLATION;
+	double magnitude = 0;		// typical displacement in pixels, 0 for the model's default
+	int layers = 3;				// foreground layers of the layered models
+	uint64 seed = 0;			// motion parameters and layer shapes are drawn from this seed
+};
+
+// Generates a pair from a source texture
+/*!
+\param source CV_8UC3 first frame, also the texture of the background
+\param params motion model and its random parameters
+\param pair output
+*/
+void makeSyntheticPair(const Mat& source, const SyntheticMotionParams& params, SyntheticPair& pair);
+
+const char* syntheticMotionName(int model);
+
+// Writes pairs cycling through every motion model, as <dir>/synthetic_NNNNNN_10.png / _11.png with
+// ground truth as .flo (all pixels), KITTI png in flow_occ (all pixels) and flow_noc (occluded pixels
+// invalid), plus manifests synthetic_kitti.txt (KITTI format, non-occluded) and synthetic_middlebury.txt
+// (.flo) for --batch, --build-cache and --sweep.
+/*!
+\param output_dir existing directory the files are written to
+\param pairs number of pairs
+\param size frame size
+\param source_path texture image, resized to size; empty for a procedural texture per pair
+\return number of pairs written, -1 on error
+*/
+int writeSyntheticDataset(const std::string& output_dir, int pairs, Size size, const std::string& source_path = "");
@@ -0,0 +1,177 @@
+/*!
+\file TaskGraph.cpp
+\brief Dependency-driven task executor on a work-stealing thread pool
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+
+// Worker index of the calling thread within the graph that owns it, -1 outside any graph
+static thread_local const TaskGraph* current_graph = NULL;
+static thread_local int current_worker = -1;
+
+TaskGraph::TaskGraph(int threads)
+{
+	next_queue = 0;
+	ready = 0;
+	stopping = false;
+	unfinished = 0;
+	if (threads <= 0)
+		threads = ThreadPool::hardwareThreads();
+	for (int i = 0; i < threads; i++)
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+	for (int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&TaskGraph::workerLoop, this, i));
+}
+
+TaskGraph::~TaskGraph()
+{
+	waitAll();
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	sleep_cv.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+TaskGraph::Handle TaskGraph::add(std::function<void()> work, const std::vector<Handle>& dependencies)
+{
+	Handle task = std::make_shared<Task>();
+	task->work = std::move(work);
+	task->remaining = 1;
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		unfinished++;
+	}
+
+	// A dependency that finishes meanwhile either sees the task in its successors or is seen as finished
+	// here, never neither: both sides look under the dependency's mutex
+	for (size_t i = 0; i < dependencies.size(); i++) {
+		const Handle& dependency = dependencies[i];
+		if (!dependency)
+			continue;
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (!dependency->finished) {
+			task->remaining++;
+			dependency->successors.push_back(task);
+		}
+	}
+	if (--task->remaining == 0)
+		schedule(task);
+	return task;
+}
+
+void TaskGraph::wait(const Handle& task)
+{
+	if (!task)
+		return;
+	std::unique_lock<std::mutex> lock(task->mutex);
+	task->finished_cv.wait(lock, [&]() { return task->finished; });
+	if (task->error)
+		std::rethrow_exception(task->error);
+}
+
+void TaskGraph::waitAll()
+{
+	std::unique_lock<std::mutex> lock(idle_mutex);
+	idle_cv.wait(lock, [this]() { return unfinished == 0; });
+}
+
+void TaskGraph::schedule(const Handle& task)
+{
+	int worker = (current_graph == this) ? current_worker : (int)(next_queue++ % queues.size());
+	{
+		std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+		queues[worker]->tasks.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		ready++;
+	}
+	sleep_cv.notify_one();
+}
+
+TaskGraph::Handle TaskGraph::take(int worker)
+{
+	Handle task;
+
+	// Newest task of its own deque first, then the oldest of the others
+	{
+		WorkerQueue& own = *queues[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+		}
+	}
+	for (size_t i = 1; !task && i < queues.size(); i++) {
+		WorkerQueue& victim = *queues[(worker + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+		}
+	}
+
+	if (task) {
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		ready--;
+	}
+	return task;
+}
+
+void TaskGraph::run(const Handle& task)
+{
+	std::exception_ptr error;
+	try {
+		task->work();
+	}
+	catch (...) {
+		error = std::current_exception();
+	}
+	task->work = std::function<void()>();	// drop what the task captured as soon as it is done
+
+	std::vector<Handle> successors;
+	{
+		std::lock_guard<std::mutex> lock(task->mutex);
+		task->finished = true;
+		task->error = error;
+		successors.swap(task->successors);
+	}
+	task->finished_cv.notify_all();
+
+	for (size_t i = 0; i < successors.size(); i++) {
+		if (--successors[i]->remaining == 0)
+			schedule(successors[i]);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		if (--unfinished == 0)
+			idle_cv.notify_all();
+	}
+}
+
+void TaskGraph::workerLoop(int worker)
+{
+	current_graph = this;
+	current_worker = worker;
+	for (;;) {
+		Handle task = take(worker);
+		if (task) {
+			run(task);
+			continue;
+		}
+
+		// Sleep until something is queued. A task may sit in a deque already scanned, so wake up on the
+		// count rather than on what this worker saw.
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleep_cv.wait(lock, [this]() { return stopping || ready > 0; });
+		if (stopping && ready == 0)
+			return;
+	}
+}
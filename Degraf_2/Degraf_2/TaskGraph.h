@@ -0,0 +1,89 @@
+/*!
+\file TaskGraph.h
+\brief Dependency-driven task executor on a work-stealing thread pool
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs tasks as soon as the tasks they depend on have finished. The graph may grow while it runs: a task
+// can be added with dependencies that are still pending, running or already done.
+//
+// Every worker owns a deque. Tasks made ready by a worker go to the back of its own deque and it takes
+// work from the back (the successor of what it just finished, whose inputs are still in cache); an idle
+// worker steals from the front of the other deques. Tasks added from outside the pool are spread over
+// the deques in turn. Tasks are coarse (an image stage), so each deque is guarded by its own mutex.
+class TaskGraph {
+
+	public:
+		struct Task;
+		typedef std::shared_ptr<Task> Handle;
+
+		// threads <= 0 uses one worker per hardware thread
+		explicit TaskGraph(int threads = 0);
+
+		// Finishes every task added, then joins the workers
+		~TaskGraph();
+
+		int size() const { return (int)workers.size(); }
+
+		// Adds a task that runs once all dependencies have finished (empty handles are ignored). A task that
+		// throws still counts as finished for its successors; the exception is rethrown by wait().
+		/*!
+		\return handle to depend on or wait for
+		*/
+		Handle add(std::function<void()> work, const std::vector<Handle>& dependencies = std::vector<Handle>());
+
+		// Blocks until the task has finished. Must not be called from inside a task.
+		void wait(const Handle& task);
+
+		// Blocks until every task added so far has finished
+		void waitAll();
+
+	private:
+		struct WorkerQueue {
+			std::mutex mutex;
+			std::deque<Handle> tasks;
+		};
+
+		std::vector<std::thread> workers;
+		std::vector<std::unique_ptr<WorkerQueue> > queues;
+		std::atomic<unsigned int> next_queue;		// round robin for tasks added from outside the pool
+
+		std::mutex sleep_mutex;
+		std::condition_variable sleep_cv;
+		int ready;									// tasks queued and not yet taken
+		bool stopping;
+
+		std::mutex idle_mutex;
+		std::condition_variable idle_cv;
+		long long unfinished;						// tasks added and not yet finished
+
+		void schedule(const Handle& task);
+		Handle take(int worker);
+		void run(const Handle& task);
+		void workerLoop(int worker);
+
+		TaskGraph(const TaskGraph&);
+		TaskGraph& operator=(const TaskGraph&);
+};
+
+struct TaskGraph::Task {
+	std::function<void()> work;
+	std::atomic<int> remaining;				// unfinished dependencies, plus one while the task is being added
+	std::mutex mutex;
+	std::condition_variable finished_cv;
+	bool finished = false;
+	std::vector<Handle> successors;			// released once the task has finished
+	std::exception_ptr error;
+};
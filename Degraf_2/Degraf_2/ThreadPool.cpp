@@ -0,0 +1,100 @@
+/*!
+\file ThreadPool.cpp
+\brief Fixed-size worker pool for running independent jobs (image pairs, files) concurrently
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+int ThreadPool::hardwareThreads()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return n > 0 ? (int)n : 1;
+}
+
+bool ThreadPool::pinCurrentThread(int cpu)
+{
+	cpu = cpu % hardwareThreads();
+#ifdef _WIN32
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+bool ThreadPool::lowerCurrentThreadPriority()
+{
+#ifdef _WIN32
+	return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL) != 0;
+#elif defined(__linux__)
+	sched_param param;
+	param.sched_priority = 0;
+	return pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) == 0;
+#else
+	return false;
+#endif
+}
+
+ThreadPool::ThreadPool(int threads)
+{
+	running = 0;
+	stopping = false;
+	if (threads <= 0)
+		threads = hardwareThreads();
+	for (int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+// Finishes the queued jobs, then joins the workers
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	queue_cv.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	idle_cv.wait(lock, [this]() { return jobs.empty() && running == 0; });
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_cv.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			running++;
+		}
+		job();
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			running--;
+			if (jobs.empty() && running == 0)
+				idle_cv.notify_all();
+		}
+	}
+}
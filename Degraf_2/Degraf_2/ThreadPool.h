@@ -0,0 +1,99 @@
+/*!
+\file ThreadPool.h
+\brief Fixed-size worker pool for running independent jobs (image pairs, files) concurrently
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core/utility.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Workers take jobs from a single FIFO queue. Jobs are coarse (a whole image pair or file), so one
+// mutex-protected queue is not a bottleneck. submit() returns a future for the job's result; exceptions
+// thrown by a job are delivered through the future.
+class ThreadPool {
+
+	public:
+		// threads <= 0 uses one worker per hardware thread
+		explicit ThreadPool(int threads = 0);
+		~ThreadPool();
+
+		int size() const { return (int)workers.size(); }
+
+		template <typename F>
+		std::future<typename std::result_of<F()>::type> submit(F job)
+		{
+			typedef typename std::result_of<F()>::type R;
+			std::shared_ptr<std::packaged_task<R()> > task = std::make_shared<std::packaged_task<R()> >(job);
+			std::future<R> result = task->get_future();
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex);
+				jobs.push_back([task]() { (*task)(); });
+			}
+			queue_cv.notify_one();
+			return result;
+		}
+
+		// Blocks until the queue is empty and no job is running
+		void wait();
+
+		static int hardwareThreads();
+
+		// Restricts the calling thread to one logical CPU (cpu modulo the hardware thread count)
+		/*!
+		\return false if the platform refused or does not support it
+		*/
+		static bool pinCurrentThread(int cpu);
+
+		// Lowers the calling thread below normal priority, for work that must not compete with the pipeline
+		/*!
+		\return false if the platform refused or does not support it
+		*/
+		static bool lowerCurrentThreadPriority();
+
+	private:
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()> > jobs;
+		std::mutex queue_mutex;
+		std::condition_variable queue_cv;
+		std::condition_variable idle_cv;
+		int running;
+		bool stopping;
+
+		void workerLoop();
+};
+
+// While jobs already run in parallel on several workers, nested OpenCV parallel loops would only
+// oversubscribe the cores. Holds OpenCV to one thread for its lifetime if there is more than one worker,
+// and restores the previous count on destruction.
+class SerialOpenCVScope {
+
+	public:
+		explicit SerialOpenCVScope(int workers) : saved_threads(cv::getNumThreads()), changed(workers > 1)
+		{
+			if (changed)
+				cv::setNumThreads(1);
+		}
+
+		~SerialOpenCVScope()
+		{
+			if (changed)
+				cv::setNumThreads(saved_threads);
+		}
+
+	private:
+		int saved_threads;
+		bool changed;
+
+		SerialOpenCVScope(const SerialOpenCVScope&);
+		SerialOpenCVScope& operator=(const SerialOpenCVScope&);
+};
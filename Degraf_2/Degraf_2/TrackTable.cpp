@@ -0,0 +1,169 @@
+/*!
+\file TrackTable.cpp
+\brief Feature tracks of the visual odometry as a structure of arrays with single-pass compaction
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "TrackTable.h"
+
+#include <algorithm>
+
+TrackTable::TrackTable()
+{
+	next_id = 0;
+	tracked = false;
+	prev_pyramid_source = curr_pyramid_source = NULL;
+	pyramid_window = Size(21, 21);
+	pyramid_levels = 3;
+	pyramid_builds = 0;
+}
+
+void TrackTable::reset(const std::vector<Point2f>& points, const std::vector<float>& point_responses)
+{
+	CV_Assert(point_responses.empty() || point_responses.size() == points.size());
+	prev_points = points;
+	curr_points.clear();
+	tracked = false;
+	ids.resize(points.size());
+	ages.assign(points.size(), 0);
+	errors.assign(points.size(), 0.0f);
+	if (point_responses.empty())
+		responses.assign(points.size(), 1.0f);
+	else
+		responses = point_responses;
+	for (size_t i = 0; i < points.size(); i++)
+		ids[i] = next_id++;
+}
+
+void TrackTable::append(const std::vector<Point2f>& points, const std::vector<float>& point_responses)
+{
+	CV_Assert(point_responses.empty() || point_responses.size() == points.size());
+	// New tracks start in the latest frame; their previous position repeats it and is replaced by advance()
+	prev_points.insert(prev_points.end(), points.begin(), points.end());
+	if (tracked)
+		curr_points.insert(curr_points.end(), points.begin(), points.end());
+	for (size_t i = 0; i < points.size(); i++) {
+		ids.push_back(next_id++);
+		ages.push_back(0);
+		errors.push_back(0.0f);
+		responses.push_back(point_responses.empty() ? 1.0f : point_responses[i]);
+	}
+}
+
+int TrackTable::track(const Mat& prev_image, const Mat& curr_image, Size window, int levels, TermCriteria criteria)
+{
+	tracked = true;
+	if (prev_points.empty()) {
+		curr_points.clear();
+		return 0;
+	}
+	if (window != pyramid_window || levels != pyramid_levels) {
+		pyramid_window = window;
+		pyramid_levels = levels;
+		prev_pyramid_source = curr_pyramid_source = NULL;
+	}
+	updatePyramids(prev_image, curr_image);
+	calcOpticalFlowPyrLK(prev_pyramid, curr_pyramid, prev_points, curr_points, status, lk_errors, window, levels, criteria, 0, 0.001);
+
+	// Tracks outside the image are failures too
+	for (size_t i = 0; i < status.size(); i++) {
+		if (curr_points[i].x < 0 || curr_points[i].y < 0)
+			status[i] = 0;
+		else if (status[i] != 0) {
+			ages[i]++;
+			errors[i] = lk_errors[i];
+		}
+	}
+	return compact(status);
+}
+
+double TrackTable::probeMotion(const Mat& prev_image, const Mat& curr_image, int samples)
+{
+	const std::vector<Point2f>& from = latest();
+	if (from.empty() || samples <= 0)
+		return -1;
+	size_t stride = (std::max)((size_t)1, from.size() / samples);
+	probe_from.clear();
+	for (size_t i = 0; i < from.size(); i += stride)
+		probe_from.push_back(from[i]);
+
+	// A small window is enough to tell a stationary frame from a moving one. The pyramids are the ones
+	// track() uses, so probing a frame that is then tracked builds nothing extra.
+	updatePyramids(prev_image, curr_image);
+	calcOpticalFlowPyrLK(prev_pyramid, curr_pyramid, probe_from, probe_to, probe_status, probe_errors, Size(11, 11), pyramid_levels,
+		TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 10, 0.03));
+
+	probe_motion.clear();
+	for (size_t i = 0; i < probe_from.size(); i++) {
+		if (probe_status[i] != 0)
+			probe_motion.push_back((float)norm(probe_to[i] - probe_from[i]));
+	}
+	if (probe_motion.size() * 2 < probe_from.size())
+		return -1;
+	std::nth_element(probe_motion.begin(), probe_motion.begin() + probe_motion.size() / 2, probe_motion.end());
+	return probe_motion[probe_motion.size() / 2];
+}
+
+int TrackTable::compact(const std::vector<uchar>& keep)
+{
+	CV_Assert(keep.size() == ids.size());
+	bool has_current = curr_points.size() == ids.size();
+	size_t n = 0;
+	for (size_t i = 0; i < keep.size(); i++) {
+		if (keep[i] == 0)
+			continue;
+		if (n != i) {
+			prev_points[n] = prev_points[i];
+			if (has_current)
+				curr_points[n] = curr_points[i];
+			ids[n] = ids[i];
+			ages[n] = ages[i];
+			errors[n] = errors[i];
+			responses[n] = responses[i];
+		}
+		n++;
+	}
+	prev_points.resize(n);
+	if (has_current)
+		curr_points.resize(n);
+	ids.resize(n);
+	ages.resize(n);
+	errors.resize(n);
+	responses.resize(n);
+	return (int)n;
+}
+
+void TrackTable::advance()
+{
+	prev_points.swap(curr_points);
+	curr_points.clear();
+	tracked = false;
+
+	// The old previous pyramid's buffers are reused for the next frame. Its image may be released and
+	// decoded into again, so it no longer counts as built.
+	prev_pyramid.swap(curr_pyramid);
+	prev_pyramid_source = curr_pyramid_source;
+	curr_pyramid_source = NULL;
+}
+
+void TrackTable::updatePyramids(const Mat& prev_image, const Mat& curr_image)
+{
+	if (prev_pyramid_source == NULL || prev_pyramid_source != prev_image.data) {
+		buildOpticalFlowPyramid(prev_image, prev_pyramid, pyramid_window, pyramid_levels);
+		prev_pyramid_source = prev_image.data;
+		pyramid_builds++;
+	}
+	if (curr_pyramid_source == NULL || curr_pyramid_source != curr_image.data) {
+		buildOpticalFlowPyramid(curr_image, curr_pyramid, pyramid_window, pyramid_levels);
+		curr_pyramid_source = curr_image.data;
+		pyramid_builds++;
+	}
+}
+
+void TrackTable::quality(std::vector<float>& out) const
+{
+	out.resize(ids.size());
+	for (size_t i = 0; i < ids.size(); i++)
+		out[i] = responses[i] / (1.0f + errors[i]);
+}
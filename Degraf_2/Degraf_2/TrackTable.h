@@ -0,0 +1,118 @@
+/*!
+\file TrackTable.h
+\brief Feature tracks of the visual odometry as a structure of arrays with single-pass compaction
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+#include "opencv2/video/tracking.hpp"
+
+#include <vector>
+
+using namespace cv;
+
+// One column per track: its position in the previous and current frame, a stable id, the number of
+// frames it has been tracked for, the last LK error and the detector response it started from. Columns are plain vectors, so previous() and
+// current() feed findEssentialMat and recoverPose without conversion. Failed tracks are removed by one
+// order-preserving pass, and advance() swaps the frames instead of copying positions.
+//
+// The LK pyramids of both frames are kept as well. advance() turns the current frame's pyramid into the
+// previous one, so each frame's pyramid is built once: tracking the same pair again (after a reseed) or
+// probing the motion first reuses them. A pyramid is rebuilt if the image passed is not the one it was
+// built from (compared by data pointer, so an image must not be overwritten while it is the table's frame).
+class TrackTable {
+
+	public:
+		TrackTable();
+
+		// Replaces all tracks by new ones at points, with fresh ids and age 0
+		/*!
+		\param responses detector response of each point; empty for all 1
+		*/
+		void reset(const std::vector<Point2f>& points, const std::vector<float>& responses = std::vector<float>());
+
+		// Adds tracks at points with fresh ids and age 0 after the existing ones, which keep their ids and order.
+		// The points are in the table's latest frame, see latest().
+		/*!
+		\param responses detector response of each point; empty for all 1
+		*/
+		void append(const std::vector<Point2f>& points, const std::vector<float>& responses = std::vector<float>());
+
+		// Tracks the previous positions from prev_image into curr_image with pyramidal LK and drops the tracks
+		// that failed or left the image
+		/*!
+		\param prev_image previous grey frame
+		\param curr_image current grey frame
+		\param window LK window size
+		\param levels pyramid levels; window and levels should stay the same between calls, a change rebuilds the pyramids
+		\param criteria LK termination criteria
+		\return number of tracks kept
+		*/
+		int track(const Mat& prev_image, const Mat& curr_image, Size window = Size(21, 21), int levels = 3,
+			TermCriteria criteria = TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 30, 0.01));
+
+		// Cheap motion estimate: tracks an evenly spaced subset of the latest positions from prev_image into
+		// curr_image and takes the median displacement. The table is not changed.
+		/*!
+		\param samples tracks probed at most
+		\return median displacement in pixels, -1 if fewer than half the probes could be tracked
+		*/
+		double probeMotion(const Mat& prev_image, const Mat& curr_image, int samples = 64);
+
+		// Keeps the tracks with keep[i] != 0 in their order, in one pass over all columns
+		/*!
+		\return number of tracks kept
+		*/
+		int compact(const std::vector<uchar>& keep);
+
+		// The current positions become the previous ones (a swap, no copy)
+		void advance();
+
+		// Pyramids built so far, one per frame when the frames are passed in order
+		long long pyramidBuilds() const { return pyramid_builds; }
+
+		int size() const { return (int)ids.size(); }
+		bool empty() const { return ids.empty(); }
+
+		const std::vector<Point2f>& previous() const { return prev_points; }
+		const std::vector<Point2f>& current() const { return curr_points; }
+		// Positions in the newest frame: current() once the table has been tracked, previous() after reset() or advance()
+		const std::vector<Point2f>& latest() const { return tracked ? curr_points : prev_points; }
+		const std::vector<int>& trackIds() const { return ids; }
+		const std::vector<int>& trackAges() const { return ages; }
+		const std::vector<float>& trackErrors() const { return errors; }
+		const std::vector<float>& trackResponses() const { return responses; }
+
+		// Ranking of the tracks for PROSAC: detector response discounted by the LK error, response / (1 + error)
+		void quality(std::vector<float>& out) const;
+
+	private:
+		std::vector<Point2f> prev_points, curr_points;
+		std::vector<int> ids;
+		std::vector<int> ages;
+		std::vector<float> errors;
+		std::vector<float> responses;
+		int next_id;
+		bool tracked;					// current positions are valid (track() since the last reset() or advance())
+
+		// LK outputs, kept to reuse their allocation
+		std::vector<uchar> status;
+		std::vector<float> lk_errors;
+
+		// Pyramids of the previous and current frame, with derivatives, and the images they were built from
+		std::vector<Mat> prev_pyramid, curr_pyramid;
+		const uchar* prev_pyramid_source;
+		const uchar* curr_pyramid_source;
+		Size pyramid_window;
+		int pyramid_levels;
+		long long pyramid_builds;
+
+		void updatePyramids(const Mat& prev_image, const Mat& curr_image);
+
+		// probeMotion buffers
+		std::vector<Point2f> probe_from, probe_to;
+		std::vector<uchar> probe_status;
+		std::vector<float> probe_errors, probe_motion;
+};
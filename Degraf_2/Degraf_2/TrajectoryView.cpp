@@ -0,0 +1,120 @@
+/*!
+\file TrajectoryView.cpp
+\brief Odometry display on its own low-priority thread, dropping camera frames when it falls behind
+\author Felix Stephenson
+*/
+
+#include "stdafx.h"
+#include "TrajectoryView.h"
+#include "ThreadPool.h"
+
+#include "opencv2/imgproc.hpp"
+#include "opencv2/highgui.hpp"
+
+TrajectoryView::TrajectoryView(const Mat& background)
+{
+	if (background.empty())
+		trajectory = Mat::zeros(600, 600, CV_8UC3);
+	else
+		trajectory = background.clone();
+	frame_pending = false;
+	stopping = false;
+	shown = dropped = 0;
+	display = std::thread(&TrajectoryView::displayLoop, this);
+}
+
+TrajectoryView::~TrajectoryView()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	display.join();
+}
+
+void TrajectoryView::update(const Mat& frame, const Vec3d& position)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending_positions.push_back(position);
+		if (frame_pending) {
+			dropped++;
+		}
+		else {
+			frame.copyTo(pending_frame);
+			frame_pending = true;
+		}
+	}
+	wake.notify_one();
+}
+
+long long TrajectoryView::shownFrames() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return shown;
+}
+
+long long TrajectoryView::droppedFrames() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return dropped;
+}
+
+void TrajectoryView::displayLoop()
+{
+	ThreadPool::lowerCurrentThreadPriority();
+
+	// HighGUI windows belong to the thread that created them
+	namedWindow("Road facing camera", WINDOW_AUTOSIZE);
+	namedWindow("Trajectory", WINDOW_AUTOSIZE);
+
+	char text[100];
+	int fontFace = FONT_HERSHEY_PLAIN;
+	double fontScale = 1;
+	int thickness = 1;
+	cv::Point textOrg(10, 50);
+
+	std::vector<Vec3d> positions;
+	Mat frame;
+	for (;;) {
+		bool has_frame, stop;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || frame_pending || !pending_positions.empty(); });
+			positions.swap(pending_positions);
+			pending_positions.clear();
+			has_frame = frame_pending;
+			if (has_frame)
+				std::swap(frame, pending_frame);
+			frame_pending = false;
+			stop = stopping;
+		}
+
+		for (size_t i = 0; i < positions.size(); i++) {
+			int x = int(positions[i][0]) + 300;
+			int y = int(positions[i][2]) + 100;
+			circle(trajectory, Point(x, y), 1, CV_RGB(0, 0, 255), 1);
+		}
+		if (!positions.empty()) {
+			const Vec3d& t_f = positions.back();
+			rectangle(trajectory, Point(10, 30), Point(550, 50), CV_RGB(0, 0, 0), FILLED);
+			sprintf(text, "Coordinates: x = %02fm y = %02fm z = %02fm", t_f[0], t_f[1], t_f[2]);
+			putText(trajectory, text, textOrg, fontFace, fontScale, Scalar::all(255), thickness, 8);
+		}
+
+		if (has_frame)
+			imshow("Road facing camera", frame);
+		imshow("Trajectory", trajectory);
+		waitKey(1);
+
+		if (has_frame) {
+			std::lock_guard<std::mutex> lock(mutex);
+			shown++;
+		}
+		if (stop)
+			break;
+	}
+	destroyWindow("Road facing camera");
+	destroyWindow("Trajectory");
+}
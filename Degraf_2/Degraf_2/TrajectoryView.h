@@ -0,0 +1,56 @@
+/*!
+\file TrajectoryView.h
+\brief Odometry display on its own low-priority thread, dropping camera frames when it falls behind
+\author Felix Stephenson
+*/
+
+#pragma once
+
+#include "opencv2/core.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cv;
+
+// Shows the camera frame and the estimated trajectory. update() only records the position and, if the
+// display has taken the previous frame, copies the new one; the thread below normal priority does all
+// drawing, imshow and waitKey. Every position is drawn, camera frames arriving while the display is
+// busy are dropped.
+class TrajectoryView {
+
+	public:
+		/*!
+		\param background trajectory canvas, e.g. the ground truth drawn by Odometry::runGroundTruth; empty for a blank one
+		*/
+		explicit TrajectoryView(const Mat& background = Mat());
+
+		// Draws what is still pending, then closes the windows
+		~TrajectoryView();
+
+		/*!
+		\param frame camera frame, copied only when it will be shown
+		\param position estimated camera position (x, y, z) in metres
+		*/
+		void update(const Mat& frame, const Vec3d& position);
+
+		long long shownFrames() const;
+		long long droppedFrames() const;
+
+	private:
+		Mat trajectory;
+		std::vector<Vec3d> pending_positions;
+		Mat pending_frame;
+		bool frame_pending;
+		bool stopping;
+		long long shown, dropped;
+
+		mutable std::mutex mutex;
+		std::condition_variable wake;
+		std::thread display;
+
+		void displayLoop();
+};
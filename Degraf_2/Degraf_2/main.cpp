@@ -8,7 +8,23 @@
 #include "FeatureMatcher.h"
 #include "SaliencyDetector.h"
 #include "EvaluateOptFlow.h"
+#include "PresetBenchmark.h"
+#include "StageProfiler.h"
+#include "MemoryAccounting.h"
+#include "SoakTest.h"
+#include "BatchEvaluator.h"
+#include "DatasetCache.h"
+#include "ParameterSweep.h"
+#include "Microbenchmark.h"
+#include "SyntheticFlow.h"
+#include "MethodComparison.h"
+#include "ResultWriter.h"
+#include "PoseStore.h"
+#include "SequenceReader.h"
+#include "FlowVisualization.h"
 #include "vo_features.h"
+#include "OdometryRunner.h"
+#include "FlowPipeline.h"
 
 // OpenCV - requires contrib modules 
 #include "opencv2/videoio.hpp"
@@ -18,6 +34,7 @@
 #include "opencv2/xfeatures2d.hpp"
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <algorithm> 
 #include <vector>
@@ -26,53 +43,253 @@ using namespace cv;
 using namespace std;
 
 
+// Writes a demo video of degraf flow on an image sequence: each frame above its colour coded flow.
+// Frames are decoded ahead on the reader's threads, so the loop only computes flow and encodes video.
+/*!
+\param pattern printf pattern of the frame files, e.g. ".../sequences/00/image_0/%06d.png"
+\param output video file
+\param max_frames frames to process, < 0 for the whole sequence
+\return 0 on success, -1 on error
+*/
+static int writeFlowVideo(const string& pattern, const string& output, int max_frames)
+{
+	SequenceReader frames(pattern, 0, max_frames, IMREAD_COLOR);
+	Mat prevImage, currImage, flow;
+	if (!frames.frame(0, prevImage)) {
+		cout << "Could not read " << frames.path(0) << endl;
+		return -1;
+	}
+
+	VideoWriter outputVideo(output, CV_FOURCC('D', 'I', 'V', 'X'), 10, Size(prevImage.cols, prevImage.rows * 2), true);
+	if (!outputVideo.isOpened())
+	{
+		cout << "Could not open the output video for write: " << output << endl;
+		return -1;
+	}
+
+	FeatureMatcher f = FeatureMatcher();
+	Mat win_mat(Size(prevImage.cols, prevImage.rows * 2), CV_8UC3);
+	int numFrame = 1;
+	for (; frames.frame(numFrame, currImage); numFrame++) {
+		f.degraf_flow_RLOF(prevImage, currImage, flow, DegrafFlowParams());
+
+		// Copy small images into big mat
+		prevImage.copyTo(win_mat(cv::Rect(0, 0, prevImage.cols, prevImage.rows)));
+		flowToDisplay(flow).copyTo(win_mat(cv::Rect(0, prevImage.rows, prevImage.cols, prevImage.rows)));
+		outputVideo << win_mat;
+
+		imshow("Flow", win_mat);
+		waitKey(1);
+
+		frames.release(numFrame - 1);
+		prevImage = currImage;
+	}
+	printf("%d frames written to %s\n", numFrame - 1, output.c_str());
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
-	
+	////////////////////////// Benchmark modes //////////////////////////
+	// Degraf_2.exe --benchmark-presets [results.csv]  runtime and EPE of every DeGraF-Flow preset on KITTI and Middlebury
+	if (argc > 1 && string(argv[1]) == "--benchmark-presets") {
+		return runPresetBenchmark(argc > 2 ? argv[2] : "degraf_presets.csv");
+	}
+
+	// Degraf_2.exe --bench [results.json] [--baseline <file>] [--threshold 0.1] [--filter <text>] [--sizes vga,kitti,1080p,4k]
+	//                     [--threads 1,2,4] [--reps n]  per-stage microbenchmarks on procedural inputs, no data set needed
+	if (argc > 1 && string(argv[1]) == "--bench") {
+		BenchOptions options;
+		if (!parseBenchOptions(argc, argv, 2, options))
+			return -1;
+		return runMicrobenchmarks(options);
+	}
+
+	// Degraf_2.exe --batch <manifest> [method] [threads] [results.csv] [output dir] [flow|all|flow,colour,error,composite]
+	//                    [block|drop-newest|drop-oldest]  evaluates every pair of a manifest concurrently, results are written
+	//                                                     in the background
+	if (argc > 2 && string(argv[1]) == "--batch") {
+		int outputs = ResultWriter::OUTPUT_FLOW, policy = ResultWriter::POLICY_BLOCK;
+		if ((argc > 7 && !ResultWriter::parseOutputs(argv[7], outputs)) || (argc > 8 && !ResultWriter::parsePolicy(argv[8], policy))) {
+			printf("Unknown outputs or back-pressure policy\n");
+			return -1;
+		}
+		return runBatchEvaluation(argv[2], argc > 3 ? argv[3] : "degraf_flow_rlof", argc > 4 ? atoi(argv[4]) : 0,
+			argc > 5 ? argv[5] : "batch_results.csv", argc > 6 ? argv[6] : "", outputs, policy);
+	}
+
+	// Degraf_2.exe --sweep <manifest|cache.dgc> <grid> [results.csv] [rungs] [threads]  grid search over DeGraF-Flow parameters,
+	//                                                   rungs > 1 drops weak configurations early by successive halving
+	if (argc > 3 && string(argv[1]) == "--sweep") {
+		return runParameterSweep(argv[2], argv[3], argc > 4 ? argv[4] : "sweep_results.csv", argc > 5 ? atoi(argv[5]) : 1,
+			argc > 6 ? atoi(argv[6]) : 0);
+	}
+
+	// Degraf_2.exe --compare <manifest|cache.dgc> [methods|all] [results.csv] [--reps n] [--warmup n] [--workers n] [--pin]
+	//                                              runtime and accuracy of several flow methods on the same decoded pairs
+	if (argc > 2 && string(argv[1]) == "--compare") {
+		return runMethodComparison(argc, argv, 2);
+	}
+
+	// Degraf_2.exe --build-cache <manifest> <cache.dgc> [threads]  decodes all pairs once into a memory mapped container for --batch
+	if (argc > 3 && string(argv[1]) == "--build-cache") {
+		vector<ManifestEntry> entries;
+		if (!readManifest(argv[2], entries) || !DatasetCache::build(entries, argv[3], argc > 4 ? atoi(argv[4]) : 0))
+			return -1;
+		printf("%d pairs cached in %s\n", (int)entries.size(), argv[3]);
+		return 0;
+	}
+
+	// Degraf_2.exe --pose-cache <poses.txt> <poses.dgp>  converts KITTI ground truth poses to the memory mapped binary form
+	if (argc > 3 && string(argv[1]) == "--pose-cache") {
+		PoseStore poses;
+		if (!poses.load(argv[2]) || !poses.writeBinary(argv[3]))
+			return -1;
+		printf("%d poses written to %s\n", poses.size(), argv[3]);
+		return 0;
+	}
+
+	// Degraf_2.exe --make-manifest <kitti|middlebury> <data set root> <manifest>  lists the training pairs of a data set
+	if (argc > 4 && string(argv[1]) == "--make-manifest") {
+		int pairs = writeManifest(argv[2], argv[3], argv[4]);
+		printf("%d pairs written to %s\n", pairs, argv[4]);
+		return pairs > 0 ? 0 : -1;
+	}
+
+	// Degraf_2.exe --make-synthetic <output dir> [pairs] [WxH] [texture image]  pairs with exact ground truth and their manifests
+	if (argc > 2 && string(argv[1]) == "--make-synthetic") {
+		int w = 1242, h = 375;
+		if (argc > 4 && sscanf(argv[4], "%dx%d", &w, &h) != 2)
+			return -1;
+		int pairs = writeSyntheticDataset(argv[2], argc > 3 ? atoi(argv[3]) : 50, Size(w, h), argc > 5 ? argv[5] : "");
+		printf("%d synthetic pairs written to %s\n", pairs, argv[2]);
+		return pairs > 0 ? 0 : -1;
+	}
+
+	// Degraf_2.exe --video <frame pattern> <output.avi> [frames]  demo video of degraf flow on an image sequence,
+	//                                                          e.g. --video .../sequences/00/image_0/%06d.png flow.avi 500
+	if (argc > 3 && string(argv[1]) == "--video") {
+		return writeFlowVideo(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : -1);
+	}
+
+	// Degraf_2.exe --stream <frame pattern> [output.avi|-] [frames] [in flight] [threads]  degraf flow on an image sequence through
+	//                                                 the task graph pipeline, consecutive pairs overlapped; prints the throughput
+	if (argc > 2 && string(argv[1]) == "--stream") {
+		string video = argc > 3 ? argv[3] : "-";
+		return runFlowStream(argv[2], video == "-" ? "" : video, argc > 4 ? atoi(argv[4]) : -1, argc > 5 ? atoi(argv[5]) : 4,
+			argc > 6 ? atoi(argv[6]) : 0);
+	}
+
+	// Degraf_2.exe --odometry [poses.txt] [--headless] [--full-redetection] [--keyframe-motion <px>]  visual odometry on the sequence
+	//                                                 set in Odometry::run, estimated poses written in the KITTI format; --headless
+	//                                                 opens no windows, --full-redetection reseeds the whole frame when tracks run low,
+	//                                                 --keyframe-motion skips frames moving less than px from the last keyframe
+	if (argc > 1 && string(argv[1]) == "--odometry") {
+		Odometry vo = Odometry();
+		for (int a = 2; a < argc; a++) {
+			if (string(argv[a]) == "--headless")
+				vo.headless = true;
+			else if (string(argv[a]) == "--full-redetection")
+				vo.bucketed_redetection = false;
+			else if (string(argv[a]) == "--keyframe-motion" && a + 1 < argc)
+				vo.keyframe_motion = atof(argv[++a]);
+			else if (string(argv[a]).compare(0, 2, "--") != 0 && vo.pose_output.empty())
+				vo.pose_output = argv[a];
+			else {
+				printf("Unexpected argument %s\nUsage: Degraf_2.exe --odometry [poses.txt] [--headless] [--full-redetection] [--keyframe-motion <px>]\n", argv[a]);
+				return -1;
+			}
+		}
+		return vo.run();
+	}
+
+	// Degraf_2.exe --odometry-batch <sequence list> [output dir] [threads] [results.csv] [frame budget]  headless odometry on every
+	//                                                 sequence of the list concurrently, each with its own calibration and poses;
+	//                                                 estimated poses go to <output dir>/<name>.txt, timing and drift to results.csv
+	if (argc > 2 && string(argv[1]) == "--odometry-batch") {
+		return runOdometryBatch(argv[2], argc > 3 ? argv[3] : "", argc > 4 ? atoi(argv[4]) : 0, argc > 5 ? argv[5] : "odometry_results.csv",
+			argc > 6 ? atoi(argv[6]) : 64);
+	}
+
+	// Degraf_2.exe --make-sequence-list <KITTI odometry root> <sequence list>  lists the training sequences 00-10 for --odometry-batch
+	if (argc > 3 && string(argv[1]) == "--make-sequence-list") {
+		int sequences = writeSequenceList(argv[2], argv[3]);
+		printf("%d sequences written to %s\n", sequences, argv[3]);
+		return sequences > 0 ? 0 : -1;
+	}
+
+	// Degraf_2.exe --soak <frames> [max growth MB] [samples.csv]  long run on synthetic frames, fails if memory grows
+	if (argc > 2 && string(argv[1]) == "--soak") {
+		return runSoak(atoi(argv[2]), argc > 3 ? atof(argv[3]) : 16.0, argc > 4 ? argv[4] : "");
+	}
+
+	// Degraf_2.exe --profile <prefix>  writes per-stage timings to <prefix>.json/.csv/.prom, a Chrome trace to <prefix>_trace.json
+	//                                   and per-stage allocation counts to <prefix>_memory.csv
+	string profile_prefix;
+	for (int a = 1; a + 1 < argc; a++) {
+		if (string(argv[a]) == "--profile")
+			profile_prefix = argv[a + 1];
+	}
+	StageProfiler::instance().trace_enabled = !profile_prefix.empty();
+
+	// Count cv::Mat buffers per stage from here on
+	if (!profile_prefix.empty())
+		MemoryAccounting::instance().install();
+
 	////////////////////////// Flow evaluation //////////////////////////
 	// *** Must first specify image file locations in the run_evaluation function in EvaluateOptFlow class ***
 
+	// --save-results <dir>  runs headless and writes the flow, visualisations and results window of every pair to dir
+	//                       on a background thread
+	string results_dir;
+	for (int a = 1; a + 1 < argc; a++) {
+		if (string(argv[a]) == "--save-results")
+			results_dir = argv[a + 1];
+	}
+
 	EvaluateOptFlow e = EvaluateOptFlow();
 	int no_of_images = 1; // Number of image pairs to loop though
+	std::unique_ptr<ResultWriter> result_writer;
+	if (!results_dir.empty()) {
+		result_writer.reset(new ResultWriter(results_dir));
+		e.result_writer = result_writer.get();
+	}
 
 	// Run evaluation of a given optical flow method (see EvaluateOptFlow.cpp for all available methods)
 	for (int i = 0; i < no_of_images; i++) {
 		cout << "\nIMAGE #: " << i << "\n\n";
-		e.runEvaluation("degraf_flow_rlof", true, i); // specify flow method here
+		e.runEvaluation("degraf_flow_rlof", results_dir.empty(), i); // specify flow method here, saved results run headless
 	}
 
 	// Output all stats and averages
 	cout << "---------------   Stats  -------------------\n";
-	float EPE = 0;
-	float time = 0;
-	float std = 0;
-	float three = 0;
-	float two = 0;
-	cout << "# EPE      STD      0.5     1        2        3       5       10       time  \n";
-	for (size_t j = 0; j < no_of_images; j++)
-	{
-		EPE += e.all_stats[j][1];
-		time += e.all_stats[j][9];
-		std += e.all_stats[j][2];
-		two += e.all_stats[j][5];
-		three += e.all_stats[j][6];
-		for (size_t k = 0; k < e.all_stats[0].size(); k++)
-		{
-			cout << e.all_stats[j][k] << " ";
-		}
-		cout << "\n\n";
-	}
-	cout << "Average EPE: " << EPE / no_of_images << "\n\n";
+	e.stats.print();
+	cout << "\nAverage EPE: " << e.stats.mean(StatsAggregator::FIELD_EPE) << "\n\n";
 
-	cout << "Average R2.0: " << two / no_of_images << "\n\n";
+	cout << "Average R2.0: " << e.stats.mean(StatsAggregator::FIELD_R2) << "\n\n";
 
-	cout << "Average R3.0: " << three / no_of_images << "\n\n";
+	cout << "Average R3.0: " << e.stats.mean(StatsAggregator::FIELD_R3) << "\n\n";
 
-	cout << "Average Time: " << time / no_of_images << "\n\n";
+	cout << "Average Time: " << e.stats.mean(StatsAggregator::FIELD_TIME) << "\n\n";
 
-	cout << "Average STD: " << std / no_of_images << "\n\n";
+	cout << "Average STD: " << e.stats.mean(StatsAggregator::FIELD_STD) << "\n\n";
 	cout << "--------------------------------------------";
 
+	if (result_writer) {
+		result_writer->flush();
+		printf("\n%lld results written to %s\n", result_writer->written(), results_dir.c_str());
+	}
+
+	if (!profile_prefix.empty()) {
+		StageProfiler& profiler = StageProfiler::instance();
+		profiler.writeJSON(profile_prefix + ".json");
+		profiler.writeCSV(profile_prefix + ".csv");
+		profiler.writePrometheus(profile_prefix + ".prom");
+		profiler.writeChromeTrace(profile_prefix + "_trace.json");
+		MemoryAccounting::instance().writeCSV(profile_prefix + "_memory.csv");
+		cout << "\nStage profile written to " << profile_prefix << ".*\n";
+	}
+
 	/////////////////////////////////////////////////////////////////////////
 	
 	
@@ -84,62 +301,7 @@ int main(int argc, char** argv)
 
 
 	//////////////// SAMPLE VIDEO ///////////////////
-	// Writes a demo video of degraf flow on a KITTI odometry image sequence
-
-	//VideoWriter outputVideo;
-	//
-	//Mat t = imread("D:/data_odometry_gray/dataset/sequences/00/image_0/000000.png"); // change this 
-	//outputVideo.open("C:/Users/felix/OneDrive/Documents/Uni/Year 4/project/Images/output/Videos/trialflow_3.avi", CV_FOURCC('D', 'I', 'V', 'X'), 10, Size(1241,752), true);
-
-	//if (!outputVideo.isOpened())
-	//{
-	//	cout << "Could not open the output video for write: " << endl;
-	//	return -1;
-	//}
-
-	//FeatureMatcher f = FeatureMatcher();
-
-	//int MAX_FRAME = 500;
-	//char filename1[200];
-	//char filename2[200];
-	//sprintf(filename1, "D:/data_odometry_gray/dataset/sequences/00/image_0/%06d.png", 0); \\ change this to dir with list of video frames
-	//sprintf(filename2, "D:/data_odometry_gray/dataset/sequences/00/image_0/%06d.png", 1);
-	//Mat img_1 = imread(filename1);
-	//Mat img_2 = imread(filename2);
-
-	//Mat prevImage = img_2;
-	//Mat currImage;
-	//Mat flow;
-
-	//char filename[100];
-
-	//for (int numFrame = 2; numFrame < MAX_FRAME; numFrame++) {
-	//	cout << "\nFRAME #: " << numFrame << "\n";
-	//	sprintf(filename, "D:/data_odometry_gray/dataset/sequences/00/image_0/%06d.png", numFrame);
-	//	currImage = imread(filename);
-
-	//	f.calcOpticalFlowRLOF(prevImage, currImage, flow, 8, 127, (0.05000000075F), true, (500.0F), (1.5F));
-
-	//	cv::Mat win_mat(cv::Size(1241, 752), CV_8UC3);
-
-	//	flow = flowToDisplay(flow)*1.5;
-	//	flow.convertTo(flow, CV_8UC3, 255.0);
-	//	cout << t.size();
-	//	cout << "\ntypes:  " << flow.type() << ", " << prevImage.type();
-
-	//	// Copy small images into big mat
-	//	flow.copyTo(win_mat(cv::Rect(0, 376, 1241, 376)));
-	//	prevImage.copyTo(win_mat(cv::Rect(0, 0, 1241, 376)));	
-
-	//	outputVideo << win_mat;
-
-	//	imshow("prev", win_mat);
-	//	//imshow("curr", currImage);
-	//	//imshow("flow", flow);
-	//	waitKey(1);
-	//	prevImage = currImage.clone();
-	//}
-	//break;
+	// Writes a demo video of degraf flow on a KITTI odometry image sequence, see --video above
 
 	return 0;
 }
@@ -23,6 +23,8 @@
 
 #include "SaliencyDetector.h"
 #include "GradientDetector.h"
+#include "MemoryAccounting.h"
+#include "TrackTable.h"
 
 #include <RLOF_Flow.h>
 
@@ -30,13 +32,72 @@ using namespace cv;
 using namespace std;
 
 
+// Timing and drift of one run, against the ground truth poses
+struct OdometryReport {
+	int frames = 0;					// frames with a pose
+	int skipped = 0;				// frames given an interpolated pose instead of being tracked
+	double seconds = 0;				// wall time of the tracking loop
+	double path_length = 0;			// ground truth distance travelled, metres
+	double final_error = 0;			// distance between the last estimated and ground truth position, metres
+	double drift_percent = 0;		// final_error as a percentage of path_length
+	double rmse = 0;				// RMS position error over all frames, metres
+};
+
 class Odometry {
 	public:
+		// Sequence and camera, set to KITTI sequence 00 by the constructor
+		string image_pattern;		// printf pattern of the grey left images, e.g. .../00/image_0/%06d.png
+		string pose_file;			// ground truth poses, KITTI text or .dgp
+		double focal;				// pixels
+		cv::Point2d pp;				// principal point
+		int max_frame;				// frames to run, < 0 for every frame with a ground truth pose
+
+		// Frames decoded ahead of the tracking and held, the run's image memory
+		int ring_size = 8;
+
+		// Adaptive keyframes: a frame whose median track displacement from the last keyframe is below
+		// keyframe_motion pixels is not tracked, and at most max_skipped frames in a row are skipped
+		// (fewer if the ring is smaller). 0 tracks every frame.
+		double keyframe_motion = 0;
+		int max_skipped = 5;
+
+		// Prints the first pose and the totals
+		bool verbose = true;
+
+		// Filled in by run()
+		OdometryReport report;
+
+		// Skips all windows and drawing, for batch runs on display-less machines
+		bool headless = false;
+
+		// If not empty, run() writes the estimated poses there in the KITTI 3x4 pose format
+		string pose_output;
+
+		// When tracks run low, detect only in the grid cells short of tracks and keep the live ones,
+		// instead of detecting over the whole frame and restarting every track
+		bool bucketed_redetection = true;
+
 		Odometry();
+
+		// Reads focal and pp from the P0 line of a KITTI calib.txt
+		bool loadCalibration(const string& calib_path);
+
 		int run();
 		int runGroundTruth();
 };
 
+void featureTracking(Mat img_1, Mat img_2, vector<Point2f>& points1, vector<Point2f>& points2, vector<uchar>& status);
+void featureDetection(Mat img_1, vector<Point2f>& points1, vector<float>* responses = NULL);
+
+// Divides img into grid_cols x grid_rows cells and runs featureDetection only in the cells holding fewer
+// than cell_target live tracks, appending each cell's strongest new points up to the target
+/*!
+\param img frame the tracks' latest positions are in
+\param tracks live tracks, kept with their ids; the new points are appended
+\return number of tracks added
+*/
+int bucketedRedetection(const Mat& img, TrackTable& tracks, int grid_cols, int grid_rows, int cell_target);
+
 
 
 